@@ -0,0 +1,606 @@
+/*
+    resize-bench: times ResizeImageWithOptions on synthetic images for every
+    filter, source size and scale factor, one result line per case.
+
+    resize-bench [--format csv|json] [--engine double|fixed|float] [--threads n]
+                 [--weights analytic|table]
+                 [--alpha matte|opaque|premultiplied] [--light srgb|linear]
+                 [--progressive factor] [--cost default|calibrated]
+                 [--sizes 64,256,...]
+                 [--scales 0.1,0.5,...] [--filters point,box,...]
+                 [--orders rgba,bgra,rgb,gray,graya,rgba64]
+                 [--min-time seconds] [--max-pixels n]
+
+    --orders picks the pixel layouts, rgb to rgba64 are the RGB24, Gray8,
+    GrayAlpha16 and RGBA64 formats. --alpha opaque makes every source pixel
+    opaque, which the resize detects and filters without alpha weighting
+    where it can, --alpha premultiplied premultiplies the source and filters
+    it in the premultiplied mode. --light linear filters in linear light.
+    --progressive sets ResizeOptions.progressive_factor. psnr_db is the PSNR
+    of each result against the direct resize with the double engine, capped
+    at 99, and 0 for direct double resizes. mpix_per_s and ns_per_pixel are
+    measured on destination pixels. peak_rss is the high water mark of the whole
+    process in KiB when the case ended. first_pass and the *_ns stage
+    columns come from the ResizeStats of one more run after the timed ones.
+    --cost calibrated picks the pass order with CalibrateResizeCostModel
+    instead of the default costs.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resize.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#define MaxListLength 32
+
+static const char *filter_names[] = {"undefined",
+                                     "point",
+                                     "box",
+                                     "triangle",
+                                     "hermite",
+                                     "hanning",
+                                     "hamming",
+                                     "blackman",
+                                     "gaussian",
+                                     "quadratic",
+                                     "cubic",
+                                     "catrom",
+                                     "mitchell",
+                                     "lanczos",
+                                     "bessel",
+                                     "sinc"};
+
+static const uint64_t default_sizes[] = {64, 256, 1024, 1920, 3840, 7680};
+static const double default_scales[] = {0.1, 0.25, 0.5, 0.75, 1.5, 2.0, 4.0};
+
+typedef struct _BenchOrder {
+    const char *name;
+    MagickPixelOrder order;
+    MagickPixelFormat format;
+} BenchOrder;
+
+static const BenchOrder bench_orders[] = {
+    {"rgba", {0, 1, 2, 3}, RGBA32PixelFormat},
+    {"bgra", {2, 1, 0, 3}, RGBA32PixelFormat},
+    {"rgb", {0, 1, 2, 3}, RGB24PixelFormat},
+    {"gray", {0, 1, 2, 3}, Gray8PixelFormat},
+    {"graya", {0, 1, 2, 3}, GrayAlpha16PixelFormat},
+    {"rgba64", {0, 1, 2, 3}, RGBA64PixelFormat}};
+
+typedef struct _BenchConfig {
+    bool json;
+    ResizeOptions options;
+    const char *engine;
+    const char *weights;
+    const char *alpha;
+    const char *light;
+    double progressive;
+    ResizeCostModel cost_model;
+    double min_time;
+    uint64_t max_pixels;
+    uint64_t sizes[MaxListLength];
+    size_t sizes_count;
+    double scales[MaxListLength];
+    size_t scales_count;
+    FilterTypes filters[MaxListLength];
+    size_t filters_count;
+    const BenchOrder *orders[MaxListLength];
+    size_t orders_count;
+} BenchConfig;
+
+static double GetSeconds(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif
+}
+
+static uint64_t GetPeakRSS(void) {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return (uint64_t)counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+    return (uint64_t)usage.ru_maxrss / 1024;
+#else
+    return (uint64_t)usage.ru_maxrss;
+#endif
+#endif
+}
+
+/*
+    PSNR of b against a over every sample, 16 bit samples peak at 65535.
+*/
+static double GetPSNR(const MagickImage *a, const MagickImage *b) {
+    const bool wide = a->format == RGBA64PixelFormat;
+    const uint64_t samples =
+        a->columns * a->rows * GetPixelFormatSize(a->format) / (wide ? 2 : 1);
+    const double peak = wide ? 65535.0 : 255.0;
+    double error = 0.0;
+    for (uint64_t i = 0; i < samples; i++) {
+        double d = wide ? (double)((const uint16_t *)a->pixels)[i] -
+                              ((const uint16_t *)b->pixels)[i]
+                        : (double)((const MagickQuantum *)a->pixels)[i] -
+                              ((const MagickQuantum *)b->pixels)[i];
+        error += d * d;
+    }
+    if (error == 0.0) return 99.0;
+    double psnr = 10.0 * log10(peak * peak * samples / error);
+    return psnr < 99.0 ? psnr : 99.0;
+}
+
+/*
+    Smooth gradients with noise and a mix of opaque, translucent and
+    transparent pixels, so the matte paths are all taken, or only opaque
+    pixels.
+*/
+static void FillSyntheticImage(MagickImage *image, const bool opaque) {
+    const uint64_t size = GetPixelFormatSize(image->format);
+    const MagickPixelOrder order = image->order;
+    uint32_t seed = 0x9e3779b9u;
+    for (uint64_t y = 0; y < image->rows; y++) {
+        for (uint64_t x = 0; x < image->columns; x++) {
+            MagickQuantum *p = (MagickQuantum *)image->pixels +
+                               (y * image->columns + x) * size;
+            uint16_t *w = (uint16_t *)p;
+            MagickQuantum red, green, blue, alpha;
+            seed = seed * 1664525u + 1013904223u;
+            red = (MagickQuantum)(x * 255 / image->columns);
+            green = (MagickQuantum)(y * 255 / image->rows);
+            blue = (MagickQuantum)(seed >> 24);
+            switch ((x / 16 + y / 16) % 4) {
+                case 0:
+                    alpha = 255;
+                    break;
+                case 1:
+                    alpha = 0;
+                    break;
+                default:
+                    alpha = (MagickQuantum)(seed >> 16);
+                    break;
+            }
+            if (opaque) alpha = 255;
+            switch (image->format) {
+                case Gray8PixelFormat:
+                    p[0] = (MagickQuantum)((red + green + blue) / 3);
+                    break;
+                case GrayAlpha16PixelFormat:
+                    p[0] = (MagickQuantum)((red + green + blue) / 3);
+                    p[1] = alpha;
+                    break;
+                case RGBA64PixelFormat:
+                    w[order.red] = (uint16_t)(red * 257);
+                    w[order.green] = (uint16_t)(green * 257);
+                    w[order.blue] = (uint16_t)(blue * 257);
+                    w[order.opacity] =
+                        (uint16_t)(opaque ? 65535 : alpha * 257 + (seed & 255));
+                    break;
+                default:
+                    p[order.red] = red;
+                    p[order.green] = green;
+                    p[order.blue] = blue;
+                    if (image->format == RGBA32PixelFormat) {
+                        p[order.opacity] = alpha;
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+static bool ParseFilter(const char *name, FilterTypes *filter) {
+    for (size_t i = 0; i < sizeof(filter_names) / sizeof(filter_names[0]);
+         i++) {
+        if (strcmp(name, filter_names[i]) == 0) {
+            *filter = (FilterTypes)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ParseList(BenchConfig *config, const char *option, char *value) {
+    for (char *item = strtok(value, ","); item != NULL;
+         item = strtok(NULL, ",")) {
+        if (strcmp(option, "--sizes") == 0) {
+            if (config->sizes_count == MaxListLength) return false;
+            config->sizes[config->sizes_count] = strtoull(item, NULL, 10);
+            if (config->sizes[config->sizes_count++] == 0) return false;
+        } else if (strcmp(option, "--scales") == 0) {
+            if (config->scales_count == MaxListLength) return false;
+            config->scales[config->scales_count] = atof(item);
+            if (config->scales[config->scales_count++] <= 0.0) return false;
+        } else if (strcmp(option, "--filters") == 0) {
+            if (config->filters_count == MaxListLength ||
+                !ParseFilter(item, &config->filters[config->filters_count++]))
+                return false;
+        } else {
+            const size_t count = sizeof(bench_orders) / sizeof(bench_orders[0]);
+            size_t i = 0;
+            while (i < count && strcmp(item, bench_orders[i].name) != 0) i++;
+            if (i == count || config->orders_count == MaxListLength) {
+                return false;
+            }
+            config->orders[config->orders_count++] = &bench_orders[i];
+        }
+    }
+    return true;
+}
+
+static bool ParseArguments(BenchConfig *config, int argc, char *argv[]) {
+    memset(config, 0, sizeof(BenchConfig));
+    GetResizeOptions(&config->options);
+    config->engine = "double";
+    config->weights = "analytic";
+    config->alpha = "matte";
+    config->light = "srgb";
+    config->min_time = 0.2;
+    config->max_pixels = 64 * 1024 * 1024;
+    for (int i = 1; i < argc; i++) {
+        const char *option = argv[i];
+        if (i + 1 == argc) return false;
+        char *value = argv[++i];
+        if (strcmp(option, "--format") == 0) {
+            if (strcmp(value, "json") != 0 && strcmp(value, "csv") != 0)
+                return false;
+            config->json = strcmp(value, "json") == 0;
+        } else if (strcmp(option, "--engine") == 0) {
+            if (strcmp(value, "double") == 0) {
+                config->options.engine = DoubleResizeEngine;
+            } else if (strcmp(value, "fixed") == 0) {
+                config->options.engine = FixedPointResizeEngine;
+            } else if (strcmp(value, "float") == 0) {
+                config->options.engine = FloatResizeEngine;
+            } else {
+                return false;
+            }
+            config->engine = value;
+        } else if (strcmp(option, "--weights") == 0) {
+            if (strcmp(value, "analytic") != 0 && strcmp(value, "table") != 0)
+                return false;
+            config->options.tabulate_filters = strcmp(value, "table") == 0;
+            config->weights = value;
+        } else if (strcmp(option, "--alpha") == 0) {
+            if (strcmp(value, "premultiplied") == 0) {
+                config->options.alpha = PremultipliedResizeAlpha;
+            } else if (strcmp(value, "matte") != 0 &&
+                       strcmp(value, "opaque") != 0) {
+                return false;
+            }
+            config->alpha = value;
+        } else if (strcmp(option, "--light") == 0) {
+            if (strcmp(value, "srgb") != 0 && strcmp(value, "linear") != 0)
+                return false;
+            config->options.linear_light = strcmp(value, "linear") == 0;
+            config->light = value;
+        } else if (strcmp(option, "--progressive") == 0) {
+            config->progressive = atof(value);
+            if (config->progressive < 0.0) return false;
+            config->options.progressive_factor = config->progressive;
+        } else if (strcmp(option, "--cost") == 0) {
+            if (strcmp(value, "calibrated") == 0) {
+                if (CalibrateResizeCostModel(&config->cost_model) != 0)
+                    return false;
+                config->options.cost_model = &config->cost_model;
+            } else if (strcmp(value, "default") != 0) {
+                return false;
+            }
+        } else if (strcmp(option, "--threads") == 0) {
+            config->options.threads = atoi(value);
+        } else if (strcmp(option, "--min-time") == 0) {
+            config->min_time = atof(value);
+        } else if (strcmp(option, "--max-pixels") == 0) {
+            config->max_pixels = strtoull(value, NULL, 10);
+        } else if (strcmp(option, "--sizes") == 0 ||
+                   strcmp(option, "--scales") == 0 ||
+                   strcmp(option, "--filters") == 0 ||
+                   strcmp(option, "--orders") == 0) {
+            if (!ParseList(config, option, value)) return false;
+        } else {
+            return false;
+        }
+    }
+    if (config->sizes_count == 0) {
+        config->sizes_count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+        memcpy(config->sizes, default_sizes, sizeof(default_sizes));
+    }
+    if (config->scales_count == 0) {
+        config->scales_count =
+            sizeof(default_scales) / sizeof(default_scales[0]);
+        memcpy(config->scales, default_scales, sizeof(default_scales));
+    }
+    if (config->filters_count == 0) {
+        for (int i = PointFilter; i <= SincFilter; i++) {
+            config->filters[config->filters_count++] = (FilterTypes)i;
+        }
+    }
+    if (config->orders_count == 0) {
+        config->orders[config->orders_count++] = &bench_orders[0];
+    }
+    return true;
+}
+
+static void PrintHeader(const BenchConfig *config) {
+    if (config->json) {
+        printf("[\n");
+        return;
+    }
+    printf(
+        "filter,engine,weights,alpha,light,progressive,threads,order,"
+        "src_columns,src_rows,"
+        "columns,rows,scale,iterations,seconds,mpix_per_s,ns_per_pixel,"
+        "psnr_db,peak_rss_kb,first_pass,plan_ns,setup_ns,reduce_ns,"
+        "first_pass_ns,second_pass_ns\n");
+}
+
+static void PrintResult(const BenchConfig *config,
+                        const FilterTypes filter,
+                        const BenchOrder *order,
+                        const MagickImage *src,
+                        const MagickImage *dst,
+                        const double scale,
+                        const uint64_t iterations,
+                        const double seconds,
+                        const double psnr,
+                        const ResizeStats *stats,
+                        bool *first) {
+    double pixels = (double)dst->columns * dst->rows * iterations;
+    double mpix_per_s = pixels / seconds * 1e-6;
+    double ns_per_pixel = seconds / pixels * 1e9;
+    unsigned long long peak_rss = (unsigned long long)GetPeakRSS();
+    const char *pass = stats->fast_path          ? "fast"
+                       : stats->horizontal_first ? "horizontal"
+                                                 : "vertical";
+    if (config->json) {
+        printf(
+            "%s  {\"filter\": \"%s\", \"engine\": \"%s\", \"weights\": \"%s\", "
+            "\"alpha\": \"%s\", \"light\": \"%s\", \"progressive\": %g, "
+            "\"threads\": %d, "
+            "\"order\": \"%s\", "
+            "\"src_columns\": %llu, "
+            "\"src_rows\": %llu, \"columns\": %llu, \"rows\": %llu, "
+            "\"scale\": %g, "
+            "\"iterations\": %llu, \"seconds\": %.6f, \"mpix_per_s\": %.3f, "
+            "\"ns_per_pixel\": %.3f, \"psnr_db\": %.2f, "
+            "\"peak_rss_kb\": %llu, \"first_pass\": \"%s\", "
+            "\"plan_ns\": %llu, \"setup_ns\": %llu, \"reduce_ns\": %llu, "
+            "\"first_pass_ns\": %llu, \"second_pass_ns\": %llu}",
+            *first ? "" : ",\n",
+            filter_names[filter],
+            config->engine,
+            config->weights,
+            config->alpha,
+            config->light,
+            config->progressive,
+            config->options.threads,
+            order->name,
+            (unsigned long long)src->columns,
+            (unsigned long long)src->rows,
+            (unsigned long long)dst->columns,
+            (unsigned long long)dst->rows,
+            scale,
+            (unsigned long long)iterations,
+            seconds,
+            mpix_per_s,
+            ns_per_pixel,
+            psnr,
+            peak_rss,
+            pass,
+            (unsigned long long)stats->plan_ns,
+            (unsigned long long)stats->setup_ns,
+            (unsigned long long)stats->reduce_ns,
+            (unsigned long long)stats->first_pass_ns,
+            (unsigned long long)stats->second_pass_ns);
+    } else {
+        printf("%s,%s,%s,%s,%s,%g,%d,%s,%llu,%llu,%llu,%llu,%g,%llu,%.6f,"
+               "%.3f,%.3f,%.2f,%llu,%s,%llu,%llu,%llu,%llu,%llu\n",
+               filter_names[filter],
+               config->engine,
+               config->weights,
+               config->alpha,
+               config->light,
+               config->progressive,
+               config->options.threads,
+               order->name,
+               (unsigned long long)src->columns,
+               (unsigned long long)src->rows,
+               (unsigned long long)dst->columns,
+               (unsigned long long)dst->rows,
+               scale,
+               (unsigned long long)iterations,
+               seconds,
+               mpix_per_s,
+               ns_per_pixel,
+               psnr,
+               peak_rss,
+               pass,
+               (unsigned long long)stats->plan_ns,
+               (unsigned long long)stats->setup_ns,
+               (unsigned long long)stats->reduce_ns,
+               (unsigned long long)stats->first_pass_ns,
+               (unsigned long long)stats->second_pass_ns);
+    }
+    *first = false;
+    fflush(stdout);
+}
+
+/*
+    Repeats one resize until min_time has passed, after one untimed run
+    that warms the caches and the lazily initialized kernels, then runs it
+    once more with stats.
+*/
+static int RunCase(const BenchConfig *config,
+                   const MagickImage *src,
+                   const MagickImage *dst,
+                   const FilterTypes filter,
+                   uint64_t *iterations,
+                   double *seconds,
+                   ResizeStats *stats) {
+    ResizeOptions options = config->options;
+    int ret = ResizeImageWithOptions(src, dst, filter, 1.0, &config->options);
+    if (ret != 0) return ret;
+    double start = GetSeconds(), now = start;
+    *iterations = 0;
+    do {
+        ret = ResizeImageWithOptions(src, dst, filter, 1.0, &config->options);
+        if (ret != 0) return ret;
+        (*iterations)++;
+        now = GetSeconds();
+    } while (now - start < config->min_time);
+    *seconds = now - start;
+    options.stats = stats;
+    return ResizeImageWithOptions(src, dst, filter, 1.0, &options);
+}
+
+/*
+    PSNR of the result in dst against the direct resize with the double
+    engine, 0 when the direct resize fails.
+*/
+static double MeasureReferencePSNR(const BenchConfig *config,
+                                     const MagickImage *src,
+                                     const MagickImage *dst,
+                                     const FilterTypes filter) {
+    ResizeOptions options = config->options;
+    MagickImage reference = *dst;
+    double psnr = 0.0;
+    options.engine = DoubleResizeEngine;
+    options.progressive_factor = 0.0;
+    reference.pixels = (MagickPixelPacket4 *)malloc(
+        dst->columns * dst->rows * GetPixelFormatSize(dst->format));
+    if (reference.pixels != NULL &&
+        ResizeImageWithOptions(src, &reference, filter, 1.0, &options) == 0) {
+        psnr = GetPSNR(&reference, dst);
+    }
+    free(reference.pixels);
+    return psnr;
+}
+
+int main(int argc, char *argv[]) {
+    BenchConfig config;
+    bool first = true;
+    int status = 0;
+
+    if (!ParseArguments(&config, argc, argv)) {
+        fprintf(stderr,
+                "usage: %s [--format csv|json] [--engine double|fixed|float] "
+                "[--threads n] [--weights analytic|table] "
+                "[--alpha matte|opaque|premultiplied] [--light srgb|linear] "
+                "[--progressive factor] [--cost default|calibrated] "
+                "[--sizes 64,256] [--scales 0.5,2] "
+                "[--filters point,box] [--orders rgba,gray] "
+                "[--min-time seconds] [--max-pixels n]\n",
+                argv[0]);
+        return 1;
+    }
+    PrintHeader(&config);
+    for (size_t o = 0; o < config.orders_count; o++) {
+        for (size_t s = 0; s < config.sizes_count; s++) {
+            // 16:9 sources, 64px is square
+            uint64_t columns = config.sizes[s];
+            uint64_t rows = columns <= 64 ? columns : columns * 9 / 16;
+            MagickImage src = {NULL,
+                               config.orders[o]->order,
+                               columns,
+                               rows,
+                               0,
+                               config.orders[o]->format};
+            uint64_t size = GetPixelFormatSize(src.format);
+            if (columns * rows > config.max_pixels) continue;
+            src.pixels = (MagickPixelPacket4 *)malloc(columns * rows * size);
+            if (src.pixels == NULL) {
+                fprintf(stderr, "out of memory for %llux%llu\n",
+                        (unsigned long long)columns,
+                        (unsigned long long)rows);
+                status = 2;
+                continue;
+            }
+            FillSyntheticImage(&src, strcmp(config.alpha, "opaque") == 0);
+            if (config.options.alpha == PremultipliedResizeAlpha) {
+                PremultiplyImage(&src);
+            }
+            for (size_t k = 0; k < config.scales_count; k++) {
+                double scale = config.scales[k];
+                MagickImage dst = {NULL,
+                                   config.orders[o]->order,
+                                   (uint64_t)(columns * scale + 0.5),
+                                   (uint64_t)(rows * scale + 0.5),
+                                   0,
+                                   src.format};
+                if (dst.columns == 0 || dst.rows == 0 ||
+                    dst.columns * dst.rows > config.max_pixels) {
+                    continue;
+                }
+                dst.pixels = (MagickPixelPacket4 *)malloc(dst.columns *
+                                                          dst.rows * size);
+                if (dst.pixels == NULL) {
+                    status = 2;
+                    continue;
+                }
+                for (size_t f = 0; f < config.filters_count; f++) {
+                    ResizeStats stats;
+                    uint64_t iterations = 0;
+                    double seconds = 0.0;
+                    int ret = RunCase(&config,
+                                      &src,
+                                      &dst,
+                                      config.filters[f],
+                                      &iterations,
+                                      &seconds,
+                                      &stats);
+                    if (ret != 0) {
+                        fprintf(stderr,
+                                "%s %llux%llu -> %llux%llu failed with %d\n",
+                                filter_names[config.filters[f]],
+                                (unsigned long long)columns,
+                                (unsigned long long)rows,
+                                (unsigned long long)dst.columns,
+                                (unsigned long long)dst.rows,
+                                ret);
+                        status = ret;
+                        continue;
+                    }
+                    double psnr = 0.0;
+                    if (config.progressive > 0.0 ||
+                        config.options.engine != DoubleResizeEngine) {
+                        psnr = MeasureReferencePSNR(
+                            &config, &src, &dst, config.filters[f]);
+                    }
+                    PrintResult(&config,
+                                config.filters[f],
+                                config.orders[o],
+                                &src,
+                                &dst,
+                                scale,
+                                iterations,
+                                seconds,
+                                psnr,
+                                &stats,
+                                &first);
+                }
+                free(dst.pixels);
+            }
+            free(src.pixels);
+        }
+    }
+    if (config.json) printf("\n]\n");
+    return status;
+}
@@ -0,0 +1,827 @@
+/*
+    resize-cli: resizes image files to one or more sizes without a window.
+
+    resize-cli [--sizes 640x480,320x,x240] [--filter lanczos] [--blur 1.0]
+               [--engine double|fixed|float] [--workers n] [--depth n]
+               [--output dir] [--raw WxH] [--list file] path...
+
+    Every path is a file or a directory, whose files with a known extension
+    are taken (not recursively). --list adds the paths of a file, one per
+    line, - reads them from stdin. Binary PPM, PGM and PAM (maxval 255) are
+    decoded as RGB24, Gray8, GrayAlpha16 or RGBA32 and written back in the
+    same format, .rgba and .raw files are RGBA32 of the --raw size. Built
+    with SDL_image, any other image it loads is resized as RGBA32 and
+    written as PNG. A size of Wx or xH keeps the aspect ratio. Outputs are
+    named <output>/<name>_<columns>x<rows>.<ext>, output defaults to ".".
+
+    The main thread reads and decodes files and submits one ResizeQueue job
+    per output, a writer thread encodes and writes the finished outputs, so
+    file I/O overlaps the resizes. At most workers + depth outputs are in
+    flight, which bounds the memory held. Throughput statistics are printed
+    at the end, the exit status is 1 when any file or output failed.
+*/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resize.h"
+#include "thread.h"
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef USE_SDL_IMAGE
+#include <SDL.h>
+#include <SDL_image.h>
+#endif
+
+#define MaxListLength 32
+#define MaxPathLength 4096
+
+static const char *filter_names[] = {"undefined",
+                                     "point",
+                                     "box",
+                                     "triangle",
+                                     "hermite",
+                                     "hanning",
+                                     "hamming",
+                                     "blackman",
+                                     "gaussian",
+                                     "quadratic",
+                                     "cubic",
+                                     "catrom",
+                                     "mitchell",
+                                     "lanczos",
+                                     "bessel",
+                                     "sinc"};
+
+typedef enum {
+    UnknownFile,
+    PPMFile,  // P6
+    PGMFile,  // P5
+    PAMFile,  // P7
+    RawFile,
+    SDLFile
+} FileKind;
+
+typedef struct _CliSize {
+    uint64_t columns;  // 0 keeps the aspect ratio
+    uint64_t rows;
+} CliSize;
+
+typedef struct _CliConfig {
+    ResizeOptions options;
+    FilterTypes filter;
+    double blur;
+    int workers;
+    uint64_t depth;
+    const char *output;
+    uint64_t raw_columns;
+    uint64_t raw_rows;
+    CliSize sizes[MaxListLength];
+    size_t sizes_count;
+} CliConfig;
+
+typedef struct _SourceImage {
+    char path[MaxPathLength];
+    FileKind kind;
+    MagickImage image;
+    void *data;        // file contents, the pixels point into them
+    uint64_t pending;  // outputs not written yet
+#ifdef USE_SDL_IMAGE
+    SDL_Surface *surface;
+#endif
+} SourceImage;
+
+typedef struct _Pipeline Pipeline;
+
+typedef struct _OutputImage {
+    Pipeline *pipeline;
+    SourceImage *source;
+    MagickImage image;
+    int status;
+    struct _OutputImage *next;
+} OutputImage;
+
+typedef struct _CliStats {
+    uint64_t files;
+    uint64_t failed_files;
+    uint64_t outputs;
+    uint64_t failed_outputs;
+    uint64_t input_pixels;
+    uint64_t output_pixels;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t read_ns;   // reading and decoding, main thread
+    uint64_t block_ns;  // main thread waiting for a free slot
+    uint64_t write_ns;  // encoding and writing, writer thread
+} CliStats;
+
+// Finished outputs travel from the queue workers to the writer thread.
+struct _Pipeline {
+    const CliConfig *config;
+    MagickMutex mutex;
+    MagickCond cond;
+    OutputImage *head;  // finished, oldest first
+    OutputImage *tail;
+    uint64_t in_flight;  // submitted and not written yet
+    uint64_t limit;
+    bool finished;  // every output has been submitted
+    CliStats stats;
+};
+
+static bool ParseFilter(const char *name, FilterTypes *filter) {
+    for (size_t i = 0; i < sizeof(filter_names) / sizeof(filter_names[0]);
+         i++) {
+        if (strcmp(name, filter_names[i]) == 0) {
+            *filter = (FilterTypes)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// WxH, Wx or xH, at least one side given.
+static bool ParseSize(const char *value, CliSize *size) {
+    const char *x = strchr(value, 'x');
+    if (x == NULL) return false;
+    size->columns = strtoull(value, NULL, 10);
+    size->rows = strtoull(x + 1, NULL, 10);
+    return size->columns != 0 || size->rows != 0;
+}
+
+static bool ParseSizes(CliConfig *config, char *value) {
+    for (char *item = strtok(value, ","); item != NULL;
+         item = strtok(NULL, ",")) {
+        if (config->sizes_count == MaxListLength ||
+            !ParseSize(item, &config->sizes[config->sizes_count++])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char *GetExtension(const char *path) {
+    const char *dot = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    const char *backslash = strrchr(path, '\\');
+    if (dot == NULL || (slash != NULL && dot < slash) ||
+        (backslash != NULL && dot < backslash)) {
+        return "";
+    }
+    return dot + 1;
+}
+
+static bool IsExtension(const char *extension, const char *name) {
+    for (; *extension != '\0' && *name != '\0'; extension++, name++) {
+        char c = *extension;
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if (c != *name) return false;
+    }
+    return *extension == *name;
+}
+
+static FileKind GetFileKind(const CliConfig *config, const char *path) {
+    const char *extension = GetExtension(path);
+    if (IsExtension(extension, "ppm") || IsExtension(extension, "pgm") ||
+        IsExtension(extension, "pnm") || IsExtension(extension, "pam")) {
+        return PPMFile;  // the header tells which one
+    }
+    if (IsExtension(extension, "rgba") || IsExtension(extension, "raw")) {
+        return config->raw_columns != 0 ? RawFile : UnknownFile;
+    }
+#ifdef USE_SDL_IMAGE
+    static const char *sdl_extensions[] = {
+        "png", "jpg", "jpeg", "bmp", "gif", "tga", "tif", "tiff", "webp"};
+    for (size_t i = 0; i < sizeof(sdl_extensions) / sizeof(sdl_extensions[0]);
+         i++) {
+        if (IsExtension(extension, sdl_extensions[i])) return SDLFile;
+    }
+#endif
+    return UnknownFile;
+}
+
+static void *ReadFileData(const char *path, uint64_t *length) {
+    FILE *file = fopen(path, "rb");
+    void *data = NULL;
+    long size;
+    if (file == NULL) return NULL;
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 &&
+        fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(size > 0 ? (size_t)size : 1);
+        if (data != NULL &&
+            fread(data, 1, (size_t)size, file) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+        *length = (uint64_t)size;
+    }
+    fclose(file);
+    return data;
+}
+
+// Next whitespace separated token of a netpbm header, comments skipped.
+static const char *ReadToken(const char *p, const char *end, char *token) {
+    size_t n = 0;
+    while (p < end) {
+        if (*p == '#') {
+            while (p < end && *p != '\n') p++;
+        } else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            p++;
+        } else {
+            break;
+        }
+    }
+    while (p < end && n < 63 && *p != ' ' && *p != '\t' && *p != '\r' &&
+           *p != '\n') {
+        token[n++] = *p++;
+    }
+    token[n] = '\0';
+    return p;
+}
+
+/*
+    Points image at the samples of a binary PPM, PGM or PAM file held in
+    data. Only 8 bit samples are taken.
+*/
+static bool DecodeNetpbm(const char *data,
+                         const uint64_t length,
+                         MagickImage *image,
+                         FileKind *kind) {
+    const char *p = data, *end = data + length;
+    char token[64];
+    uint64_t depth = 0, maxval = 0;
+    image->columns = image->rows = 0;
+    p = ReadToken(p, end, token);
+    if (strcmp(token, "P5") == 0 || strcmp(token, "P6") == 0) {
+        *kind = token[1] == '5' ? PGMFile : PPMFile;
+        depth = *kind == PGMFile ? 1 : 3;
+        p = ReadToken(p, end, token);
+        image->columns = strtoull(token, NULL, 10);
+        p = ReadToken(p, end, token);
+        image->rows = strtoull(token, NULL, 10);
+        p = ReadToken(p, end, token);
+        maxval = strtoull(token, NULL, 10);
+        p++;  // single whitespace before the samples
+    } else if (strcmp(token, "P7") == 0) {
+        *kind = PAMFile;
+        for (;;) {
+            p = ReadToken(p, end, token);
+            if (token[0] == '\0') return false;
+            if (strcmp(token, "ENDHDR") == 0) break;
+            if (strcmp(token, "TUPLTYPE") == 0) {
+                p = ReadToken(p, end, token);
+                continue;
+            }
+            char key[64];
+            strcpy(key, token);
+            p = ReadToken(p, end, token);
+            if (strcmp(key, "WIDTH") == 0) {
+                image->columns = strtoull(token, NULL, 10);
+            } else if (strcmp(key, "HEIGHT") == 0) {
+                image->rows = strtoull(token, NULL, 10);
+            } else if (strcmp(key, "DEPTH") == 0) {
+                depth = strtoull(token, NULL, 10);
+            } else if (strcmp(key, "MAXVAL") == 0) {
+                maxval = strtoull(token, NULL, 10);
+            }
+        }
+        p++;  // newline after ENDHDR
+    } else {
+        return false;
+    }
+    static const MagickPixelFormat formats[] = {Gray8PixelFormat,
+                                                GrayAlpha16PixelFormat,
+                                                RGB24PixelFormat,
+                                                RGBA32PixelFormat};
+    if (maxval != 255 || depth < 1 || depth > 4 || image->columns == 0 ||
+        image->rows == 0 || p > end ||
+        (uint64_t)(end - p) / depth / image->columns < image->rows) {
+        return false;
+    }
+    image->pixels = (MagickPixelPacket4 *)p;
+    image->order = (MagickPixelOrder){0, 1, 2, 3};
+    image->stride = 0;
+    image->format = formats[depth - 1];
+    return true;
+}
+
+static void FreeSource(SourceImage *source) {
+#ifdef USE_SDL_IMAGE
+    if (source->surface != NULL) SDL_FreeSurface(source->surface);
+#endif
+    free(source->data);
+    free(source);
+}
+
+static SourceImage *ReadSource(const CliConfig *config,
+                               const char *path,
+                               CliStats *stats) {
+    SourceImage *source = (SourceImage *)calloc(1, sizeof(SourceImage));
+    uint64_t length = 0;
+    if (source == NULL) return NULL;
+    snprintf(source->path, sizeof(source->path), "%s", path);
+    source->kind = GetFileKind(config, path);
+#ifdef USE_SDL_IMAGE
+    if (source->kind == SDLFile) {
+        SDL_Surface *surface = IMG_Load(path);
+        if (surface != NULL) {
+            source->surface = SDL_ConvertSurfaceFormat(
+                surface, SDL_PIXELFORMAT_RGBA32, 0);
+            SDL_FreeSurface(surface);
+        }
+        if (source->surface == NULL) {
+            fprintf(stderr, "%s: %s\n", path, SDL_GetError());
+            FreeSource(source);
+            return NULL;
+        }
+        source->image.pixels = (MagickPixelPacket4 *)source->surface->pixels;
+        source->image.order = (MagickPixelOrder){0, 1, 2, 3};
+        source->image.columns = (uint64_t)source->surface->w;
+        source->image.rows = (uint64_t)source->surface->h;
+        source->image.stride = (uint64_t)source->surface->pitch;
+        source->image.format = RGBA32PixelFormat;
+        stats->bytes_read += source->image.stride * source->image.rows;
+        return source;
+    }
+#endif
+    source->data = ReadFileData(path, &length);
+    if (source->data == NULL) {
+        fprintf(stderr, "%s: cannot read\n", path);
+        FreeSource(source);
+        return NULL;
+    }
+    stats->bytes_read += length;
+    if (source->kind == RawFile) {
+        source->image.pixels = (MagickPixelPacket4 *)source->data;
+        source->image.order = (MagickPixelOrder){0, 1, 2, 3};
+        source->image.columns = config->raw_columns;
+        source->image.rows = config->raw_rows;
+        source->image.stride = 0;
+        source->image.format = RGBA32PixelFormat;
+        if (length == config->raw_columns * config->raw_rows * 4) {
+            return source;
+        }
+    } else if (DecodeNetpbm((const char *)source->data,
+                            length,
+                            &source->image,
+                            &source->kind)) {
+        return source;
+    }
+    fprintf(stderr, "%s: unsupported or truncated image\n", path);
+    FreeSource(source);
+    return NULL;
+}
+
+static const char *GetOutputExtension(const FileKind kind) {
+    switch (kind) {
+        case PGMFile:
+            return "pgm";
+        case PAMFile:
+            return "pam";
+        case RawFile:
+            return "rgba";
+        case SDLFile:
+            return "png";
+        default:
+            return "ppm";
+    }
+}
+
+static void GetOutputPath(const CliConfig *config,
+                          const OutputImage *output,
+                          char *path) {
+    const char *name = output->source->path;
+    const char *slash = strrchr(name, '/');
+    const char *backslash = strrchr(name, '\\');
+    if (slash != NULL) name = slash + 1;
+    if (backslash != NULL && backslash + 1 > name) name = backslash + 1;
+    const char *extension = GetExtension(name);
+    const int length = extension[0] != '\0' ? (int)(extension - 1 - name)
+                                            : (int)strlen(name);
+    snprintf(path,
+             MaxPathLength,
+             "%s/%.*s_%llux%llu.%s",
+             config->output,
+             length,
+             name,
+             (unsigned long long)output->image.columns,
+             (unsigned long long)output->image.rows,
+             GetOutputExtension(output->source->kind));
+}
+
+static bool WriteOutput(const CliConfig *config,
+                        const OutputImage *output,
+                        uint64_t *bytes) {
+    static const char *tuple_types[] = {
+        "GRAYSCALE", "GRAYSCALE_ALPHA", "RGB", "RGB_ALPHA"};
+    const MagickImage *image = &output->image;
+    const uint64_t depth = GetPixelFormatSize(image->format);
+    const uint64_t size = image->columns * image->rows * depth;
+    char path[MaxPathLength];
+    GetOutputPath(config, output, path);
+#ifdef USE_SDL_IMAGE
+    if (output->source->kind == SDLFile) {
+        SDL_Surface *surface =
+            SDL_CreateRGBSurfaceWithFormatFrom(image->pixels,
+                                               (int)image->columns,
+                                               (int)image->rows,
+                                               32,
+                                               (int)(image->columns * 4),
+                                               SDL_PIXELFORMAT_RGBA32);
+        bool ok = surface != NULL && IMG_SavePNG(surface, path) == 0;
+        if (surface != NULL) SDL_FreeSurface(surface);
+        if (!ok) fprintf(stderr, "%s: %s\n", path, SDL_GetError());
+        *bytes += ok ? size : 0;
+        return ok;
+    }
+#endif
+    FILE *file = fopen(path, "wb");
+    int header = 0;
+    if (file == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    switch (output->source->kind) {
+        case PPMFile:
+        case PGMFile:
+            header = fprintf(file,
+                             "P%c\n%llu %llu\n255\n",
+                             output->source->kind == PGMFile ? '5' : '6',
+                             (unsigned long long)image->columns,
+                             (unsigned long long)image->rows);
+            break;
+        case PAMFile:
+            header = fprintf(file,
+                             "P7\nWIDTH %llu\nHEIGHT %llu\nDEPTH %llu\n"
+                             "MAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+                             (unsigned long long)image->columns,
+                             (unsigned long long)image->rows,
+                             (unsigned long long)depth,
+                             tuple_types[depth - 1]);
+            break;
+        default:
+            break;
+    }
+    bool ok = header >= 0 && fwrite(image->pixels, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) fprintf(stderr, "%s: write failed\n", path);
+    *bytes += ok ? (uint64_t)header + size : 0;
+    return ok;
+}
+
+// Hands output over to the writer thread, called on the queue workers.
+static void FinishOutput(OutputImage *output, const int status) {
+    Pipeline *pipeline = output->pipeline;
+    output->status = status;
+    output->next = NULL;
+    MagickMutexLock(&pipeline->mutex);
+    if (pipeline->tail != NULL) {
+        pipeline->tail->next = output;
+    } else {
+        pipeline->head = output;
+    }
+    pipeline->tail = output;
+    MagickCondBroadcast(&pipeline->cond);
+    MagickMutexUnlock(&pipeline->mutex);
+}
+
+static void OnResizeDone(void *data, const int status) {
+    FinishOutput((OutputImage *)data, status);
+}
+
+static void WriteOutputs(void *arg) {
+    Pipeline *pipeline = (Pipeline *)arg;
+    CliStats *stats = &pipeline->stats;
+    MagickMutexLock(&pipeline->mutex);
+    for (;;) {
+        while (pipeline->head == NULL &&
+               !(pipeline->finished && pipeline->in_flight == 0)) {
+            MagickCondWait(&pipeline->cond, &pipeline->mutex);
+        }
+        OutputImage *output = pipeline->head;
+        if (output == NULL) break;
+        pipeline->head = output->next;
+        if (pipeline->head == NULL) pipeline->tail = NULL;
+        MagickMutexUnlock(&pipeline->mutex);
+
+        SourceImage *source = output->source;
+        const uint64_t start = GetMagickNanoseconds();
+        if (output->status != 0) {
+            fprintf(stderr,
+                    "%s: resize to %llux%llu failed with %d\n",
+                    source->path,
+                    (unsigned long long)output->image.columns,
+                    (unsigned long long)output->image.rows,
+                    output->status);
+            stats->failed_outputs++;
+        } else if (WriteOutput(
+                       pipeline->config, output, &stats->bytes_written)) {
+            stats->outputs++;
+            stats->output_pixels +=
+                output->image.columns * output->image.rows;
+        } else {
+            stats->failed_outputs++;
+        }
+        stats->write_ns += GetMagickNanoseconds() - start;
+        free(output->image.pixels);
+        free(output);
+        if (--source->pending == 0) FreeSource(source);
+
+        MagickMutexLock(&pipeline->mutex);
+        pipeline->in_flight--;
+        MagickCondBroadcast(&pipeline->cond);
+    }
+    MagickMutexUnlock(&pipeline->mutex);
+}
+
+static void GetOutputSize(const CliSize *size,
+                          const MagickImage *src,
+                          uint64_t *columns,
+                          uint64_t *rows) {
+    *columns = size->columns;
+    *rows = size->rows;
+    if (*columns == 0) {
+        *columns = (src->columns * *rows + src->rows / 2) / src->rows;
+    } else if (*rows == 0) {
+        *rows = (src->rows * *columns + src->columns / 2) / src->columns;
+    }
+    *columns = *columns > 0 ? *columns : 1;
+    *rows = *rows > 0 ? *rows : 1;
+}
+
+// Reads one file and queues all of its outputs.
+static void ProcessFile(Pipeline *pipeline,
+                        ResizeQueue *queue,
+                        const char *path) {
+    const CliConfig *config = pipeline->config;
+    CliStats *stats = &pipeline->stats;
+    uint64_t start = GetMagickNanoseconds();
+    SourceImage *source = ReadSource(config, path, stats);
+    stats->read_ns += GetMagickNanoseconds() - start;
+    if (source == NULL) {
+        stats->failed_files++;
+        return;
+    }
+    stats->files++;
+    stats->input_pixels += source->image.columns * source->image.rows;
+    source->pending = config->sizes_count;
+    for (size_t i = 0; i < config->sizes_count; i++) {
+        OutputImage *output = (OutputImage *)calloc(1, sizeof(OutputImage));
+        if (output == NULL) {
+            fprintf(stderr, "%s: out of memory\n", path);
+            exit(2);
+        }
+        output->pipeline = pipeline;
+        output->source = source;
+        output->image = source->image;
+        output->image.stride = 0;
+        GetOutputSize(&config->sizes[i],
+                      &source->image,
+                      &output->image.columns,
+                      &output->image.rows);
+        output->image.pixels = (MagickPixelPacket4 *)malloc(
+            output->image.columns * output->image.rows *
+            GetPixelFormatSize(output->image.format));
+
+        start = GetMagickNanoseconds();
+        MagickMutexLock(&pipeline->mutex);
+        while (pipeline->in_flight >= pipeline->limit) {
+            MagickCondWait(&pipeline->cond, &pipeline->mutex);
+        }
+        pipeline->in_flight++;
+        MagickMutexUnlock(&pipeline->mutex);
+        stats->block_ns += GetMagickNanoseconds() - start;
+
+        int ret = output->image.pixels == NULL
+                      ? 2
+                      : SubmitResizeJob(queue,
+                                        &source->image,
+                                        &output->image,
+                                        config->filter,
+                                        config->blur,
+                                        OnResizeDone,
+                                        output,
+                                        DefaultResizeSubmit,
+                                        NULL);
+        if (ret != 0) FinishOutput(output, ret);
+    }
+}
+
+static void ProcessPath(Pipeline *pipeline,
+                        ResizeQueue *queue,
+                        const char *path) {
+    char file[MaxPathLength];
+#if defined(_WIN32)
+    WIN32_FIND_DATAA entry;
+    DWORD attributes = GetFileAttributesA(path);
+    if (attributes == INVALID_FILE_ATTRIBUTES ||
+        !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        ProcessFile(pipeline, queue, path);
+        return;
+    }
+    snprintf(file, sizeof(file), "%s\\*", path);
+    HANDLE find = FindFirstFileA(file, &entry);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        snprintf(file, sizeof(file), "%s\\%s", path, entry.cFileName);
+        if (GetFileKind(pipeline->config, file) != UnknownFile) {
+            ProcessFile(pipeline, queue, file);
+        }
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    struct stat info;
+    DIR *directory;
+    struct dirent *entry;
+    if (stat(path, &info) != 0 || !S_ISDIR(info.st_mode) ||
+        (directory = opendir(path)) == NULL) {
+        ProcessFile(pipeline, queue, path);
+        return;
+    }
+    while ((entry = readdir(directory)) != NULL) {
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        if (stat(file, &info) == 0 && S_ISREG(info.st_mode) &&
+            GetFileKind(pipeline->config, file) != UnknownFile) {
+            ProcessFile(pipeline, queue, file);
+        }
+    }
+    closedir(directory);
+#endif
+}
+
+static bool ProcessList(Pipeline *pipeline,
+                        ResizeQueue *queue,
+                        const char *list) {
+    FILE *file = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    char line[MaxPathLength];
+    if (file == NULL) return false;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        size_t length = strlen(line);
+        while (length > 0 &&
+               (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length > 0) ProcessPath(pipeline, queue, line);
+    }
+    if (file != stdin) fclose(file);
+    return true;
+}
+
+static void PrintStats(const CliStats *stats, const double seconds) {
+    const double input_mp = (double)stats->input_pixels / 1e6;
+    const double output_mp = (double)stats->output_pixels / 1e6;
+    const double mb = (double)(stats->bytes_read + stats->bytes_written) / 1e6;
+    printf("files: %llu read, %llu failed\n",
+           (unsigned long long)stats->files,
+           (unsigned long long)stats->failed_files);
+    printf("outputs: %llu written, %llu failed\n",
+           (unsigned long long)stats->outputs,
+           (unsigned long long)stats->failed_outputs);
+    printf("pixels: %.2f MP in, %.2f MP out\n", input_mp, output_mp);
+    printf("bytes: %.2f MB read, %.2f MB written\n",
+           (double)stats->bytes_read / 1e6,
+           (double)stats->bytes_written / 1e6);
+    printf("wall: %.3f s, %.2f files/s, %.2f MP/s in, %.2f MP/s out, "
+           "%.2f MB/s io\n",
+           seconds,
+           (double)stats->files / seconds,
+           input_mp / seconds,
+           output_mp / seconds,
+           mb / seconds);
+    printf("reader: %.3f s reading, %.3f s blocked; writer: %.3f s writing\n",
+           (double)stats->read_ns * 1e-9,
+           (double)stats->block_ns * 1e-9,
+           (double)stats->write_ns * 1e-9);
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [--sizes 640x480,320x,x240] [--filter lanczos] "
+            "[--blur 1.0] [--engine double|fixed|float] [--workers n] "
+            "[--depth n] [--output dir] [--raw WxH] [--list file] "
+            "path...\n",
+            program);
+}
+
+int main(int argc, char *argv[]) {
+    CliConfig config;
+    Pipeline pipeline;
+    ResizeQueue *queue;
+    MagickThread writer;
+    const char *lists[MaxListLength];
+    const char *paths[MaxListLength * 8];
+    size_t lists_count = 0, paths_count = 0;
+    bool ok = true;
+
+    memset(&config, 0, sizeof(config));
+    GetResizeOptions(&config.options);
+    config.filter = LanczosFilter;
+    config.blur = 1.0;
+    config.output = ".";
+    for (int i = 1; i < argc; i++) {
+        const char *option = argv[i];
+        if (strncmp(option, "--", 2) != 0) {
+            if (paths_count == sizeof(paths) / sizeof(paths[0])) ok = false;
+            if (ok) paths[paths_count++] = option;
+            continue;
+        }
+        if (i + 1 == argc) {
+            ok = false;
+            break;
+        }
+        char *value = argv[++i];
+        if (strcmp(option, "--sizes") == 0) {
+            ok = ok && ParseSizes(&config, value);
+        } else if (strcmp(option, "--filter") == 0) {
+            ok = ok && ParseFilter(value, &config.filter);
+        } else if (strcmp(option, "--blur") == 0) {
+            config.blur = atof(value);
+            ok = ok && config.blur > 0.0;
+        } else if (strcmp(option, "--engine") == 0) {
+            if (strcmp(value, "double") == 0) {
+                config.options.engine = DoubleResizeEngine;
+            } else if (strcmp(value, "fixed") == 0) {
+                config.options.engine = FixedPointResizeEngine;
+            } else if (strcmp(value, "float") == 0) {
+                config.options.engine = FloatResizeEngine;
+            } else {
+                ok = false;
+            }
+        } else if (strcmp(option, "--workers") == 0) {
+            config.workers = atoi(value);
+        } else if (strcmp(option, "--depth") == 0) {
+            config.depth = strtoull(value, NULL, 10);
+        } else if (strcmp(option, "--output") == 0) {
+            config.output = value;
+        } else if (strcmp(option, "--raw") == 0) {
+            CliSize size;
+            ok = ok && ParseSize(value, &size) && size.columns != 0 &&
+                 size.rows != 0;
+            config.raw_columns = size.columns;
+            config.raw_rows = size.rows;
+        } else if (strcmp(option, "--list") == 0) {
+            if (lists_count == MaxListLength) ok = false;
+            if (ok) lists[lists_count++] = value;
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || config.sizes_count == 0 || paths_count + lists_count == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+#if defined(_WIN32)
+    if (_mkdir(config.output) != 0 && errno != EEXIST) {
+#else
+    if (mkdir(config.output, 0777) != 0 && errno != EEXIST) {
+#endif
+        fprintf(stderr, "%s: %s\n", config.output, strerror(errno));
+        return 1;
+    }
+    if (config.workers <= 0) config.workers = GetMagickCPUCount();
+    if (config.depth == 0) config.depth = (uint64_t)config.workers * 2;
+
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.config = &config;
+    pipeline.limit = (uint64_t)config.workers + config.depth;
+    queue = CreateResizeQueue(config.workers, config.depth, &config.options);
+    if (queue == NULL || !MagickMutexInit(&pipeline.mutex) ||
+        !MagickCondInit(&pipeline.cond) ||
+        !MagickThreadCreate(&writer, WriteOutputs, &pipeline)) {
+        fprintf(stderr, "cannot start the resize workers\n");
+        return 2;
+    }
+
+    const uint64_t start = GetMagickNanoseconds();
+    for (size_t i = 0; i < paths_count; i++) {
+        ProcessPath(&pipeline, queue, paths[i]);
+    }
+    for (size_t i = 0; i < lists_count; i++) {
+        if (!ProcessList(&pipeline, queue, lists[i])) {
+            fprintf(stderr, "%s: %s\n", lists[i], strerror(errno));
+            pipeline.stats.failed_files++;
+        }
+    }
+    MagickMutexLock(&pipeline.mutex);
+    pipeline.finished = true;
+    MagickCondBroadcast(&pipeline.cond);
+    MagickMutexUnlock(&pipeline.mutex);
+    MagickThreadJoin(writer);
+    const double seconds =
+        (double)(GetMagickNanoseconds() - start) * 1e-9;
+
+    DestroyResizeQueue(queue);
+    MagickCondDestroy(&pipeline.cond);
+    MagickMutexDestroy(&pipeline.mutex);
+    PrintStats(&pipeline.stats, seconds > 0.0 ? seconds : 1e-9);
+    return pipeline.stats.failed_files + pipeline.stats.failed_outputs == 0
+               ? 0
+               : 1;
+}
@@ -0,0 +1,86 @@
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ArenaAlignment 64
+#define MinArenaChunkSize 4096
+
+struct _MagickArenaChunk {
+    MagickArenaChunk *next;
+    size_t size;  // usable bytes after the header
+    size_t used;
+};
+
+#define ArenaAlign(size) \
+    (((size) + ArenaAlignment - 1) & ~(size_t)(ArenaAlignment - 1))
+#define ArenaChunkData(chunk) \
+    ((unsigned char *)(chunk) + ArenaAlign(sizeof(MagickArenaChunk)))
+
+static MagickArenaChunk *AllocateArenaChunk(const size_t size) {
+    // over-allocate so the data can be aligned whatever malloc returns
+    unsigned char *memory = (unsigned char *)malloc(
+        ArenaAlign(sizeof(MagickArenaChunk)) + size + ArenaAlignment);
+    if (memory == NULL) return NULL;
+    MagickArenaChunk *chunk = (MagickArenaChunk *)memory;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+void InitializeArena(MagickArena *arena) { arena->chunks = NULL; }
+
+void *ArenaAllocate(MagickArena *arena, const size_t size) {
+    MagickArenaChunk *chunk = arena->chunks;
+    uintptr_t data, start;
+    if (chunk != NULL) {
+        data = (uintptr_t)ArenaChunkData(chunk);
+        start = ArenaAlign(data + chunk->used) - data;
+        if (start <= chunk->size && size <= chunk->size - start) {
+            chunk->used = start + size;
+            return (void *)(data + start);
+        }
+    }
+    size_t chunk_size = size + ArenaAlignment;
+    if (chunk != NULL && chunk_size < chunk->size * 2) {
+        chunk_size = chunk->size * 2;
+    }
+    if (chunk_size < MinArenaChunkSize) chunk_size = MinArenaChunkSize;
+    chunk = AllocateArenaChunk(chunk_size);
+    if (chunk == NULL) return NULL;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    data = (uintptr_t)ArenaChunkData(chunk);
+    start = ArenaAlign(data) - data;
+    chunk->used = start + size;
+    return (void *)(data + start);
+}
+
+void ResetArena(MagickArena *arena) {
+    MagickArenaChunk *chunk = arena->chunks;
+    if (chunk == NULL) return;
+    if (chunk->next == NULL) {
+        chunk->used = 0;
+        return;
+    }
+    size_t total = 0;
+    while (chunk != NULL) {
+        MagickArenaChunk *next = chunk->next;
+        total += chunk->size;
+        free(chunk);
+        chunk = next;
+    }
+    // a failure only means the next allocation starts from scratch
+    arena->chunks = AllocateArenaChunk(total);
+}
+
+void DestroyArena(MagickArena *arena) {
+    MagickArenaChunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        MagickArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef _MAGICK_ARENA_H
+#define _MAGICK_ARENA_H
+
+#include <stddef.h>
+
+typedef struct _MagickArenaChunk MagickArenaChunk;
+
+/*
+    Grow-only bump allocator. Allocations are never freed one by one, and
+    memory stays valid until the next reset. A reset folds every chunk into
+    a single one as large as all of them, so once an arena has seen its
+    largest workload further allocations no longer reach malloc.
+*/
+typedef struct _MagickArena {
+    MagickArenaChunk *chunks;  // most recent chunk first
+} MagickArena;
+
+void InitializeArena(MagickArena *arena);
+void *ArenaAllocate(MagickArena *arena, const size_t size);
+void ResetArena(MagickArena *arena);
+void DestroyArena(MagickArena *arena);
+
+#endif
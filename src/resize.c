@@ -1,56 +1,34 @@
 #include "resize.h"
 
+#include "arena.h"
+#include "resize_private.h"
+#include "thread.h"
+
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define ARG_NOT_USED(arg) (void)arg
-#define MaxRGB 255U
-#define MagickEpsilon 1.0e-12
-#define MagickPI 3.14159265358979323846264338327950288419716939937510
-#define OpaqueOpacity 0UL
-#define TransparentOpacity MaxRGB
-#define MaxRGBFloat 255.0f
-#define MaxRGBDouble 255.0
-#define RoundDoubleToQuantum(value)              \
-    ((Quantum)(value < 0.0              ? 0U     \
-               : (value > MaxRGBDouble) ? MaxRGB \
-                                        : value + 0.5))
-
-#define AbsoluteValue(x) ((x) < 0 ? -(x) : (x))
-
-#define DefaultResizeFilter LanczosFilter
-#define DefaultThumbnailFilter BoxFilter
-#define Max(x, y) (((x) > (y)) ? (x) : (y))
-#define Min(x, y) (((x) < (y)) ? (x) : (y))
-#define MagickPassFail uint8_t
-#define MagickPass 1
-#define MagickFail 0
-
-typedef struct _ContributionInfo {
-    double weight;
-    int64_t pixel;
-} ContributionInfo;
+// weights of count taps from start, the filter function inlined in the loop
+typedef void (*FilterWeights)(double *restrict weight,
+                              const int64_t start,
+                              const int64_t count,
+                              const double center,
+                              const double scale,
+                              const double support);
 
 typedef struct _FilterInfo {
-    double (*function)(const double, const double), support;
+    FilterWeights weights;
+    double support;
+    bool tabulate;  // transcendental, read back from a table when asked for
 } FilterInfo;
 
-typedef struct _DoublePixelPacket {
-    double red, green, blue, opacity;
-} DoublePixelPacket;
-
-typedef unsigned char Quantum;
 
 typedef Quantum PixelPacket4[4];
 typedef struct _PixelIndex {
     int red, green, blue, opacity;
 } PixelIndex;
 
-#define GET_PIXEL_PACKET(p, k) p[k]
-#define SET_PIXEL_PACKET(p, k, v) p[k] = v
-
 static double J1(double x) {
     double p, q;
 
@@ -268,65 +246,198 @@ static double Triangle(const double x, const double support) {
     return (0.0);
 }
 
-static const FilterInfo filters[SincFilter + 1] = {{Box, 0.0},
-                                                   {Box, 0.0},
-                                                   {Box, 0.5},
-                                                   {Triangle, 1.0},
-                                                   {Hermite, 1.0},
-                                                   {Hanning, 1.0},
-                                                   {Hamming, 1.0},
-                                                   {Blackman, 1.0},
-                                                   {Gaussian, 1.25},
-                                                   {Quadratic, 1.5},
-                                                   {Cubic, 2.0},
-                                                   {Catrom, 2.0},
-                                                   {Mitchell, 2.0},
-                                                   {Lanczos, 3.0},
-                                                   {BlackmanBessel, 3.2383},
-                                                   {BlackmanSinc, 4.0}};
-static MagickPassFail HorizontalFilter(
-    const MagickImage *restrict source,
-    const MagickImage *restrict destination,
-    const double x_factor,
+#define DefineFilterWeights(filter)                                      \
+    static void filter##Weights(double *restrict weight,                  \
+                                const int64_t start,                      \
+                                const int64_t count,                      \
+                                const double center,                      \
+                                const double scale,                       \
+                                const double support) {                   \
+        for (int64_t n = 0; n < count; n++) {                             \
+            weight[n] =                                                   \
+                filter(scale * ((double)start + n - center + 0.5), support); \
+        }                                                                 \
+    }
+
+DefineFilterWeights(Box)
+DefineFilterWeights(Triangle)
+DefineFilterWeights(Hermite)
+DefineFilterWeights(Hanning)
+DefineFilterWeights(Hamming)
+DefineFilterWeights(Blackman)
+DefineFilterWeights(Gaussian)
+DefineFilterWeights(Quadratic)
+DefineFilterWeights(Cubic)
+DefineFilterWeights(Catrom)
+DefineFilterWeights(Mitchell)
+DefineFilterWeights(Lanczos)
+DefineFilterWeights(BlackmanBessel)
+DefineFilterWeights(BlackmanSinc)
+
+static const FilterInfo filters[SincFilter + 1] = {
+    {BoxWeights, 0.0, false},
+    {BoxWeights, 0.0, false},
+    {BoxWeights, 0.5, false},
+    {TriangleWeights, 1.0, false},
+    {HermiteWeights, 1.0, false},
+    {HanningWeights, 1.0, true},
+    {HammingWeights, 1.0, true},
+    {BlackmanWeights, 1.0, true},
+    {GaussianWeights, 1.25, true},
+    {QuadraticWeights, 1.5, false},
+    {CubicWeights, 2.0, false},
+    {CatromWeights, 2.0, false},
+    {MitchellWeights, 2.0, false},
+    {LanczosWeights, 3.0, true},
+    {BlackmanBesselWeights, 3.2383, true},
+    {BlackmanSincWeights, 4.0, true}};
+
+/*
+    The transcendental filters are even and smooth inside their support, so
+    they are sampled every 1 / FilterTableResolution over [0, support + 1]
+    once and read back with linear interpolation. Against the analytic
+    functions the largest error is below 1e-6 (Blackman, |f''| ~ 8.1 at 0),
+    the taps past support + 1 that huge blurs reach are still evaluated.
+*/
+#define FilterTableResolution 1024
+#define FilterTableLength (5 * FilterTableResolution + 2)
+
+static double filter_tables[SincFilter + 1][FilterTableLength];
+static MagickOnce filter_tables_once = MAGICK_ONCE_INIT;
+
+static void InitializeFilterTables(void) {
+    for (int i = 0; i <= SincFilter; i++) {
+        if (!filters[i].tabulate) continue;
+        filters[i].weights(filter_tables[i],
+                           0,
+                           FilterTableLength,
+                           0.5,
+                           1.0 / FilterTableResolution,
+                           filters[i].support);
+    }
+}
+
+static const double *GetFilterTable(const FilterTypes filter) {
+    if (!filters[filter].tabulate) return NULL;
+    MagickCallOnce(&filter_tables_once, InitializeFilterTables);
+    return filter_tables[filter];
+}
+
+static void TabulatedWeights(const FilterInfo *restrict filter_info,
+                             const double *restrict table,
+                             double *restrict weight,
+                             const int64_t start,
+                             const int64_t count,
+                             const double center,
+                             const double scale) {
+    const double limit = (filter_info->support + 1.0) * FilterTableResolution;
+    for (int64_t n = 0; n < count; n++) {
+        double x = fabs(scale * ((double)start + n - center + 0.5)) *
+                   FilterTableResolution;
+        if (x >= limit) {
+            filter_info->weights(weight + n,
+                                 start + n,
+                                 1,
+                                 center,
+                                 scale,
+                                 filter_info->support);
+            continue;
+        }
+        int64_t i = (int64_t)x;
+        weight[n] = table[i] + (x - (double)i) * (table[i + 1] - table[i]);
+    }
+}
+
+double GetFilterValue(const FilterTypes filter,
+                      const double x,
+                      const bool tabulated) {
+    const FilterInfo *filter_info = &filters[filter];
+    const double *table = tabulated ? GetFilterTable(filter) : NULL;
+    double weight;
+    // a window of one tap centered so that the tap sits at x
+    if (table != NULL) {
+        TabulatedWeights(filter_info, table, &weight, 0, 1, 0.5 - x, 1.0);
+    } else {
+        filter_info->weights(
+            &weight, 0, 1, 0.5 - x, 1.0, filter_info->support);
+    }
+    return weight;
+}
+
+/*
+    Computes the contribution windows of every destination pixel along one
+    axis, these only depend on the geometry, the filter and the blur. The
+    destination spans the source from offset on, windows are clipped to
+    [0, source_length). The weights are interpolated from filter_table when
+    it is not NULL.
+*/
+static MagickPassFail BuildContributionTable(
+    ContributionTable *table,
+    const uint64_t source_length,
+    const uint64_t destination_length,
+    const double factor,
+    const double offset,
     const FilterInfo *restrict filter_info,
+    const double *restrict filter_table,
     const double blur,
-    ContributionInfo *restrict view_data_set) {
+    MagickArena *arena) {
     double scale, support;
-    DoublePixelPacket zero;
-    uint64_t x;
-    const bool matte = true;
-    MagickPassFail status = MagickPass;
-    scale = blur * Max(1.0 / x_factor, 1.0);
+    uint64_t x, total = 0;
+    scale = blur * Max(1.0 / factor, 1.0);
     support = scale * filter_info->support;
     if (support <= 0.5) {
         support = 0.5 + MagickEpsilon;
         scale = 1.0;
     }
     scale = 1.0 / scale;
-    (void)memset(&zero, 0, sizeof(DoublePixelPacket));
-    ContributionInfo *restrict contribution = view_data_set;
-    MagickPixelPacket4 *source_pixels = (MagickPixelPacket4 *)source->pixels;
-    MagickPixelPacket4 *destination_pixels =
-        (MagickPixelPacket4 *)destination->pixels;
-
-    for (x = 0; x < destination->columns; x++) {
-        double center, density;
-        int64_t n, start, stop, y;
-
-        MagickPassFail thread_status;
-        thread_status = status;
-        if (thread_status == MagickFail) continue;
-        center = (double)(x + 0.5) / x_factor;
-        start = (int64_t)Max(center - support + 0.5, 0);
-        stop = (int64_t)Min(center + support + 0.5, source->columns);
-        density = 0.0;
-        for (n = 0; n < (stop - start); n++) {
-            contribution[n].pixel = start + n;
-            contribution[n].weight = filter_info->function(
-                scale * ((double)start + n - center + 0.5),
-                filter_info->support);
-            density += contribution[n].weight;
+    table->length = destination_length;
+    table->max_count = 0;
+    table->support = support;
+    table->weights = NULL;
+    table->densities = NULL;
+    table->fixed_weights = NULL;
+    table->float_weights = NULL;
+    table->windows = (ContributionWindow *)ArenaAllocate(
+        arena, destination_length * sizeof(ContributionWindow));
+    if (table->windows == NULL) return MagickFail;
+    for (x = 0; x < destination_length; x++) {
+        double center = offset + (double)(x + 0.5) / factor;
+        int64_t start = (int64_t)Max(center - support + 0.5, 0);
+        int64_t stop = (int64_t)Min(center + support + 0.5, source_length);
+        table->windows[x].start = start;
+        table->windows[x].count = stop - start;
+        table->windows[x].offset = total;
+        table->max_count = Max(table->max_count, stop - start);
+        total += stop - start;
+    }
+    table->taps = total;
+    table->weights = (double *)ArenaAllocate(arena, total * sizeof(double));
+    table->densities = (double *)ArenaAllocate(
+        arena, destination_length * sizeof(double));
+    if (table->weights == NULL || table->densities == NULL) return MagickFail;
+    for (x = 0; x < destination_length; x++) {
+        double center = offset + (double)(x + 0.5) / factor;
+        int64_t start = table->windows[x].start;
+        int64_t n;
+        double density = 0.0;
+        double *restrict weight = table->weights + table->windows[x].offset;
+        if (filter_table != NULL) {
+            TabulatedWeights(filter_info,
+                             filter_table,
+                             weight,
+                             start,
+                             table->windows[x].count,
+                             center,
+                             scale);
+        } else {
+            filter_info->weights(weight,
+                                 start,
+                                 table->windows[x].count,
+                                 center,
+                                 scale,
+                                 filter_info->support);
         }
+        for (n = 0; n < table->windows[x].count; n++) density += weight[n];
         if ((density != 0.0) && (density != 1.0)) {
             /*
                 Normalize.
@@ -334,264 +445,1698 @@ static MagickPassFail HorizontalFilter(
             int64_t i;
 
             density = 1.0 / density;
-            for (i = 0; i < n; i++) contribution[i].weight *= density;
+            for (i = 0; i < n; i++) weight[i] *= density;
         }
-        int64_t p_offset = contribution[0].pixel;
-        MagickPixelPacket4 *p = (source_pixels + p_offset);
-        int64_t p_offset_w =
-            contribution[n - 1].pixel - contribution[0].pixel + 1;
-        int64_t q_offset = x;
-        MagickPixelPacket4 *q = (destination_pixels + q_offset);
-
-        if (thread_status != MagickFail) {
-            if (matte) {
-                for (int64_t y = 0; y < destination->rows; y++) {
-                    double transparency_coeff, normalize, weight;
-                    DoublePixelPacket pixel;
-                    int64_t j;
-                    int64_t i;
-                    pixel = zero;
-                    normalize = 0.0;
-                    int64_t yy =
-                        (y % destination->rows) * destination->columns +
-                        (y / destination->rows);
-                    for (i = 0; i < n; i++) {
-                        j = y * (contribution[n - 1].pixel -
-                                 contribution[0].pixel + 1) +
-                            (contribution[i].pixel - contribution[0].pixel);
-                        weight = contribution[i].weight;
-                        int64_t jj = (j / p_offset_w) * source->columns +
-                                     (j % p_offset_w);
-                        MagickQuantum opacity =
-                            TransparentOpacity -
-                            GET_PIXEL_PACKET(p[jj], source->order.opacity);
-                        transparency_coeff =
-                            weight *
-                            (1 - ((double)opacity / TransparentOpacity));
-                        pixel.red += transparency_coeff *
-                                     GET_PIXEL_PACKET(p[jj], source->order.red);
-                        pixel.green +=
-                            transparency_coeff *
-                            GET_PIXEL_PACKET(p[jj], source->order.green);
-                        pixel.blue +=
-                            transparency_coeff *
-                            GET_PIXEL_PACKET(p[jj], source->order.blue);
-                        pixel.opacity += weight * opacity;
-                        normalize += transparency_coeff;
-                    }
-                    normalize = 1.0 / (AbsoluteValue(normalize) <= MagickEpsilon
-                                           ? 1.0
-                                           : normalize);
-                    pixel.red *= normalize;
-                    pixel.green *= normalize;
-                    pixel.blue *= normalize;
-                    SET_PIXEL_PACKET(q[yy],
-                                     destination->order.red,
-                                     RoundDoubleToQuantum(pixel.red));
-                    SET_PIXEL_PACKET(q[yy],
-                                     destination->order.green,
-                                     RoundDoubleToQuantum(pixel.green));
-                    SET_PIXEL_PACKET(q[yy],
-                                     destination->order.blue,
-                                     RoundDoubleToQuantum(pixel.blue));
-                    SET_PIXEL_PACKET(q[yy],
-                                     destination->order.opacity,
-                                     (TransparentOpacity -
-                                      RoundDoubleToQuantum(pixel.opacity)));
-                }
-            }
+        /*
+            Summed in tap order like the normalize of the kernels, which
+            equals it for an opaque window.
+        */
+        density = 0.0;
+        for (n = 0; n < table->windows[x].count; n++) density += weight[n];
+        table->densities[x] = density;
+    }
+    if (BuildFloatContributionTable(table, arena) == MagickFail) {
+        return MagickFail;
+    }
+    return BuildFixedContributionTable(table, arena);
+}
+
+#define TransparencyCoeff4(a)                                          \
+    TransparencyCoeff(a), TransparencyCoeff(a + 1), TransparencyCoeff(a + 2), \
+        TransparencyCoeff(a + 3)
+#define TransparencyCoeff16(a)                                   \
+    TransparencyCoeff4(a), TransparencyCoeff4(a + 4),            \
+        TransparencyCoeff4(a + 8), TransparencyCoeff4(a + 12)
+#define TransparencyCoeff64(a)                                   \
+    TransparencyCoeff16(a), TransparencyCoeff16(a + 16),         \
+        TransparencyCoeff16(a + 32), TransparencyCoeff16(a + 48)
+
+const double MagickTransparencyTable[MaxRGB + 1] = {
+    TransparencyCoeff64(0),
+    TransparencyCoeff64(64),
+    TransparencyCoeff64(128),
+    TransparencyCoeff64(192)};
+
+/*
+    An opaque tap has a transparency coefficient of exactly 1, so it only
+    adds the weighted colors and leaves the opacity at 0. A premultiplied
+    tap adds its weighted alpha as well.
+*/
+MAGICK_FORCE_INLINE void AccumulatePixelPacket(
+    double *restrict pixel,
+    double *restrict normalize,
+    const MagickQuantum *restrict s,
+    const double weight,
+    const MagickPixelOrder source_order,
+    const ResizeAlphaMode alpha) {
+    if (alpha != MatteResizeAlpha) {
+        pixel[source_order.red] +=
+            weight * GET_PIXEL_PACKET(s, source_order.red);
+        pixel[source_order.green] +=
+            weight * GET_PIXEL_PACKET(s, source_order.green);
+        pixel[source_order.blue] +=
+            weight * GET_PIXEL_PACKET(s, source_order.blue);
+        if (alpha == PremultipliedResizeAlpha) {
+            pixel[source_order.opacity] +=
+                weight * GET_PIXEL_PACKET(s, source_order.opacity);
+        }
+        return;
+    }
+    MagickQuantum opacity =
+        TransparentOpacity - GET_PIXEL_PACKET(s, source_order.opacity);
+    double transparency_coeff =
+        weight *
+        MagickTransparencyTable[GET_PIXEL_PACKET(s, source_order.opacity)];
+    pixel[source_order.red] +=
+        transparency_coeff * GET_PIXEL_PACKET(s, source_order.red);
+    pixel[source_order.green] +=
+        transparency_coeff * GET_PIXEL_PACKET(s, source_order.green);
+    pixel[source_order.blue] +=
+        transparency_coeff * GET_PIXEL_PACKET(s, source_order.blue);
+    pixel[source_order.opacity] += weight * opacity;
+    *normalize += transparency_coeff;
+}
+
+MAGICK_FORCE_INLINE void FilterWindow(MagickQuantum *restrict q,
+                                      const MagickPixelPacket4 *restrict pixels,
+                                      const double *restrict weights,
+                                      const int64_t count,
+                                      const double density,
+                                      const MagickPixelOrder source_order,
+                                      const MagickPixelOrder destination_order,
+                                      const ResizeAlphaMode alpha) {
+    double pixel[4] = {0.0, 0.0, 0.0, 0.0};
+    double normalize = 0.0;
+    for (int64_t i = 0; i < count; i++) {
+        AccumulatePixelPacket(
+            pixel, &normalize, pixels[i], weights[i], source_order, alpha);
+    }
+    if (alpha == PremultipliedResizeAlpha) {
+        SetPremultipliedPixelPacket(q, pixel, source_order, destination_order);
+        return;
+    }
+    SetDoublePixelPacket(q,
+                         pixel,
+                         alpha == OpaqueResizeAlpha ? density : normalize,
+                         source_order,
+                         destination_order);
+}
+
+/*
+    Filters one row, source and destination pixels are both walked
+    contiguously. The common window sizes get loops of constant length.
+*/
+MAGICK_FORCE_INLINE void HorizontalFilterPixels(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const double *restrict weights = table->weights + window->offset;
+        const MagickPixelPacket4 *restrict pixels = p + window->start;
+        const double density = table->densities[x];
+        switch (window->count) {
+            case 2:
+                FilterWindow(q[x],
+                             pixels,
+                             weights,
+                             2,
+                             density,
+                             source_order,
+                             destination_order,
+                             alpha);
+                break;
+            case 4:
+                FilterWindow(q[x],
+                             pixels,
+                             weights,
+                             4,
+                             density,
+                             source_order,
+                             destination_order,
+                             alpha);
+                break;
+            case 6:
+                FilterWindow(q[x],
+                             pixels,
+                             weights,
+                             6,
+                             density,
+                             source_order,
+                             destination_order,
+                             alpha);
+                break;
+            default:
+                FilterWindow(q[x],
+                             pixels,
+                             weights,
+                             window->count,
+                             density,
+                             source_order,
+                             destination_order,
+                             alpha);
+                break;
         }
     }
-    return status;
 }
+
+MAGICK_FORCE_INLINE void FilterColumns(
+    const double *restrict weights,
+    const int64_t count,
+    const double density,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    for (uint64_t x = 0; x < columns; x++) {
+        double pixel[4] = {0.0, 0.0, 0.0, 0.0};
+        double normalize = 0.0;
+        for (int64_t i = 0; i < count; i++) {
+            AccumulatePixelPacket(pixel,
+                                  &normalize,
+                                  rows[i][x],
+                                  weights[i],
+                                  source_order,
+                                  alpha);
+        }
+        if (alpha == PremultipliedResizeAlpha) {
+            SetPremultipliedPixelPacket(
+                q[x], pixel, source_order, destination_order);
+            continue;
+        }
+        SetDoublePixelPacket(q[x],
+                             pixel,
+                             alpha == OpaqueResizeAlpha ? density : normalize,
+                             source_order,
+                             destination_order);
+    }
+}
+
+MAGICK_FORCE_INLINE void VerticalFilterPixels(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    const ContributionWindow *window = &table->windows[y];
+    const double *restrict weights = table->weights + window->offset;
+    const double density = table->densities[y];
+    switch (window->count) {
+        case 2:
+            FilterColumns(weights,
+                          2,
+                          density,
+                          rows,
+                          source_order,
+                          q,
+                          columns,
+                          destination_order,
+                          alpha);
+            break;
+        case 4:
+            FilterColumns(weights,
+                          4,
+                          density,
+                          rows,
+                          source_order,
+                          q,
+                          columns,
+                          destination_order,
+                          alpha);
+            break;
+        case 6:
+            FilterColumns(weights,
+                          6,
+                          density,
+                          rows,
+                          source_order,
+                          q,
+                          columns,
+                          destination_order,
+                          alpha);
+            break;
+        default:
+            FilterColumns(weights,
+                          window->count,
+                          density,
+                          rows,
+                          source_order,
+                          q,
+                          columns,
+                          destination_order,
+                          alpha);
+            break;
+    }
+}
+
+/*
+    Alpha weighted, opaque and premultiplied variants of the bodies, each
+    also defined for the constant pixel layouts below.
+*/
+#define DefineRowKernelBodies(horizontal, vertical, alpha)                  \
+    MAGICK_FORCE_INLINE void horizontal##Body(                              \
+        const ContributionTable *restrict table,                            \
+        const MagickPixelPacket4 *restrict p,                               \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const MagickPixelOrder destination_order) {                         \
+        HorizontalFilterPixels(                                             \
+            table, p, source_order, q, destination_order, alpha);           \
+    }                                                                       \
+    MAGICK_FORCE_INLINE void vertical##Body(                                \
+        const ContributionTable *restrict table,                            \
+        const uint64_t y,                                                   \
+        const MagickPixelPacket4 *const *restrict rows,                     \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const uint64_t columns,                                             \
+        const MagickPixelOrder destination_order) {                         \
+        VerticalFilterPixels(                                               \
+            table, y, rows, source_order, q, columns, destination_order,    \
+            alpha);                                                         \
+    }                                                                       \
+    static void horizontal(const ContributionTable *restrict table,         \
+                           const MagickPixelPacket4 *restrict p,            \
+                           const MagickPixelOrder source_order,             \
+                           MagickPixelPacket4 *restrict q,                  \
+                           const MagickPixelOrder destination_order) {      \
+        horizontal##Body(table, p, source_order, q, destination_order);     \
+    }                                                                       \
+    static void vertical(const ContributionTable *restrict table,           \
+                         const uint64_t y,                                  \
+                         const MagickPixelPacket4 *const *restrict rows,    \
+                         const MagickPixelOrder source_order,               \
+                         MagickPixelPacket4 *restrict q,                    \
+                         const uint64_t columns,                            \
+                         const MagickPixelOrder destination_order) {        \
+        vertical##Body(                                                     \
+            table, y, rows, source_order, q, columns, destination_order);   \
+    }                                                                       \
+    DefineOrderedRowKernels(                                                \
+        static, horizontal, vertical, OpacityLast, OpacityLastOrder)        \
+    DefineOrderedRowKernels(                                                \
+        static, horizontal, vertical, OpacityFirst, OpacityFirstOrder)
+
+DefineRowKernelBodies(HorizontalFilterRow, VerticalFilterRow, MatteResizeAlpha)
+DefineRowKernelBodies(HorizontalOpaqueFilterRow,
+                      VerticalOpaqueFilterRow,
+                      OpaqueResizeAlpha)
+DefineRowKernelBodies(HorizontalPremultipliedFilterRow,
+                      VerticalPremultipliedFilterRow,
+                      PremultipliedResizeAlpha)
+
+static const ResizeKernels scalar_kernels = {
+    "scalar",
+    {HorizontalFilterRow,
+     HorizontalFilterRowOpacityLast,
+     HorizontalFilterRowOpacityFirst},
+    {VerticalFilterRow, VerticalFilterRowOpacityLast, VerticalFilterRowOpacityFirst},
+    {HorizontalFilterRowFixed,
+     HorizontalFilterRowFixedOpacityLast,
+     HorizontalFilterRowFixedOpacityFirst},
+    {VerticalFilterRowFixed,
+     VerticalFilterRowFixedOpacityLast,
+     VerticalFilterRowFixedOpacityFirst},
+    {HorizontalPlainFilterRowFixed,
+     HorizontalPlainFilterRowFixedOpacityLast,
+     HorizontalPlainFilterRowFixedOpacityFirst},
+    {VerticalPlainFilterRowFixed,
+     VerticalPlainFilterRowFixedOpacityLast,
+     VerticalPlainFilterRowFixedOpacityFirst},
+    {HorizontalWideFilterRowFixed,
+     HorizontalWideFilterRowFixedOpacityLast,
+     HorizontalWideFilterRowFixedOpacityFirst},
+    {VerticalWideFilterRowFixed,
+     VerticalWideFilterRowFixedOpacityLast,
+     VerticalWideFilterRowFixedOpacityFirst},
+    {HorizontalWidePlainFilterRowFixed,
+     HorizontalWidePlainFilterRowFixedOpacityLast,
+     HorizontalWidePlainFilterRowFixedOpacityFirst},
+    {VerticalWidePlainFilterRowFixed,
+     VerticalWidePlainFilterRowFixedOpacityLast,
+     VerticalWidePlainFilterRowFixedOpacityFirst},
+    {HorizontalFilterRowFloat,
+     HorizontalFilterRowFloatOpacityLast,
+     HorizontalFilterRowFloatOpacityFirst},
+    {VerticalFilterRowFloat,
+     VerticalFilterRowFloatOpacityLast,
+     VerticalFilterRowFloatOpacityFirst},
+    {HorizontalPlainFilterRowFloat,
+     HorizontalPlainFilterRowFloatOpacityLast,
+     HorizontalPlainFilterRowFloatOpacityFirst},
+    {VerticalPlainFilterRowFloat,
+     VerticalPlainFilterRowFloatOpacityLast,
+     VerticalPlainFilterRowFloatOpacityFirst},
+    {HorizontalOpaqueFilterRow,
+     HorizontalOpaqueFilterRowOpacityLast,
+     HorizontalOpaqueFilterRowOpacityFirst},
+    {VerticalOpaqueFilterRow,
+     VerticalOpaqueFilterRowOpacityLast,
+     VerticalOpaqueFilterRowOpacityFirst},
+    {HorizontalPremultipliedFilterRow,
+     HorizontalPremultipliedFilterRowOpacityLast,
+     HorizontalPremultipliedFilterRowOpacityFirst},
+    {VerticalPremultipliedFilterRow,
+     VerticalPremultipliedFilterRowOpacityLast,
+     VerticalPremultipliedFilterRowOpacityFirst},
+    NULL,
+    NULL,
+    NULL,
+    NULL};
+static ResizeKernels resize_kernels;
+static MagickOnce resize_kernels_once = MAGICK_ONCE_INIT;
+
+const ResizeKernels *GetScalarResizeKernels(void) { return &scalar_kernels; }
+
+static void InitializeResizeKernels(void) {
+    const ResizeKernels *kernels = GetSIMDResizeKernels();
+    resize_kernels = scalar_kernels;
+    if (kernels == NULL) return;
+    resize_kernels.name = kernels->name;
+    for (int i = 0; i < PixelLayoutCount; i++) {
+        if (kernels->horizontal[i] != NULL)
+            resize_kernels.horizontal[i] = kernels->horizontal[i];
+        if (kernels->vertical[i] != NULL)
+            resize_kernels.vertical[i] = kernels->vertical[i];
+        if (kernels->fixed_horizontal[i] != NULL)
+            resize_kernels.fixed_horizontal[i] = kernels->fixed_horizontal[i];
+        if (kernels->fixed_vertical[i] != NULL)
+            resize_kernels.fixed_vertical[i] = kernels->fixed_vertical[i];
+        if (kernels->fixed_plain_horizontal[i] != NULL)
+            resize_kernels.fixed_plain_horizontal[i] =
+                kernels->fixed_plain_horizontal[i];
+        if (kernels->fixed_plain_vertical[i] != NULL)
+            resize_kernels.fixed_plain_vertical[i] =
+                kernels->fixed_plain_vertical[i];
+        if (kernels->fixed_wide_horizontal[i] != NULL)
+            resize_kernels.fixed_wide_horizontal[i] =
+                kernels->fixed_wide_horizontal[i];
+        if (kernels->fixed_wide_vertical[i] != NULL)
+            resize_kernels.fixed_wide_vertical[i] =
+                kernels->fixed_wide_vertical[i];
+        if (kernels->fixed_wide_plain_horizontal[i] != NULL)
+            resize_kernels.fixed_wide_plain_horizontal[i] =
+                kernels->fixed_wide_plain_horizontal[i];
+        if (kernels->fixed_wide_plain_vertical[i] != NULL)
+            resize_kernels.fixed_wide_plain_vertical[i] =
+                kernels->fixed_wide_plain_vertical[i];
+        if (kernels->float_horizontal[i] != NULL)
+            resize_kernels.float_horizontal[i] = kernels->float_horizontal[i];
+        if (kernels->float_vertical[i] != NULL)
+            resize_kernels.float_vertical[i] = kernels->float_vertical[i];
+        if (kernels->float_plain_horizontal[i] != NULL)
+            resize_kernels.float_plain_horizontal[i] =
+                kernels->float_plain_horizontal[i];
+        if (kernels->float_plain_vertical[i] != NULL)
+            resize_kernels.float_plain_vertical[i] =
+                kernels->float_plain_vertical[i];
+        if (kernels->opaque_horizontal[i] != NULL)
+            resize_kernels.opaque_horizontal[i] = kernels->opaque_horizontal[i];
+        if (kernels->opaque_vertical[i] != NULL)
+            resize_kernels.opaque_vertical[i] = kernels->opaque_vertical[i];
+        if (kernels->premultiplied_horizontal[i] != NULL)
+            resize_kernels.premultiplied_horizontal[i] =
+                kernels->premultiplied_horizontal[i];
+        if (kernels->premultiplied_vertical[i] != NULL)
+            resize_kernels.premultiplied_vertical[i] =
+                kernels->premultiplied_vertical[i];
+    }
+    resize_kernels.wide_horizontal = kernels->wide_horizontal;
+    resize_kernels.wide_vertical = kernels->wide_vertical;
+    resize_kernels.wide_premultiplied_horizontal =
+        kernels->wide_premultiplied_horizontal;
+    resize_kernels.wide_premultiplied_vertical =
+        kernels->wide_premultiplied_vertical;
+}
+
+static const ResizeKernels *GetResizeKernels(void) {
+    MagickCallOnce(&resize_kernels_once, InitializeResizeKernels);
+    return &resize_kernels;
+}
+
+static PixelLayout GetPixelLayout(const MagickPixelOrder source_order,
+                                  const MagickPixelOrder destination_order) {
+    if (memcmp(&source_order, &destination_order, sizeof(MagickPixelOrder)) !=
+        0) {
+        return AnyPixelLayout;
+    }
+    if (source_order.opacity == 3) return OpacityLastPixelLayout;
+    if (source_order.opacity == 0) return OpacityFirstPixelLayout;
+    return AnyPixelLayout;
+}
+
+HorizontalRowKernel GetHorizontalRowKernel(
+    const ResizeEngineType engine,
+    const MagickPixelFormat format,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    PixelLayout layout = GetPixelLayout(source_order, destination_order);
+    if (engine == FixedPointResizeEngine) {
+        const ResizeKernels *kernels = GetResizeKernels();
+        if (format == RGBA64PixelFormat) {
+            return alpha == MatteResizeAlpha
+                       ? kernels->fixed_wide_horizontal[layout]
+                       : kernels->fixed_wide_plain_horizontal[layout];
+        }
+        return alpha == MatteResizeAlpha
+                   ? kernels->fixed_horizontal[layout]
+                   : kernels->fixed_plain_horizontal[layout];
+    }
+    if (format != RGBA32PixelFormat) {
+        const ResizeKernels *kernels = GetResizeKernels();
+        HorizontalRowKernel kernel =
+            alpha == PremultipliedResizeAlpha
+                ? kernels->wide_premultiplied_horizontal
+                : kernels->wide_horizontal;
+        if (format == RGBA64PixelFormat &&
+            layout == OpacityLastPixelLayout && kernel != NULL) {
+            return kernel;
+        }
+        return GetFormatHorizontalRowKernel(
+            format, alpha == PremultipliedResizeAlpha);
+    }
+    if (engine == FloatResizeEngine) {
+        return alpha == MatteResizeAlpha
+                   ? GetResizeKernels()->float_horizontal[layout]
+                   : GetResizeKernels()->float_plain_horizontal[layout];
+    }
+    if (alpha == PremultipliedResizeAlpha) {
+        return GetResizeKernels()->premultiplied_horizontal[layout];
+    }
+    if (alpha == OpaqueResizeAlpha) {
+        return GetResizeKernels()->opaque_horizontal[layout];
+    }
+    return GetResizeKernels()->horizontal[layout];
+}
+
+VerticalRowKernel GetVerticalRowKernel(
+    const ResizeEngineType engine,
+    const MagickPixelFormat format,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    PixelLayout layout = GetPixelLayout(source_order, destination_order);
+    if (engine == FixedPointResizeEngine) {
+        const ResizeKernels *kernels = GetResizeKernels();
+        if (format == RGBA64PixelFormat) {
+            return alpha == MatteResizeAlpha
+                       ? kernels->fixed_wide_vertical[layout]
+                       : kernels->fixed_wide_plain_vertical[layout];
+        }
+        return alpha == MatteResizeAlpha
+                   ? kernels->fixed_vertical[layout]
+                   : kernels->fixed_plain_vertical[layout];
+    }
+    if (format != RGBA32PixelFormat) {
+        const ResizeKernels *kernels = GetResizeKernels();
+        VerticalRowKernel kernel = alpha == PremultipliedResizeAlpha
+                                       ? kernels->wide_premultiplied_vertical
+                                       : kernels->wide_vertical;
+        if (format == RGBA64PixelFormat &&
+            layout == OpacityLastPixelLayout && kernel != NULL) {
+            return kernel;
+        }
+        return GetFormatVerticalRowKernel(
+            format, alpha == PremultipliedResizeAlpha);
+    }
+    if (engine == FloatResizeEngine) {
+        return alpha == MatteResizeAlpha
+                   ? GetResizeKernels()->float_vertical[layout]
+                   : GetResizeKernels()->float_plain_vertical[layout];
+    }
+    if (alpha == PremultipliedResizeAlpha) {
+        return GetResizeKernels()->premultiplied_vertical[layout];
+    }
+    if (alpha == OpaqueResizeAlpha) {
+        return GetResizeKernels()->opaque_vertical[layout];
+    }
+    return GetResizeKernels()->vertical[layout];
+}
+
+static void HorizontalFilterBand(const FilterPass *pass, const uint64_t band) {
+    const MagickImage *source = pass->source;
+    const MagickImage *destination = pass->destination;
+    uint64_t y = band * pass->band_rows;
+    uint64_t stop = Min(y + pass->band_rows, destination->rows);
+
+    if (pass->linear) {
+        MagickPixelPacket4 *row = (MagickPixelPacket4 *)(
+            (MagickQuantum *)pass->linear_rows +
+            band * source->columns * GetPixelSize(RGBA64PixelFormat));
+        for (; y < stop; y++) {
+            DecodeLinearRow(source->format,
+                            source->order,
+                            GetImageRow(source, y),
+                            source->columns,
+                            row);
+            pass->horizontal(pass->table,
+                             row,
+                             OpacityLastOrder,
+                             GetImageRow(destination, y),
+                             OpacityLastOrder);
+        }
+        return;
+    }
+    for (; y < stop; y++) {
+        pass->horizontal(pass->table,
+                         GetImageRow(source, y),
+                         source->order,
+                         GetImageRow(destination, y),
+                         destination->order);
+    }
+}
+
+static void VerticalFilterBand(const FilterPass *pass, const uint64_t band) {
+    const MagickImage *source = pass->source;
+    const MagickImage *destination = pass->destination;
+    const MagickPixelPacket4 **rows = pass->rows + band * pass->table->max_count;
+    uint64_t y = band * pass->band_rows;
+    uint64_t stop = Min(y + pass->band_rows, destination->rows);
+
+    for (; y < stop; y++) {
+        const ContributionWindow *window = &pass->table->windows[y];
+        for (int64_t i = 0; i < window->count; i++) {
+            rows[i] = GetImageRow(source, window->start + i);
+        }
+        if (pass->linear) {
+            MagickPixelPacket4 *row = (MagickPixelPacket4 *)(
+                (MagickQuantum *)pass->linear_rows +
+                band * destination->columns * GetPixelSize(RGBA64PixelFormat));
+            pass->vertical(pass->table,
+                           y,
+                           rows,
+                           OpacityLastOrder,
+                           row,
+                           destination->columns,
+                           OpacityLastOrder);
+            EncodeLinearRow(row,
+                            destination->columns,
+                            destination->format,
+                            destination->order,
+                            GetImageRow(destination, y));
+            continue;
+        }
+        pass->vertical(pass->table,
+                       y,
+                       rows,
+                       source->order,
+                       GetImageRow(destination, y),
+                       destination->columns,
+                       destination->order);
+    }
+}
+
+MagickPassFail PrepareFilterPass(FilterPass *pass,
+                                 const MagickImage *source,
+                                 const MagickImage *destination,
+                                 const ContributionTable *table,
+                                 const bool horizontal,
+                                 const ResizeEngineType engine,
+                                 const ResizeAlphaMode alpha,
+                                 MagickThreadPool *pool,
+                                 MagickArena *scratch) {
+    uint64_t bands = (uint64_t)GetThreadPoolSize(pool) * 4;
+    bands = Min(bands, destination->rows);
+    pass->source = source;
+    pass->destination = destination;
+    pass->table = table;
+    pass->linear = source->format != destination->format &&
+                   engine != FixedPointResizeEngine;
+    if (pass->linear) {
+        pass->horizontal = GetHorizontalRowKernel(engine,
+                                                  RGBA64PixelFormat,
+                                                  OpacityLastOrder,
+                                                  OpacityLastOrder,
+                                                  alpha);
+        pass->vertical = GetVerticalRowKernel(engine,
+                                              RGBA64PixelFormat,
+                                              OpacityLastOrder,
+                                              OpacityLastOrder,
+                                              alpha);
+    } else {
+        pass->horizontal = GetHorizontalRowKernel(
+            engine, source->format, source->order, destination->order, alpha);
+        pass->vertical = GetVerticalRowKernel(
+            engine, source->format, source->order, destination->order, alpha);
+    }
+    pass->is_horizontal = horizontal;
+    pass->band_rows = (destination->rows + bands - 1) / bands;
+    pass->bands = (destination->rows + pass->band_rows - 1) / pass->band_rows;
+    pass->linear_rows = NULL;
+    pass->rows = NULL;
+    if (pass->linear) {
+        InitializeLinearLight();
+        uint64_t columns = horizontal ? source->columns : destination->columns;
+        pass->linear_rows = (MagickPixelPacket4 *)ArenaAllocate(
+            scratch,
+            pass->bands * columns * GetPixelSize(RGBA64PixelFormat));
+        if (pass->linear_rows == NULL) return MagickFail;
+    }
+    if (!horizontal) {
+        pass->rows = (const MagickPixelPacket4 **)ArenaAllocate(
+            scratch,
+            pass->bands * table->max_count * sizeof(MagickPixelPacket4 *));
+        if (pass->rows == NULL) return MagickFail;
+    }
+    return MagickPass;
+}
+
+typedef struct _FilterPassList {
+    const FilterPass *passes;
+    uint64_t count;
+} FilterPassList;
+
+static void FilterPassListBand(void *arg, const uint64_t index) {
+    const FilterPassList *list = (const FilterPassList *)arg;
+    const FilterPass *pass = list->passes;
+    uint64_t band = index;
+
+    while (band >= pass->bands) {
+        band -= pass->bands;
+        pass++;
+    }
+    if (pass->is_horizontal) {
+        HorizontalFilterBand(pass, band);
+    } else {
+        VerticalFilterBand(pass, band);
+    }
+}
+
+void RunFilterPasses(const FilterPass *passes,
+                     const uint64_t count,
+                     MagickThreadPool *pool) {
+    FilterPassList list;
+    uint64_t bands = 0;
+
+    for (uint64_t i = 0; i < count; i++) bands += passes[i].bands;
+    list.passes = passes;
+    list.count = count;
+    ThreadPoolRun(pool, FilterPassListBand, &list, bands);
+}
+
+static MagickPassFail RunFilterPass(const MagickImage *restrict source,
+                                    const MagickImage *restrict destination,
+                                    const ContributionTable *restrict table,
+                                    const bool horizontal,
+                                    const ResizeEngineType engine,
+                                    const ResizeAlphaMode alpha,
+                                    MagickThreadPool *pool,
+                                    MagickArena *scratch) {
+    FilterPass pass;
+    if (PrepareFilterPass(&pass,
+                          source,
+                          destination,
+                          table,
+                          horizontal,
+                          engine,
+                          alpha,
+                          pool,
+                          scratch) == MagickFail) {
+        return MagickFail;
+    }
+    RunFilterPasses(&pass, 1, pool);
+    return MagickPass;
+}
+
+static MagickPassFail HorizontalFilter(
+    const MagickImage *restrict source,
+    const MagickImage *restrict destination,
+    const ContributionTable *restrict table,
+    const ResizeEngineType engine,
+    const ResizeAlphaMode alpha,
+    MagickThreadPool *pool,
+    MagickArena *scratch) {
+    return RunFilterPass(source,
+                         destination,
+                         table,
+                         true,
+                         engine,
+                         alpha,
+                         pool,
+                         scratch);
+}
+
 static MagickPassFail VerticalFilter(const MagickImage *restrict source,
                                      const MagickImage *restrict destination,
-                                     const double y_factor,
-                                     const FilterInfo *restrict filter_info,
-                                     const double blur,
-                                     ContributionInfo *restrict view_data_set) {
-    const bool matte = true;
-    MagickPassFail status = MagickPass;
-    double scale = blur * Max(1.0 / y_factor, 1.0);
-    double support = scale * filter_info->support;
-    if (support <= 0.5) {
-        support = 0.5 + MagickEpsilon;
-        scale = 1.0;
-    }
-    scale = 1.0 / scale;
-    DoublePixelPacket zero;
-    (void)memset(&zero, 0, sizeof(DoublePixelPacket));
-    ContributionInfo *restrict contribution = view_data_set;
-    MagickPixelPacket4 *source_pixels = (MagickPixelPacket4 *)source->pixels;
-    MagickPixelPacket4 *destination_pixels =
-        (MagickPixelPacket4 *)destination->pixels;
-
-    for (uint64_t y = 0; y < destination->rows; y++) {
-        MagickPassFail thread_status;
-        thread_status = status;
-        if (thread_status == MagickFail) continue;
-        double center = (double)(y + 0.5) / y_factor;
-        int64_t start = (int64_t)Max(center - support + 0.5, 0);
-        int64_t stop = (int64_t)Min(center + support + 0.5, source->rows);
-        double density = 0.0;
-        int64_t n = 0;
-        for (n = 0; n < (stop - start); n++) {
-            contribution[n].pixel = start + n;
-            contribution[n].weight = filter_info->function(
-                scale * ((double)start + n - center + 0.5),
-                filter_info->support);
-            density += contribution[n].weight;
+                                     const ContributionTable *restrict table,
+                                     const ResizeEngineType engine,
+                                     const ResizeAlphaMode alpha,
+                                     MagickThreadPool *pool,
+                                     MagickArena *scratch) {
+    return RunFilterPass(
+        source, destination, table, false, engine, alpha, pool, scratch);
+}
+
+bool IsOpaqueImage(const MagickImage *image) {
+    const int opacity = image->order.opacity;
+    for (uint64_t y = 0; y < image->rows; y++) {
+        const MagickQuantum *p = (const MagickQuantum *)GetImageRow(image, y);
+        // and of every pixel of the row, whole words so the loop vectorizes
+        uint32_t all = 0xffffffffU, value;
+        for (uint64_t x = 0; x < image->columns; x++) {
+            memcpy(&value, p + x * sizeof(MagickPixelPacket4), sizeof(value));
+            all &= value;
         }
-        if (density != 0.0 && density != 1.0) {
-            int64_t i;
-            density = 1.0 / density;
-            for (i = 0; i < n; i++) contribution[i].weight *= density;
+        if (((const MagickQuantum *)&all)[opacity] != MaxRGB) return false;
+    }
+    return true;
+}
+
+/*
+    The opaque kernels only exist for RGBA32, the intermediate image of an
+    opaque source is opaque as well so both passes use them.
+*/
+ResizeAlphaMode GetResizeAlphaMode(const MagickImage *src,
+                                   const ResizeOptions *options) {
+    if (options->alpha == PremultipliedResizeAlpha) {
+        return PremultipliedResizeAlpha;
+    }
+    if (IsLinearResize(src, options)) {
+        if (!MagickPixelFormats[src->format].matte ||
+            options->alpha == OpaqueResizeAlpha ||
+            (options->alpha == DetectResizeAlpha &&
+             src->format == RGBA32PixelFormat && IsOpaqueImage(src))) {
+            return PremultipliedResizeAlpha;
         }
-        int64_t p_offset = source->columns * contribution[0].pixel;
-        MagickPixelPacket4 *p = (source_pixels + p_offset);
-        int64_t q_offset = destination->columns * y;
-        MagickPixelPacket4 *q = (destination_pixels + q_offset);
-
-        if (thread_status != MagickFail) {
-            if (matte) {
-                for (int64_t x = 0; x < destination->columns; x++) {
-                    double transparency_coeff, normalize, weight;
-                    DoublePixelPacket pixel = zero;
-                    int64_t j;
-                    int64_t i;
-                    normalize = 0.0;
-                    for (i = 0; i < n; i++) {
-                        j = (int64_t)((contribution[i].pixel -
-                                       contribution[0].pixel) *
-                                          source->columns +
-                                      x);
-
-                        weight = contribution[i].weight;
-                        MagickQuantum opacity =
-                            TransparentOpacity -
-                            GET_PIXEL_PACKET(p[j], source->order.opacity);
-                        transparency_coeff =
-                            weight *
-                            (1 - ((double)opacity / TransparentOpacity));
-                        pixel.red += transparency_coeff *
-                                     GET_PIXEL_PACKET(p[j], source->order.red);
-                        pixel.green +=
-                            transparency_coeff *
-                            GET_PIXEL_PACKET(p[j], source->order.green);
-                        pixel.blue +=
-                            transparency_coeff *
-                            GET_PIXEL_PACKET(p[j], source->order.blue);
-                        pixel.opacity += weight * opacity;
-                        normalize += transparency_coeff;
-                    }
-                    normalize = 1.0 / (AbsoluteValue(normalize) <= MagickEpsilon
-                                           ? 1.0
-                                           : normalize);
-                    pixel.red *= normalize;
-                    pixel.green *= normalize;
-                    pixel.blue *= normalize;
-                    SET_PIXEL_PACKET(q[x],
-                                     destination->order.red,
-                                     RoundDoubleToQuantum(pixel.red));
-                    SET_PIXEL_PACKET(q[x],
-                                     destination->order.green,
-                                     RoundDoubleToQuantum(pixel.green));
-                    SET_PIXEL_PACKET(q[x],
-                                     destination->order.blue,
-                                     RoundDoubleToQuantum(pixel.blue));
-                    SET_PIXEL_PACKET(q[x],
-                                     destination->order.opacity,
-                                     (TransparentOpacity -
-                                      RoundDoubleToQuantum(pixel.opacity)));
-                }
-            }
+        return MatteResizeAlpha;
+    }
+    if (src->format != RGBA32PixelFormat ||
+        options->alpha == MatteResizeAlpha) {
+        return MatteResizeAlpha;
+    }
+    if (options->alpha == OpaqueResizeAlpha || IsOpaqueImage(src)) {
+        return OpaqueResizeAlpha;
+    }
+    return MatteResizeAlpha;
+}
+
+bool IsLinearResize(const MagickImage *src, const ResizeOptions *options) {
+    return options->linear_light && MagickPixelFormats[src->format].depth == 1;
+}
+
+ResizeEngineType GetResizeEngine(const MagickImage *src,
+                                 const ResizeOptions *options) {
+    if (options->engine == FixedPointResizeEngine &&
+        (src->format != RGBA32PixelFormat || IsLinearResize(src, options))) {
+        return DoubleResizeEngine;
+    }
+    return options->engine;
+}
+
+ResizeFastPath GetPlanFastPath(const ResizePlan *plan, const bool linear) {
+    if (linear && (plan->fast_path == BoxAverageResizeFastPath ||
+                   plan->x_halvings > 0 || plan->y_halvings > 0)) {
+        return NoResizeFastPath;
+    }
+    return plan->fast_path;
+}
+
+bool AllocateImage(MagickImage *image,
+                   const uint64_t columns,
+                   const uint64_t rows,
+                   const MagickPixelFormat format,
+                   const MagickPixelOrder order,
+                   MagickArena *arena) {
+    image->pixels = (MagickPixelPacket4 *)ArenaAllocate(
+        arena, columns * rows * GetPixelSize(format));
+    image->columns = columns;
+    image->rows = rows;
+    image->order = order;
+    image->stride = 0;
+    image->format = format;
+    return image->pixels != NULL;
+}
+
+static FilterTypes GetResizeFilter(const FilterTypes filter) {
+    if (filter != UndefinedFilter) {
+        return filter;
+    }
+    return MitchellFilter;
+}
+
+void GetResizeCostModel(ResizeCostModel *model) {
+    model->horizontal_tap = 2.0;
+    model->horizontal_pixel = 3.5;
+    model->vertical_tap = 2.4;
+    model->vertical_pixel = 2.5;
+}
+
+/*
+    Best of three runs of one pass in nanoseconds, 0 when it fails.
+*/
+static double TimeFilterPass(const MagickImage *source,
+                             const MagickImage *destination,
+                             const ContributionTable *table,
+                             const bool horizontal,
+                             MagickArena *scratch) {
+    uint64_t best = 0;
+    for (int i = 0; i < 3; i++) {
+        uint64_t start = GetMagickNanoseconds(), elapsed;
+        ResetArena(scratch);
+        if (RunFilterPass(source,
+                          destination,
+                          table,
+                          horizontal,
+                          DoubleResizeEngine,
+                          MatteResizeAlpha,
+                          NULL,
+                          scratch) == MagickFail) {
+            return 0.0;
         }
+        elapsed = GetMagickNanoseconds() - start;
+        if (i == 0 || elapsed < best) best = elapsed;
     }
-    return status;
+    return (double)Max(best, 1);
 }
 
-static MagickImage *AllocateImage(const uint64_t columns,
-                                  const uint64_t rows,
-                                  const MagickPixelOrder order) {
-    MagickImage *img = (MagickImage *)malloc(sizeof(MagickImage));
-    img->pixels = (MagickPixelPacket4 *)malloc(columns * rows *
-                                               sizeof(MagickPixelPacket4));
-    img->columns = columns;
-    img->rows = rows;
-    img->order = order;
-    return img;
+/*
+    Solves the tap and pixel costs of one pass from a narrow and a wide
+    table, both run over the same number of lines. Noise that leaves a cost
+    negative falls back to taps alone.
+*/
+static void SolvePassCost(const ContributionTable *narrow,
+                          const double narrow_ns,
+                          const ContributionTable *wide,
+                          const double wide_ns,
+                          double *tap,
+                          double *pixel) {
+    const double narrow_taps = (double)narrow->taps,
+                 wide_taps = (double)wide->taps;
+    const double narrow_pixels = (double)narrow->length,
+                 wide_pixels = (double)wide->length;
+    const double det = narrow_taps * wide_pixels - wide_taps * narrow_pixels;
+    *tap = (narrow_ns * wide_pixels - wide_ns * narrow_pixels) / det;
+    *pixel = (narrow_taps * wide_ns - wide_taps * narrow_ns) / det;
+    if (!(*tap > 0.0 && *pixel > 0.0)) {
+        *tap = (narrow_ns + wide_ns) / (narrow_taps + wide_taps);
+        *pixel = 0.0;
+    }
 }
 
-static void DestroyImage(MagickImage *img) {
-    if (img->pixels != NULL) free(img->pixels);
-    img->pixels = NULL;
-    free(img);
+int CalibrateResizeCostModel(ResizeCostModel *model) {
+    const uint64_t size = 256, reduced = 64, lines = 256;
+    ContributionTable narrow, wide;
+    MagickImage source, destination;
+    MagickArena arena, scratch;
+    double narrow_ns, wide_ns, horizontal_tap, horizontal_pixel;
+    int ret = 2;
+
+    InitializeArena(&arena);
+    InitializeArena(&scratch);
+    // same size with two or three taps, and 4x down with about 24
+    if (BuildContributionTable(&narrow,
+                               size,
+                               size,
+                               1.0,
+                               0.0,
+                               &filters[TriangleFilter],
+                               NULL,
+                               1.0,
+                               &arena) == MagickFail ||
+        BuildContributionTable(&wide,
+                               size,
+                               reduced,
+                               (double)reduced / size,
+                               0.0,
+                               &filters[LanczosFilter],
+                               NULL,
+                               1.0,
+                               &arena) == MagickFail ||
+        !AllocateImage(&source,
+                       size,
+                       lines,
+                       RGBA32PixelFormat,
+                       OpacityLastOrder,
+                       &arena) ||
+        !AllocateImage(&destination,
+                       size,
+                       lines,
+                       RGBA32PixelFormat,
+                       OpacityLastOrder,
+                       &arena)) {
+        goto done;
+    }
+    for (uint64_t i = 0; i < size * lines * sizeof(MagickPixelPacket4); i++) {
+        ((MagickQuantum *)source.pixels)[i] =
+            (MagickQuantum)((i * 2654435761U) >> 24);
+    }
+
+    narrow_ns = TimeFilterPass(&source, &destination, &narrow, true, &scratch);
+    destination.columns = reduced;
+    wide_ns = TimeFilterPass(&source, &destination, &wide, true, &scratch);
+    if (narrow_ns == 0.0 || wide_ns == 0.0) goto done;
+    SolvePassCost(&narrow,
+                  narrow_ns / lines,
+                  &wide,
+                  wide_ns / lines,
+                  &horizontal_tap,
+                  &horizontal_pixel);
+
+    // columns of the source are the lines of the vertical pass
+    destination.columns = size;
+    narrow_ns = TimeFilterPass(&source, &destination, &narrow, false, &scratch);
+    destination.rows = reduced;
+    wide_ns = TimeFilterPass(&source, &destination, &wide, false, &scratch);
+    if (narrow_ns == 0.0 || wide_ns == 0.0) goto done;
+    SolvePassCost(&narrow,
+                  narrow_ns / size,
+                  &wide,
+                  wide_ns / size,
+                  &model->vertical_tap,
+                  &model->vertical_pixel);
+    model->horizontal_tap = horizontal_tap;
+    model->horizontal_pixel = horizontal_pixel;
+    ret = 0;
+
+done:
+    DestroyArena(&scratch);
+    DestroyArena(&arena);
+    return ret;
 }
 
-int ResizeImage(const MagickImage *src,
-                const MagickImage *dst,
-                const FilterTypes filter,
-                const double blur) {
-    int64_t columns = dst->columns;
-    int64_t rows = dst->rows;
-    double support, x_factor, x_support, y_factor, y_support;
+/*
+    The cost model only overrides the pixel count order of the original resize
+    when the two estimates differ by more than this fraction and the factors
+    are not isotropic, near ties keep the original output.
+*/
+#define PassOrderMargin 0.1
+
+/*
+    Estimated nanoseconds of one line of a pass with table.
+*/
+static double GetLineCost(const ContributionTable *table,
+                          const double tap,
+                          const double pixel) {
+    return (double)table->taps * tap + (double)table->length * pixel;
+}
+
+/*
+    The first pass filters every line of the (reduced) source, the second
+    every line of the intermediate, whose length the first pass set.
+*/
+static bool IsHorizontalFirst(const ResizePlan *plan,
+                              const uint64_t source_columns,
+                              const uint64_t source_rows,
+                              const ResizeCostModel *model) {
+    const double horizontal = GetLineCost(
+        &plan->horizontal, model->horizontal_tap, model->horizontal_pixel);
+    const double vertical = GetLineCost(
+        &plan->vertical, model->vertical_tap, model->vertical_pixel);
+    const double horizontal_first =
+        (double)source_rows * horizontal + (double)plan->columns * vertical;
+    const double vertical_first =
+        (double)source_columns * vertical + (double)plan->rows * horizontal;
+    const bool baseline =
+        (double)plan->columns * (double)(source_rows + plan->rows) >
+        (double)plan->rows * (double)(source_columns + plan->columns);
+
+    if ((double)plan->columns * source_rows ==
+            (double)plan->rows * source_columns ||
+        fabs(horizontal_first - vertical_first) <=
+            PassOrderMargin * fmin(horizontal_first, vertical_first)) {
+        return baseline;
+    }
+    return horizontal_first < vertical_first;
+}
+
+/*
+    (Re)builds the weight tables of plan in its arena. The destination spans
+    region of the source, the whole source when region is NULL. With a
+    progressive_factor the source is first halved while an axis stays that
+    many times its target, the tables then start from the reduced image.
+    The pass order is the cheaper one under cost_model, the defaults when it
+    is NULL.
+*/
+static MagickPassFail InitializeResizePlan(ResizePlan *plan,
+                                           const uint64_t src_columns,
+                                           const uint64_t src_rows,
+                                           const ResizeRegion *region,
+                                           const uint64_t columns,
+                                           const uint64_t rows,
+                                           const FilterTypes filter,
+                                           const double blur,
+                                           const bool tabulate_filters,
+                                           const double progressive_factor,
+                                           const ResizeCostModel *cost_model) {
+    double x_factor, y_factor, x_offset = 0.0, y_offset = 0.0;
+    double width = (double)src_columns, height = (double)src_rows;
+    uint64_t reduced_columns = src_columns, reduced_rows = src_rows;
+    const double *filter_table;
     int64_t i = 0;
-    MagickPassFail status;
-    bool order;
     assert(((int)filter >= 0) && ((int)filter <= SincFilter));
 
-    if (src->columns == 0 || src->rows == 0 || columns == 0 || rows == 0) {
-        return 1;
+    if (src_columns == 0 || src_rows == 0 || columns == 0 || rows == 0) {
+        return MagickFail;
     }
-    if (columns == src->columns && rows == src->rows && blur == 1.0) {
-        // Todo 直接拷贝
-        return 2;
+    ResetArena(&plan->arena);
+    plan->src_columns = src_columns;
+    plan->src_rows = src_rows;
+    plan->columns = columns;
+    plan->rows = rows;
+    plan->blur = blur;
+    plan->tabulate_filters = tabulate_filters;
+    plan->progressive_factor = progressive_factor;
+    if (cost_model != NULL) {
+        plan->cost_model = *cost_model;
+    } else {
+        GetResizeCostModel(&plan->cost_model);
     }
+    plan->x_halvings = 0;
+    plan->y_halvings = 0;
 
-    order = (((double)columns * (src->rows + rows)) >
-             ((double)rows * (src->columns + columns)));
-    MagickImage *source_image =
-        order ? AllocateImage(columns, src->rows, src->order)
-              : AllocateImage(src->columns, rows, src->order);
+    i = GetResizeFilter(filter);
+    plan->filter = (FilterTypes)i;
+    plan->fast_path = GetResizeFastPath(
+        src_columns, src_rows, columns, rows, plan->filter, blur);
+    if (region != NULL) {
+        x_offset = region->x;
+        y_offset = region->y;
+        width = region->width;
+        height = region->height;
+    }
+    if (progressive_factor > 0.0 && plan->fast_path == NoResizeFastPath &&
+        plan->filter != PointFilter) {
+        const double factor = Max(progressive_factor, 1.0);
+        for (; width / 2.0 >= factor * columns; plan->x_halvings++) {
+            x_offset /= 2.0;
+            width /= 2.0;
+            reduced_columns = (reduced_columns + 1) / 2;
+        }
+        for (; height / 2.0 >= factor * rows; plan->y_halvings++) {
+            y_offset /= 2.0;
+            height /= 2.0;
+            reduced_rows = (reduced_rows + 1) / 2;
+        }
+        plan->fast_path = GetResizeFastPath(
+            reduced_columns, reduced_rows, columns, rows, plan->filter, blur);
+    }
+    if (x_offset != 0.0 || y_offset != 0.0 ||
+        width != (double)reduced_columns || height != (double)reduced_rows) {
+        plan->fast_path = NoResizeFastPath;
+    }
+    x_factor = columns / width;
+    y_factor = rows / height;
+    filter_table = tabulate_filters ? GetFilterTable(plan->filter) : NULL;
+    if (BuildContributionTable(&plan->horizontal,
+                               reduced_columns,
+                               columns,
+                               x_factor,
+                               x_offset,
+                               &filters[i],
+                               filter_table,
+                               blur,
+                               &plan->arena) == MagickFail ||
+        BuildContributionTable(&plan->vertical,
+                               reduced_rows,
+                               rows,
+                               y_factor,
+                               y_offset,
+                               &filters[i],
+                               filter_table,
+                               blur,
+                               &plan->arena) == MagickFail) {
+        return MagickFail;
+    }
+    plan->order = IsHorizontalFirst(
+        plan, reduced_columns, reduced_rows, &plan->cost_model);
+    return MagickPass;
+}
 
-    x_factor = (double)columns / src->columns;
-    y_factor = (double)rows / src->rows;
-    i = DefaultResizeFilter;
-    if (filter != UndefinedFilter) {
-        i = filter;
-        // } else if ((x_factor * y_factor) > 1.0 || 1) {
-    } else {
-        i = MitchellFilter;
-    }
-    x_support = blur * Max(1.0 / x_factor, 1.0) * filters[i].support;
-    y_support = blur * Max(1.0 / y_factor, 1.0) * filters[i].support;
-    support = Max(x_support, y_support);
-    if (support < filters[i].support) support = filters[i].support;
-    ContributionInfo *view_data_set = (ContributionInfo *)malloc(
-        sizeof(ContributionInfo) * (size_t)(2.0 * Max(support, 0.5) + 3));
-    if (view_data_set == NULL) {
+static ResizePlan *CreateRegionResizePlan(const uint64_t src_columns,
+                                          const uint64_t src_rows,
+                                          const ResizeRegion *region,
+                                          const uint64_t columns,
+                                          const uint64_t rows,
+                                          const FilterTypes filter,
+                                          const double blur,
+                                          const ResizeOptions *options) {
+    bool tabulate_filters = options != NULL && options->tabulate_filters;
+    double progressive_factor =
+        options != NULL ? options->progressive_factor : 0.0;
+    const ResizeCostModel *cost_model =
+        options != NULL ? options->cost_model : NULL;
+    ResizePlan *plan = (ResizePlan *)malloc(sizeof(ResizePlan));
+    if (plan == NULL) {
+        return NULL;
+    }
+    memset(plan, 0, sizeof(ResizePlan));
+    InitializeArena(&plan->arena);
+    if (InitializeResizePlan(plan,
+                             src_columns,
+                             src_rows,
+                             region,
+                             columns,
+                             rows,
+                             filter,
+                             blur,
+                             tabulate_filters,
+                             progressive_factor,
+                             cost_model) == MagickFail) {
+        DestroyResizePlan(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+ResizePlan *CreateResizePlanWithOptions(const uint64_t src_columns,
+                                        const uint64_t src_rows,
+                                        const uint64_t columns,
+                                        const uint64_t rows,
+                                        const FilterTypes filter,
+                                        const double blur,
+                                        const ResizeOptions *options) {
+    return CreateRegionResizePlan(
+        src_columns, src_rows, NULL, columns, rows, filter, blur, options);
+}
+
+ResizePlan *CreateResizePlan(const uint64_t src_columns,
+                             const uint64_t src_rows,
+                             const uint64_t columns,
+                             const uint64_t rows,
+                             const FilterTypes filter,
+                             const double blur) {
+    return CreateResizePlanWithOptions(
+        src_columns, src_rows, columns, rows, filter, blur, NULL);
+}
+
+void DestroyResizePlan(ResizePlan *plan) {
+    if (plan == NULL) return;
+    DestroyArena(&plan->arena);
+    free(plan);
+}
+
+void GetResizeOptions(ResizeOptions *options) {
+    memset(options, 0, sizeof(ResizeOptions));
+    options->threads = 1;
+    options->pool = NULL;
+    options->engine = DoubleResizeEngine;
+    options->tabulate_filters = false;
+    options->alpha = DetectResizeAlpha;
+    options->linear_light = false;
+    options->progressive_factor = 0.0;
+    options->stats = NULL;
+    options->cost_model = NULL;
+}
+
+/*
+    Halves src plan->x_halvings and plan->y_halvings times, alternating
+    between two scratch images that each keep the size of their first and
+    largest level. Returns the reduced image, in RGBA64 linear light when
+    linear, and adds the bytes of both images to bytes.
+*/
+static const MagickImage *ReduceImage(const ResizePlan *plan,
+                                      const MagickImage *src,
+                                      const bool linear,
+                                      const bool premultiplied,
+                                      MagickImage *images,
+                                      uint64_t *bytes,
+                                      MagickThreadPool *pool,
+                                      MagickArena *scratch) {
+    const MagickImage *source = src;
+    int x_halvings = plan->x_halvings, y_halvings = plan->y_halvings;
+    for (int level = 0; x_halvings > 0 || y_halvings > 0; level++) {
+        MagickImage *image = &images[level % 2];
+        uint64_t columns = source->columns, rows = source->rows;
+        if (x_halvings-- > 0) columns = (columns + 1) / 2;
+        if (y_halvings-- > 0) rows = (rows + 1) / 2;
+        if (level < 2) {
+            if (!AllocateImage(image,
+                               columns,
+                               rows,
+                               linear ? RGBA64PixelFormat : src->format,
+                               linear ? OpacityLastOrder : src->order,
+                               scratch)) {
+                return NULL;
+            }
+            *bytes += columns * rows * GetPixelSize(image->format);
+        } else {
+            image->columns = columns;
+            image->rows = rows;
+        }
+        if (HalveImage(source, image, premultiplied, pool, scratch) ==
+            MagickFail) {
+            return NULL;
+        }
+        source = image;
+    }
+    return source;
+}
+
+/*
+    Clears stats and returns the start of the call, 0 without stats.
+*/
+static uint64_t StartResizeStats(ResizeStats *stats) {
+    if (stats == NULL) return 0;
+    memset(stats, 0, sizeof(ResizeStats));
+    return GetMagickNanoseconds();
+}
+
+/*
+    Nanoseconds since *start, which moves to now. Only called with stats.
+*/
+static uint64_t GetStageTime(uint64_t *start) {
+    uint64_t now = GetMagickNanoseconds(), elapsed = now - *start;
+    *start = now;
+    return elapsed;
+}
+
+static void DescribeResizePlan(const ResizePlan *plan,
+                               const bool order,
+                               const ResizeFastPath fast_path,
+                               MagickThreadPool *pool,
+                               ResizeStats *stats) {
+    stats->filter = plan->filter;
+    stats->horizontal_first = order;
+    stats->fast_path = fast_path != NoResizeFastPath;
+    stats->x_halvings = plan->x_halvings;
+    stats->y_halvings = plan->y_halvings;
+    stats->threads = GetThreadPoolSize(pool);
+    stats->x_support = plan->horizontal.support;
+    stats->y_support = plan->vertical.support;
+    stats->x_taps = plan->horizontal.max_count;
+    stats->y_taps = plan->vertical.max_count;
+    stats->x_total_taps = plan->horizontal.taps;
+    stats->y_total_taps = plan->vertical.taps;
+}
+
+/*
+    Runs both passes of plan, every allocation comes from scratch. The stages
+    are timed into options->stats when it is set.
+*/
+static int ExecuteResizePlan(const ResizePlan *plan,
+                             const MagickImage *src,
+                             const MagickImage *dst,
+                             const ResizeOptions *options,
+                             MagickThreadPool *pool,
+                             MagickArena *scratch) {
+    MagickPassFail status;
+    MagickImage source_image, reduced[2];
+    const MagickImage *source = src;
+    bool linear = IsLinearResize(src, options);
+    // decoding in the horizontal pass reads every source pixel once
+    bool order = plan->order || linear;
+    ResizeFastPath fast_path = GetPlanFastPath(plan, linear);
+    ResizeEngineType engine = GetResizeEngine(src, options);
+    MagickPixelFormat format = linear || engine == FixedPointResizeEngine
+                                   ? RGBA64PixelFormat
+                                   : src->format;
+    MagickPixelOrder pixel_order = linear ? OpacityLastOrder : src->order;
+    ResizeAlphaMode alpha = DetectResizeAlpha;
+    ResizeStats *stats = options->stats;
+    uint64_t clock = 0, reduce_bytes = 0;
+
+    if (src->columns != plan->src_columns || src->rows != plan->src_rows ||
+        dst->columns != plan->columns || dst->rows != plan->rows) {
+        return 1;
+    }
+    if (!IsValidImageLayout(src) || !IsValidImageLayout(dst) ||
+        src->format != dst->format ||
+        (options->linear_light && options->alpha == PremultipliedResizeAlpha)) {
+        return 1;
+    }
+    if (stats != NULL) {
+        DescribeResizePlan(plan, order, fast_path, pool, stats);
+        clock = GetMagickNanoseconds();
+    }
+    if (plan->x_halvings > 0 || plan->y_halvings > 0) {
+        // opaque pixels halve to the same bytes with plain sums, and the
+        // reduced image stays opaque
+        alpha = GetResizeAlphaMode(src, options);
+        if (stats != NULL) stats->setup_ns += GetStageTime(&clock);
+        source = ReduceImage(plan,
+                             src,
+                             linear,
+                             alpha == OpaqueResizeAlpha ||
+                                 alpha == PremultipliedResizeAlpha,
+                             reduced,
+                             &reduce_bytes,
+                             pool,
+                             scratch);
+        if (source == NULL) {
+            return 2;
+        }
+        if (stats != NULL) {
+            stats->reduce_bytes = reduce_bytes;
+            stats->reduce_ns = GetStageTime(&clock);
+        }
+    }
+    if (fast_path != NoResizeFastPath) {
+        RunResizeFastPath(fast_path,
+                          source,
+                          dst,
+                          options->alpha == PremultipliedResizeAlpha,
+                          pool);
+        if (stats != NULL) stats->first_pass_ns = GetStageTime(&clock);
+        return 0;
+    }
+    if (alpha == DetectResizeAlpha) {
+        alpha = GetResizeAlphaMode(src, options);
+    }
+    if (!(order ? AllocateImage(&source_image,
+                                plan->columns,
+                                source->rows,
+                                format,
+                                pixel_order,
+                                scratch)
+                : AllocateImage(&source_image,
+                                source->columns,
+                                plan->rows,
+                                format,
+                                pixel_order,
+                                scratch))) {
         return 2;
     }
+    if (stats != NULL) {
+        stats->intermediate_bytes = source_image.columns * source_image.rows *
+                                    GetPixelSize(format);
+        stats->setup_ns += GetStageTime(&clock);
+    }
+
     status = MagickPass;
     if (order) {
-        status = HorizontalFilter(
-            src, source_image, x_factor, &filters[i], blur, view_data_set);
+        status = HorizontalFilter(source,
+                                  &source_image,
+                                  &plan->horizontal,
+                                  engine,
+                                  alpha,
+                                  pool,
+                                  scratch);
+        if (stats != NULL) stats->first_pass_ns = GetStageTime(&clock);
         if (status != MagickFail) {
-            status = VerticalFilter(
-                source_image, dst, y_factor, &filters[i], blur, view_data_set);
+            status = VerticalFilter(&source_image,
+                                    dst,
+                                    &plan->vertical,
+                                    engine,
+                                    alpha,
+                                    pool,
+                                    scratch);
         }
     } else {
-        status = VerticalFilter(
-            src, source_image, y_factor, &filters[i], blur, view_data_set);
+        status = VerticalFilter(source,
+                                &source_image,
+                                &plan->vertical,
+                                engine,
+                                alpha,
+                                pool,
+                                scratch);
+        if (stats != NULL) stats->first_pass_ns = GetStageTime(&clock);
         if (status != MagickFail)
-            status = HorizontalFilter(
-                source_image, dst, x_factor, &filters[i], blur, view_data_set);
+            status = HorizontalFilter(&source_image,
+                                      dst,
+                                      &plan->horizontal,
+                                      engine,
+                                      alpha,
+                                      pool,
+                                      scratch);
     }
-    // free
-    free(view_data_set);
-    DestroyImage(source_image);
+    if (stats != NULL) stats->second_pass_ns = GetStageTime(&clock);
     if (status == MagickFail) {
         return 4;
     }
     return 0;
 }
+
+/*
+    Runs plan on a temporary pool and scratch arena, options is not NULL.
+*/
+static int RunResizePlan(const ResizePlan *plan,
+                         const MagickImage *src,
+                         const MagickImage *dst,
+                         const ResizeOptions *options) {
+    MagickThreadPool *pool;
+    MagickArena scratch;
+    uint64_t clock = options->stats != NULL ? GetMagickNanoseconds() : 0;
+    int ret;
+
+    pool = options->pool;
+    if (pool == NULL && options->threads > 1) {
+        pool = CreateThreadPool(options->threads);
+        if (pool == NULL) {
+            return 2;
+        }
+    }
+    if (options->stats != NULL) {
+        options->stats->setup_ns = GetStageTime(&clock);
+    }
+    InitializeArena(&scratch);
+    ret = ExecuteResizePlan(plan, src, dst, options, pool, &scratch);
+    DestroyArena(&scratch);
+    if (pool != options->pool) DestroyThreadPool(pool);
+    return ret;
+}
+
+int ResizeImageWithPlan(const ResizePlan *plan,
+                        const MagickImage *src,
+                        const MagickImage *dst,
+                        const ResizeOptions *options) {
+    ResizeOptions defaults;
+    uint64_t start;
+    int ret;
+
+    if (options == NULL) {
+        GetResizeOptions(&defaults);
+        options = &defaults;
+    }
+    start = StartResizeStats(options->stats);
+    ret = RunResizePlan(plan, src, dst, options);
+    if (options->stats != NULL) {
+        options->stats->total_ns = GetMagickNanoseconds() - start;
+    }
+    return ret;
+}
+
+int ResizeImageWithOptions(const MagickImage *src,
+                           const MagickImage *dst,
+                           const FilterTypes filter,
+                           const double blur,
+                           const ResizeOptions *options) {
+    ResizeOptions defaults;
+    uint64_t start;
+    int ret;
+    if (src->columns == 0 || src->rows == 0 || dst->columns == 0 ||
+        dst->rows == 0) {
+        return 1;
+    }
+    if (options == NULL) {
+        GetResizeOptions(&defaults);
+        options = &defaults;
+    }
+    start = StartResizeStats(options->stats);
+    ResizePlan *plan = CreateResizePlanWithOptions(src->columns,
+                                                   src->rows,
+                                                   dst->columns,
+                                                   dst->rows,
+                                                   filter,
+                                                   blur,
+                                                   options);
+    if (plan == NULL) {
+        return 2;
+    }
+    if (options->stats != NULL) {
+        options->stats->plan_ns = GetMagickNanoseconds() - start;
+    }
+    ret = RunResizePlan(plan, src, dst, options);
+    DestroyResizePlan(plan);
+    if (options->stats != NULL) {
+        options->stats->total_ns = GetMagickNanoseconds() - start;
+    }
+    return ret;
+}
+
+struct _ResizeContext {
+    ResizePlan plan;  // plan of the last geometry
+    bool has_plan;
+    MagickArena scratch;     // intermediate image and row pointers
+    MagickThreadPool *pool;  // pool for options->threads
+};
+
+ResizeContext *CreateResizeContext(void) {
+    ResizeContext *context = (ResizeContext *)malloc(sizeof(ResizeContext));
+    if (context == NULL) {
+        return NULL;
+    }
+    memset(context, 0, sizeof(ResizeContext));
+    InitializeArena(&context->plan.arena);
+    InitializeArena(&context->scratch);
+    return context;
+}
+
+void DestroyResizeContext(ResizeContext *context) {
+    if (context == NULL) return;
+    DestroyArena(&context->plan.arena);
+    DestroyArena(&context->scratch);
+    DestroyThreadPool(context->pool);
+    free(context);
+}
+
+int ResizeImageWithContext(ResizeContext *context,
+                           const MagickImage *src,
+                           const MagickImage *dst,
+                           const FilterTypes filter,
+                           const double blur,
+                           const ResizeOptions *options) {
+    ResizeOptions defaults;
+    MagickThreadPool *pool;
+    ResizePlan *plan = &context->plan;
+    ResizeCostModel cost_model;
+    uint64_t start, clock;
+    int ret;
+
+    if (src->columns == 0 || src->rows == 0 || dst->columns == 0 ||
+        dst->rows == 0) {
+        return 1;
+    }
+    if (options == NULL) {
+        GetResizeOptions(&defaults);
+        options = &defaults;
+    }
+    start = clock = StartResizeStats(options->stats);
+    if (options->cost_model != NULL) {
+        cost_model = *options->cost_model;
+    } else {
+        GetResizeCostModel(&cost_model);
+    }
+    if (!context->has_plan || plan->src_columns != src->columns ||
+        plan->src_rows != src->rows || plan->columns != dst->columns ||
+        plan->rows != dst->rows || plan->filter != GetResizeFilter(filter) ||
+        plan->blur != blur ||
+        plan->tabulate_filters != options->tabulate_filters ||
+        plan->progressive_factor != options->progressive_factor ||
+        memcmp(&plan->cost_model, &cost_model, sizeof(cost_model)) != 0) {
+        context->has_plan = InitializeResizePlan(plan,
+                                                 src->columns,
+                                                 src->rows,
+                                                 NULL,
+                                                 dst->columns,
+                                                 dst->rows,
+                                                 filter,
+                                                 blur,
+                                                 options->tabulate_filters,
+                                                 options->progressive_factor,
+                                                 &cost_model) == MagickPass;
+        if (!context->has_plan) {
+            return 2;
+        }
+        if (options->stats != NULL) {
+            options->stats->plan_ns = GetStageTime(&clock);
+        }
+    }
+    pool = options->pool;
+    if (pool == NULL && options->threads > 1) {
+        if (GetThreadPoolSize(context->pool) != options->threads) {
+            DestroyThreadPool(context->pool);
+            context->pool = CreateThreadPool(options->threads);
+            if (context->pool == NULL) {
+                return 2;
+            }
+        }
+        pool = context->pool;
+    }
+    if (options->stats != NULL) {
+        options->stats->setup_ns = GetStageTime(&clock);
+    }
+    ResetArena(&context->scratch);
+    ret = ExecuteResizePlan(plan, src, dst, options, pool, &context->scratch);
+    if (options->stats != NULL) {
+        options->stats->total_ns = GetMagickNanoseconds() - start;
+    }
+    return ret;
+}
+
+int GetImageView(const MagickImage *image,
+                 const uint64_t x,
+                 const uint64_t y,
+                 const uint64_t columns,
+                 const uint64_t rows,
+                 MagickImage *view) {
+    if (columns == 0 || rows == 0 || x > image->columns ||
+        columns > image->columns - x || y > image->rows ||
+        rows > image->rows - y || !IsValidImageLayout(image)) {
+        return 1;
+    }
+    *view = *image;
+    view->pixels = (MagickPixelPacket4 *)((MagickQuantum *)GetImageRow(
+                                              image, y) +
+                                          x * GetPixelSize(image->format));
+    view->columns = columns;
+    view->rows = rows;
+    view->stride = GetImageStride(image);
+    return 0;
+}
+
+int ResizeImageRegion(const MagickImage *src,
+                      const ResizeRegion *region,
+                      const MagickImage *dst,
+                      const FilterTypes filter,
+                      const double blur,
+                      const ResizeOptions *options) {
+    ResizeOptions defaults;
+    MagickImage view;
+    ResizeRegion bounds;
+    uint64_t x, y, start;
+    int ret;
+
+    if (!(region->x >= 0.0 && region->y >= 0.0 && region->width > 0.0 &&
+          region->height > 0.0) ||
+        region->x + region->width > (double)src->columns ||
+        region->y + region->height > (double)src->rows ||
+        dst->columns == 0 || dst->rows == 0) {
+        return 1;
+    }
+    // the pixels the region overlaps, the filters are clipped to them
+    x = (uint64_t)floor(region->x);
+    y = (uint64_t)floor(region->y);
+    if (GetImageView(src,
+                     x,
+                     y,
+                     (uint64_t)ceil(region->x + region->width) - x,
+                     (uint64_t)ceil(region->y + region->height) - y,
+                     &view) != 0) {
+        return 1;
+    }
+    if (options == NULL) {
+        GetResizeOptions(&defaults);
+        options = &defaults;
+    }
+    start = StartResizeStats(options->stats);
+    bounds.x = region->x - (double)x;
+    bounds.y = region->y - (double)y;
+    bounds.width = region->width;
+    bounds.height = region->height;
+    ResizePlan *plan = CreateRegionResizePlan(view.columns,
+                                              view.rows,
+                                              &bounds,
+                                              dst->columns,
+                                              dst->rows,
+                                              filter,
+                                              blur,
+                                              options);
+    if (plan == NULL) {
+        return 2;
+    }
+    if (options->stats != NULL) {
+        options->stats->plan_ns = GetMagickNanoseconds() - start;
+    }
+    ret = RunResizePlan(plan, &view, dst, options);
+    DestroyResizePlan(plan);
+    if (options->stats != NULL) {
+        options->stats->total_ns = GetMagickNanoseconds() - start;
+    }
+    return ret;
+}
+
+int ResizeImage(const MagickImage *src,
+                const MagickImage *dst,
+                const FilterTypes filter,
+                const double blur) {
+    return ResizeImageWithOptions(src, dst, filter, blur, NULL);
+}
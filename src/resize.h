@@ -33,18 +33,316 @@ typedef struct _MagickPixelOrder {
     int red, green, blue, opacity;
 } MagickPixelOrder;
 
+// Memory layout of one pixel. order places the channels a format has
+// within the pixel, gray formats ignore it.
+typedef enum {
+    RGBA32PixelFormat,      // 4 x 8 bit, placed by order
+    RGB24PixelFormat,       // 3 x 8 bit, order.red, green and blue below 3
+    Gray8PixelFormat,       // 8 bit gray
+    GrayAlpha16PixelFormat, // 8 bit gray then 8 bit alpha
+    RGBA64PixelFormat       // 4 x 16 bit in host byte order, placed by order
+} MagickPixelFormat;
+
 typedef struct _MagickImage {
-    MagickPixelPacket4 *pixels;  // image pixel ptr
+    MagickPixelPacket4 *pixels;  // first pixel, whatever the format
     MagickPixelOrder order;      // 4byte is rgba or brga
     uint64_t columns;            // image pixel width
     uint64_t rows;               // image pixel heigth
+    uint64_t stride;             // bytes per row, 0 is columns * pixel size
+    MagickPixelFormat format;    // 0 is RGBA32PixelFormat
 } MagickImage;
 
+// Bytes of one pixel of format.
+uint64_t GetPixelFormatSize(const MagickPixelFormat format);
+
+// Convert the pixels of image in place between straight and premultiplied
+// alpha, rounding to nearest. Formats without alpha are left unchanged,
+// colors brighter than their alpha unpremultiply to the maximum.
+int PremultiplyImage(const MagickImage *image);
+int UnpremultiplyImage(const MagickImage *image);
+
+// Describes the columns x rows rectangle at (x, y) of image without copying,
+// the view shares the pixels and stride of image.
+int GetImageView(const MagickImage *image,
+                 const uint64_t x,
+                 const uint64_t y,
+                 const uint64_t columns,
+                 const uint64_t rows,
+                 MagickImage *view);
+
+// Rectangle of source pixels, the bounds may fall between pixels.
+typedef struct _ResizeRegion {
+    double x, y;  // top left corner
+    double width, height;
+} ResizeRegion;
+
+// src and dst must have the same format, their orders may differ. Formats
+// without alpha skip the alpha weighting, 16 bit pixels are filtered as 16
+// bit and their rows must be 2 byte aligned.
 int ResizeImage(const MagickImage *src,
                 const MagickImage *dst,
                 const FilterTypes filter,
                 const double blur);
 
+// Worker threads shared by resize calls, threads <= 0 uses every cpu.
+typedef struct _MagickThreadPool MagickThreadPool;
+
+MagickThreadPool *CreateThreadPool(int threads);
+void DestroyThreadPool(MagickThreadPool *pool);
+int GetThreadPoolSize(const MagickThreadPool *pool);
+
+typedef enum {
+    DoubleResizeEngine,      // double weights and accumulators
+    FixedPointResizeEngine,  // 16 bit weights, int32 accumulators and a 16
+                             // bit intermediate, +-1 after both passes
+                             // (colors premultiplied by alpha), RGBA32
+                             // only and no linear light, the rest use double
+    FloatResizeEngine        // float weights and accumulators, +-1 after
+                             // both passes (colors premultiplied by alpha),
+                             // RGBA32 only, the rest use double
+} ResizeEngineType;
+
+// How the resize treats alpha. Straight alpha colors are weighted by alpha,
+// opaque RGBA32 sources are filtered with a plain weighted sum and written
+// with alpha 255 instead, byte-identical, on the double engine, and like
+// premultiplied pixels on the float and fixed point engines. Premultiplied
+// pixels have every sample, alpha included, filtered as a plain weighted sum
+// and stay premultiplied.
+typedef enum {
+    DetectResizeAlpha,        // straight, scan the source for opaque once
+    MatteResizeAlpha,         // straight, always weight by alpha, no scan
+    OpaqueResizeAlpha,        // the caller knows every source alpha is max
+    PremultipliedResizeAlpha  // src and dst colors are premultiplied
+} ResizeAlphaMode;
+
+// Nanoseconds per tap and per written pixel of each pass, a plan runs the
+// passes in the order with the lower estimate for its window sizes.
+typedef struct _ResizeCostModel {
+    double horizontal_tap, horizontal_pixel;
+    double vertical_tap, vertical_pixel;
+} ResizeCostModel;
+
+// Costs measured on RGBA32 straight alpha with the double engine.
+void GetResizeCostModel(ResizeCostModel *model);
+
+// Times both passes on small synthetic images, a few milliseconds, and
+// returns 0 or 2. Resizes of one geometry may pick another order with a
+// calibrated model, which changes the rounding of the result.
+int CalibrateResizeCostModel(ResizeCostModel *model);
+
+// What one resize did and how long each stage took, in nanoseconds of a
+// monotonic clock. Filled in by ResizeImageWithOptions, ResizeImageWithPlan,
+// ResizeImageWithContext and ResizeImageRegion when ResizeOptions.stats is
+// set, fields of stages that did not run are 0.
+typedef struct _ResizeStats {
+    FilterTypes filter;     // filter after UndefinedFilter mapping
+    bool horizontal_first;  // pass order, linear light is always horizontal
+    bool fast_path;         // a copy, sample or box average ran instead
+    int x_halvings, y_halvings;  // progressive 2x reductions per axis
+    int threads;                 // threads of the pool the passes ran on
+    double x_support, y_support;  // filter support in source pixels
+    int64_t x_taps, y_taps;       // largest window of each axis
+    uint64_t x_total_taps, y_total_taps;  // taps summed over every window
+    uint64_t intermediate_bytes;  // image between the two passes
+    uint64_t reduce_bytes;        // both images of the progressive halvings
+    uint64_t plan_ns;             // weight tables, 0 with a prebuilt plan
+    uint64_t setup_ns;  // temporary pool, opaque scan and intermediate
+    uint64_t reduce_ns;
+    uint64_t first_pass_ns;  // the fast path when one ran
+    uint64_t second_pass_ns;
+    uint64_t total_ns;  // whole call
+} ResizeStats;
+
+typedef struct _ResizeOptions {
+    int threads;             // threads for a temporary pool when pool is NULL
+    MagickThreadPool *pool;  // caller owned pool, calls on it are serialized
+    ResizeEngineType engine;
+    // interpolate the weights of the transcendental filters (Hanning to
+    // Gaussian, Lanczos, Bessel, Sinc) from tables sampled once, at most
+    // 1e-6 off the analytic filter, cheaper plans for large destinations
+    bool tabulate_filters;
+    ResizeAlphaMode alpha;  // ResizeImageStream cannot scan for opaque
+    // filter 8 bit sRGB colors in linear light: samples are decoded through
+    // a table once per source pixel into a 16 bit intermediate and encoded
+    // once per destination pixel, double engine only. RGBA64 is filtered as
+    // stored, PremultipliedResizeAlpha is invalid with it.
+    bool linear_light;
+    // progressive downscale: halve the source with exact 2x box averages
+    // while an axis stays at least progressive_factor times its target,
+    // then filter the rest of the way. Much cheaper for large reductions,
+    // not identical to a direct resize. 0 disables it, it does not apply
+    // to PointFilter, to the fast paths or to ResizeImageBatch, and
+    // ResizeImageStream rejects plans created with it.
+    double progressive_factor;
+    // filled in by every call when not NULL, the clock is only read then.
+    // Calls sharing options must not run at once with it set.
+    ResizeStats *stats;
+    const ResizeCostModel *cost_model;  // NULL uses GetResizeCostModel
+} ResizeOptions;
+
+void GetResizeOptions(ResizeOptions *options);
+
+int ResizeImageWithOptions(const MagickImage *src,
+                           const MagickImage *dst,
+                           const FilterTypes filter,
+                           const double blur,
+                           const ResizeOptions *options);
+
+// Crops region of src and resizes it to dst in one call: the filters only
+// read the source pixels the region overlaps and the intermediate image is
+// sized to the region. Integer bounds give the result of resizing
+// GetImageView of the region.
+int ResizeImageRegion(const MagickImage *src,
+                      const ResizeRegion *region,
+                      const MagickImage *dst,
+                      const FilterTypes filter,
+                      const double blur,
+                      const ResizeOptions *options);
+
+// Precomputed contribution weights for one (src, dst, filter, blur)
+// geometry, reusable across any number of images of that geometry.
+typedef struct _ResizePlan ResizePlan;
+
+ResizePlan *CreateResizePlan(const uint64_t src_columns,
+                             const uint64_t src_rows,
+                             const uint64_t columns,
+                             const uint64_t rows,
+                             const FilterTypes filter,
+                             const double blur);
+
+// Same as CreateResizePlan, with the tabulate_filters, progressive_factor
+// and cost_model choices of options.
+ResizePlan *CreateResizePlanWithOptions(const uint64_t src_columns,
+                                        const uint64_t src_rows,
+                                        const uint64_t columns,
+                                        const uint64_t rows,
+                                        const FilterTypes filter,
+                                        const double blur,
+                                        const ResizeOptions *options);
+
+int ResizeImageWithPlan(const ResizePlan *plan,
+                        const MagickImage *src,
+                        const MagickImage *dst,
+                        const ResizeOptions *options);
+
+void DestroyResizePlan(ResizePlan *plan);
+
+// Keeps the plan of the last geometry, a thread pool and grow-only scratch
+// memory between calls, so a batch of same sized resizes stops allocating
+// after the first one. A context must not be used by two threads at once.
+typedef struct _ResizeContext ResizeContext;
+
+ResizeContext *CreateResizeContext(void);
+
+int ResizeImageWithContext(ResizeContext *context,
+                           const MagickImage *src,
+                           const MagickImage *dst,
+                           const FilterTypes filter,
+                           const double blur,
+                           const ResizeOptions *options);
+
+void DestroyResizeContext(ResizeContext *context);
+
+typedef struct _ResizeTarget {
+    const MagickImage *image;  // destination
+    FilterTypes filter;
+    double blur;
+    int status;  // return code of this target, set by ResizeImageBatch
+} ResizeTarget;
+
+typedef enum {
+    DefaultResizeBatch = 0,
+    // resize small targets from a finished target at least twice their size
+    // instead of from src, faster but not identical to ResizeImage
+    DeriveResizeBatch = 1
+} ResizeBatchFlags;
+
+// Resizes src to every target. Targets whose first pass matches share one
+// intermediate and all passes are scheduled together across the threads.
+// Returns the first non zero target status.
+int ResizeImageBatch(const MagickImage *src,
+                     ResizeTarget *targets,
+                     const uint64_t count,
+                     const ResizeBatchFlags flags,
+                     const ResizeOptions *options);
+
+// Fills source row y, rows are requested once each from top to bottom.
+typedef int (*ResizeReadRowHandler)(void *data,
+                                    const uint64_t y,
+                                    MagickPixelPacket4 *row);
+// Receives destination row y, rows are emitted from top to bottom.
+typedef int (*ResizeWriteRowHandler)(void *data,
+                                     const uint64_t y,
+                                     const MagickPixelPacket4 *row);
+
+// Resizes without materializing the source, destination or intermediate
+// image, only a ring of rows as tall as the vertical filter support is kept.
+// Rows are RGBA32.
+// A handler returning non zero aborts the resize with 8.
+int ResizeImageStream(const ResizePlan *plan,
+                      const MagickPixelOrder src_order,
+                      ResizeReadRowHandler read_row,
+                      void *read_data,
+                      const MagickPixelOrder dst_order,
+                      ResizeWriteRowHandler write_row,
+                      void *write_data,
+                      const ResizeOptions *options);
+
+// Resizes run asynchronously by a fixed set of worker threads. Each worker
+// keeps its own ResizeContext and list of jobs: a job goes to the least
+// loaded worker, on a tie to one whose context holds its plan, and an idle
+// worker steals the newest job of the most loaded one.
+typedef struct _ResizeQueue ResizeQueue;
+typedef struct _ResizeJob ResizeJob;
+
+// Runs on the thread that finished or cancelled the job, before waiters
+// are woken. status is the ResizeImageWithOptions return code, or 16 when
+// the job was cancelled.
+typedef void (*ResizeJobCallback)(void *data, const int status);
+
+typedef enum {
+    DefaultResizeSubmit = 0,  // wait while the queue holds depth jobs
+    NoWaitResizeSubmit = 1    // return 32 instead of waiting
+} ResizeSubmitFlags;
+
+// workers <= 0 uses every cpu, depth bounds the jobs not yet started. Each
+// job runs on one worker with options, whose threads, pool and stats are
+// ignored.
+ResizeQueue *CreateResizeQueue(const int workers,
+                               const uint64_t depth,
+                               const ResizeOptions *options);
+
+// Queues the resize of src to dst, their pixels must stay valid until the
+// job is done. job receives a handle to release with ReleaseResizeJob, a
+// NULL job releases it once done. Returns 0, 1 for invalid images, 2 when
+// out of memory, 32 when the queue is full and flags has NoWaitResizeSubmit.
+int SubmitResizeJob(ResizeQueue *queue,
+                    const MagickImage *src,
+                    const MagickImage *dst,
+                    const FilterTypes filter,
+                    const double blur,
+                    ResizeJobCallback callback,
+                    void *data,
+                    const ResizeSubmitFlags flags,
+                    ResizeJob **job);
+
+// Status of job, -1 until it is done.
+int GetResizeJobStatus(const ResizeJob *job);
+
+// Blocks until job is done and returns its status.
+int WaitResizeJob(const ResizeJob *job);
+
+// Removes job from the queue unless it already started, its callback then
+// gets 16. Returns true when the job was cancelled.
+bool CancelResizeJob(ResizeJob *job);
+
+void ReleaseResizeJob(ResizeJob *job);
+
+// Cancels the jobs not yet started and waits for the running ones. Handles
+// not released yet stay valid, their jobs are done, and have to be released
+// with ReleaseResizeJob.
+void DestroyResizeQueue(ResizeQueue *queue);
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }
 #endif /* defined(__cplusplus) || defined(c_plusplus) */
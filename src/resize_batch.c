@@ -0,0 +1,264 @@
+#include <stdlib.h>
+
+#include "resize_private.h"
+
+typedef struct _BatchItem {
+    ResizeTarget *target;
+    int64_t source;  // item the target is derived from, -1 for src
+    const MagickImage *source_image;
+    ResizePlan *plan;
+    bool order;  // horizontal pass first, always in linear light
+    ResizeFastPath fast_path;
+    uint64_t level;  // items of a level only depend on earlier levels
+    uint64_t owner;  // item holding the intermediate used by this one
+    MagickImage intermediate;
+} BatchItem;
+
+static uint64_t GetTargetArea(const ResizeTarget *target) {
+    return target->image->columns * target->image->rows;
+}
+
+/*
+    Both plans start from the same image with the same first pass table, so
+    their intermediates are identical.
+*/
+static bool ShareIntermediate(const BatchItem *a, const BatchItem *b) {
+    const ResizePlan *p = a->plan, *q = b->plan;
+    if (a->source_image != b->source_image || a->order != b->order ||
+        p->filter != q->filter || p->blur != q->blur) {
+        return false;
+    }
+    return a->order ? p->columns == q->columns : p->rows == q->rows;
+}
+
+static int ValidateTarget(const ResizeTarget *target,
+                          const MagickImage *src) {
+    const MagickImage *dst = target->image;
+    if (dst->columns == 0 || dst->rows == 0) {
+        return 1;
+    }
+    if (!IsValidImageLayout(dst) || dst->format != src->format) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+    Filters every level in two stages: the first passes of all targets, with
+    one pass per distinct intermediate, then the second passes. Each stage is
+    a single parallel-for over the bands of its passes, so small targets do
+    not leave threads idle.
+*/
+static void RunBatchLevel(BatchItem *items,
+                          const uint64_t count,
+                          const uint64_t level,
+                          FilterPass *passes,
+                          const ResizeEngineType engine,
+                          const ResizeAlphaMode alpha,
+                          const bool linear,
+                          MagickThreadPool *pool,
+                          MagickArena *scratch) {
+    uint64_t i, j, n = 0;
+
+    ResetArena(scratch);
+    for (i = 0; i < count; i++) {
+        BatchItem *item = &items[i];
+        const ResizePlan *plan = item->plan;
+        if (item->level != level || item->target->status != 0) continue;
+        const MagickPixelFormat format =
+            linear || engine == FixedPointResizeEngine
+                ? RGBA64PixelFormat
+                : item->source_image->format;
+        const MagickPixelOrder order =
+            linear ? OpacityLastOrder : item->source_image->order;
+        if (item->source >= 0 && items[item->source].target->status != 0) {
+            item->target->status = 4;
+            continue;
+        }
+        if (item->fast_path != NoResizeFastPath) continue;
+        item->owner = i;
+        for (j = 0; j < i; j++) {
+            if (items[j].level == level && items[j].target->status == 0 &&
+                items[j].fast_path == NoResizeFastPath &&
+                items[j].owner == j && ShareIntermediate(&items[j], item)) {
+                item->owner = j;
+                break;
+            }
+        }
+        if (item->owner != i) continue;
+        if (!(item->order ? AllocateImage(&item->intermediate,
+                                          plan->columns,
+                                          plan->src_rows,
+                                          format,
+                                          order,
+                                          scratch)
+                          : AllocateImage(&item->intermediate,
+                                          plan->src_columns,
+                                          plan->rows,
+                                          format,
+                                          order,
+                                          scratch)) ||
+            PrepareFilterPass(&passes[n],
+                              item->source_image,
+                              &item->intermediate,
+                              item->order ? &plan->horizontal : &plan->vertical,
+                              item->order,
+                              engine,
+                              alpha,
+                              pool,
+                              scratch) == MagickFail) {
+            item->target->status = 2;
+            continue;
+        }
+        n++;
+    }
+    RunFilterPasses(passes, n, pool);
+
+    n = 0;
+    for (i = 0; i < count; i++) {
+        BatchItem *item = &items[i];
+        const ResizePlan *plan = item->plan;
+        if (item->level != level || item->target->status != 0) continue;
+        if (item->fast_path != NoResizeFastPath) {
+            RunResizeFastPath(item->fast_path,
+                              item->source_image,
+                              item->target->image,
+                              alpha == PremultipliedResizeAlpha,
+                              pool);
+            continue;
+        }
+        if (PrepareFilterPass(&passes[n],
+                              &items[item->owner].intermediate,
+                              item->target->image,
+                              item->order ? &plan->vertical : &plan->horizontal,
+                              !item->order,
+                              engine,
+                              alpha,
+                              pool,
+                              scratch) == MagickFail) {
+            item->target->status = 2;
+            continue;
+        }
+        n++;
+    }
+    RunFilterPasses(passes, n, pool);
+}
+
+int ResizeImageBatch(const MagickImage *src,
+                     ResizeTarget *targets,
+                     const uint64_t count,
+                     const ResizeBatchFlags flags,
+                     const ResizeOptions *options) {
+    ResizeOptions defaults, plan_options;
+    MagickThreadPool *pool = NULL;
+    MagickArena scratch;
+    BatchItem *items = NULL;
+    FilterPass *passes = NULL;
+    uint64_t i, j, n = 0, levels = 0;
+    ResizeAlphaMode alpha;
+    bool linear;
+    int ret = 0;
+
+    if (options == NULL) {
+        GetResizeOptions(&defaults);
+        options = &defaults;
+    }
+    if (src->columns == 0 || src->rows == 0 || !IsValidImageLayout(src) ||
+        (options->linear_light && options->alpha == PremultipliedResizeAlpha)) {
+        for (i = 0; i < count; i++) targets[i].status = 1;
+        return count == 0 ? 0 : 1;
+    }
+    InitializeArena(&scratch);
+    linear = IsLinearResize(src, options);
+    // the passes run straight from the source or a larger target
+    plan_options = *options;
+    plan_options.progressive_factor = 0.0;
+    items = (BatchItem *)malloc(Max(count, 1) * sizeof(BatchItem));
+    passes = (FilterPass *)malloc(Max(count, 1) * sizeof(FilterPass));
+    pool = options->pool;
+    if (pool == NULL && options->threads > 1) {
+        pool = CreateThreadPool(options->threads);
+    }
+    if (items == NULL || passes == NULL ||
+        (pool == NULL && options->threads > 1)) {
+        for (i = 0; i < count; i++) targets[i].status = 2;
+        goto done;
+    }
+
+    /*
+        Largest targets first, so a derived target always comes after the
+        target it is derived from.
+    */
+    for (i = 0; i < count; i++) {
+        targets[i].status = ValidateTarget(&targets[i], src);
+        if (targets[i].status != 0) continue;
+        for (j = n; j > 0 && GetTargetArea(items[j - 1].target) <
+                                 GetTargetArea(&targets[i]);
+             j--) {
+            items[j] = items[j - 1];
+        }
+        items[j].target = &targets[i];
+        n++;
+    }
+    for (i = 0; i < n; i++) {
+        BatchItem *item = &items[i];
+        const MagickImage *dst = item->target->image;
+        item->source = -1;
+        item->source_image = src;
+        item->level = 0;
+        item->plan = NULL;
+        if (flags & DeriveResizeBatch) {
+            // smallest downscaled target at least twice as large on both axes
+            for (j = i; j > 0; j--) {
+                const MagickImage *image = items[j - 1].target->image;
+                if (image->columns <= src->columns &&
+                    image->rows <= src->rows &&
+                    GetTargetArea(items[j - 1].target) <
+                        src->columns * src->rows &&
+                    image->columns >= dst->columns * 2 &&
+                    image->rows >= dst->rows * 2) {
+                    item->source = (int64_t)(j - 1);
+                    item->source_image = image;
+                    item->level = items[j - 1].level + 1;
+                    break;
+                }
+            }
+        }
+        levels = Max(levels, item->level + 1);
+        item->plan = CreateResizePlanWithOptions(item->source_image->columns,
+                                                 item->source_image->rows,
+                                                 dst->columns,
+                                                 dst->rows,
+                                                 item->target->filter,
+                                                 item->target->blur,
+                                                 &plan_options);
+        if (item->plan == NULL) {
+            item->target->status = 2;
+            continue;
+        }
+        item->order = item->plan->order || linear;
+        item->fast_path = GetPlanFastPath(item->plan, linear);
+    }
+    // derived targets are opaque whenever src is
+    alpha = GetResizeAlphaMode(src, options);
+    for (i = 0; i < levels; i++) {
+        RunBatchLevel(items,
+                      n,
+                      i,
+                      passes,
+                      GetResizeEngine(src, options),
+                      alpha,
+                      linear,
+                      pool,
+                      &scratch);
+    }
+    for (i = 0; i < n; i++) DestroyResizePlan(items[i].plan);
+
+done:
+    for (i = 0; i < count && ret == 0; i++) ret = targets[i].status;
+    if (pool != options->pool) DestroyThreadPool(pool);
+    DestroyArena(&scratch);
+    free(passes);
+    free(items);
+    return ret;
+}
@@ -0,0 +1,593 @@
+#include <string.h>
+
+#include "resize_private.h"
+#include "thread.h"
+
+/*
+    Geometries the filters reduce to something simpler than a weighted sum:
+    PointFilter always and BoxFilter on upscales have one tap per pixel, and
+    BoxFilter on an integer downscale weights k source pixels equally.
+*/
+ResizeFastPath GetResizeFastPath(const uint64_t src_columns,
+                                 const uint64_t src_rows,
+                                 const uint64_t columns,
+                                 const uint64_t rows,
+                                 const FilterTypes filter,
+                                 const double blur) {
+    bool integer_up = columns % src_columns == 0 && rows % src_rows == 0;
+    bool integer_down = src_columns % columns == 0 && src_rows % rows == 0;
+    bool mixed = (columns % src_columns == 0 && src_rows % rows == 0) ||
+                 (src_columns % columns == 0 && rows % src_rows == 0);
+
+    if (columns == src_columns && rows == src_rows && blur == 1.0) {
+        return CopyResizeFastPath;
+    }
+    if (filter == PointFilter && (integer_up || integer_down || mixed)) {
+        return SampleResizeFastPath;
+    }
+    if (filter == BoxFilter && integer_up && blur <= 1.0) {
+        return SampleResizeFastPath;
+    }
+    if (filter == BoxFilter && integer_down && blur == 1.0 &&
+        (src_columns / columns) * (src_rows / rows) <= MaxBoxAverageArea) {
+        return BoxAverageResizeFastPath;
+    }
+    return NoResizeFastPath;
+}
+
+/*
+    Source pixel of destination x along an axis with one tap per pixel: an
+    upscale by k replicates x / k, a downscale by k picks the pixel the Box
+    window of the generic path puts its only non zero weight on.
+*/
+static inline uint64_t GetSampleIndex(const uint64_t x,
+                                      const uint64_t source_length,
+                                      const uint64_t length) {
+    if (length >= source_length) {
+        return x / (length / source_length);
+    }
+    uint64_t k = source_length / length;
+    return x * k + (k - 1) / 2;
+}
+
+typedef struct _FastPathPass {
+    const MagickImage *source;
+    const MagickImage *destination;
+    const PixelFormatInfo *info;  // premultiplied alpha counts as a color
+    bool premultiplied;
+    uint64_t size;  // bytes per pixel
+    int source_channels[4];
+    int destination_channels[4];
+    uint64_t band_rows;
+    MagickPixelPacket4 *linear_rows;  // two RGBA64 rows per band, HalveImage
+} FastPathPass;
+
+MAGICK_FORCE_INLINE uint32_t GetQuantum(const MagickQuantum *restrict p,
+                                        const int k,
+                                        const bool wide) {
+    return wide ? ((const uint16_t *)p)[k] : p[k];
+}
+
+MAGICK_FORCE_INLINE void SetQuantum(MagickQuantum *restrict q,
+                                    const int k,
+                                    const uint32_t value,
+                                    const bool wide) {
+    if (wide) {
+        ((uint16_t *)q)[k] = (uint16_t)value;
+    } else {
+        q[k] = (MagickQuantum)value;
+    }
+}
+
+static void CopyBand(void *arg, const uint64_t band) {
+    const FastPathPass *pass = (const FastPathPass *)arg;
+    const MagickImage *source = pass->source;
+    const MagickImage *destination = pass->destination;
+    const MagickPixelOrder so = source->order, dst = destination->order;
+    const int *sc = pass->source_channels, *dc = pass->destination_channels;
+    const int samples = pass->info->colors + pass->info->matte;
+    const bool wide = pass->info->depth == 2;
+    const bool same = memcmp(&so, &dst, sizeof(MagickPixelOrder)) == 0 ||
+                      pass->info->colors == 1;
+    uint64_t y = band * pass->band_rows;
+    uint64_t stop = Min(y + pass->band_rows, destination->rows);
+
+    for (; y < stop; y++) {
+        const MagickQuantum *restrict p =
+            (const MagickQuantum *)GetImageRow(source, y);
+        MagickQuantum *restrict q =
+            (MagickQuantum *)GetImageRow(destination, y);
+        if (same) {
+            memcpy(q, p, destination->columns * pass->size);
+            continue;
+        }
+        for (uint64_t x = 0; x < destination->columns; x++) {
+            for (int k = 0; k < samples; k++) {
+                SetQuantum(q, dc[k], GetQuantum(p, sc[k], wide), wide);
+            }
+            p += pass->size;
+            q += pass->size;
+        }
+    }
+}
+
+/*
+    A single tap of weight 1 returns the pixel itself, except that the
+    color of a fully transparent pixel normalizes to 0.
+*/
+MAGICK_FORCE_INLINE void SamplePixel(MagickQuantum *restrict q,
+                                     const MagickQuantum *restrict p,
+                                     const int *restrict sc,
+                                     const int *restrict dc,
+                                     const int colors,
+                                     const bool matte,
+                                     const bool wide) {
+    bool transparent = false;
+    if (matte) {
+        uint32_t alpha = GetQuantum(p, sc[colors], wide);
+        SetQuantum(q, dc[colors], alpha, wide);
+        transparent = alpha == 0;
+    }
+    for (int k = 0; k < colors; k++) {
+        SetQuantum(
+            q, dc[k], transparent ? 0 : GetQuantum(p, sc[k], wide), wide);
+    }
+}
+
+/*
+    Samples one row, packet4 inlines the RGBA32 pixel size and channels
+    whose alpha is premultiplied or not.
+*/
+MAGICK_FORCE_INLINE void SampleRow(const FastPathPass *pass,
+                                   const MagickQuantum *restrict p,
+                                   MagickQuantum *restrict q,
+                                   const bool packet4,
+                                   const bool premultiplied) {
+    const uint64_t size = packet4 ? sizeof(MagickPixelPacket4) : pass->size;
+    const uint64_t columns = pass->destination->columns;
+    const uint64_t source_columns = pass->source->columns;
+    const int colors = packet4 ? (premultiplied ? 4 : 3) : pass->info->colors;
+    const bool matte = packet4 ? !premultiplied : pass->info->matte;
+    const bool wide = !packet4 && pass->info->depth == 2;
+    int sc[4], dc[4];  // locals, the byte stores cannot alias them
+    memcpy(sc, pass->source_channels, sizeof(sc));
+    memcpy(dc, pass->destination_channels, sizeof(dc));
+    if (columns >= source_columns) {
+        uint64_t k = columns / source_columns;
+        for (uint64_t x = 0; x < source_columns; x++) {
+            SamplePixel(
+                q + x * k * size, p + x * size, sc, dc, colors, matte, wide);
+            for (uint64_t i = 1; i < k; i++) {
+                memcpy(q + (x * k + i) * size, q + x * k * size, size);
+            }
+        }
+    } else {
+        uint64_t k = source_columns / columns;
+        const MagickQuantum *restrict s = p + (k - 1) / 2 * size;
+        for (uint64_t x = 0; x < columns; x++) {
+            SamplePixel(
+                q + x * size, s + x * k * size, sc, dc, colors, matte, wide);
+        }
+    }
+}
+
+static void SampleBand(void *arg, const uint64_t band) {
+    const FastPathPass *pass = (const FastPathPass *)arg;
+    const MagickImage *source = pass->source;
+    const MagickImage *destination = pass->destination;
+    uint64_t y = band * pass->band_rows;
+    uint64_t stop = Min(y + pass->band_rows, destination->rows);
+
+    for (; y < stop; y++) {
+        const MagickQuantum *restrict p = (const MagickQuantum *)GetImageRow(
+            source, GetSampleIndex(y, source->rows, destination->rows));
+        MagickQuantum *restrict q =
+            (MagickQuantum *)GetImageRow(destination, y);
+        if (source->format != RGBA32PixelFormat) {
+            SampleRow(pass, p, q, false, false);
+        } else if (pass->premultiplied) {
+            SampleRow(pass, p, q, true, true);
+        } else {
+            SampleRow(pass, p, q, true, false);
+        }
+    }
+}
+
+/*
+    Averages every kx * ky block of one destination row in one pass with the
+    matte weighting of the filters, rounding once instead of once per pass.
+    Inlined with constant kx and ky for the common halving, premultiplied
+    pixels weigh 1 like the filters do.
+*/
+MAGICK_FORCE_INLINE void BoxAverageRow(const MagickImage *restrict source,
+                                       const uint64_t y,
+                                       const uint64_t kx,
+                                       const uint64_t ky,
+                                       MagickPixelPacket4 *restrict q,
+                                       const uint64_t columns,
+                                       const MagickPixelOrder dst,
+                                       const bool premultiplied) {
+    const MagickPixelOrder so = source->order;
+    const uint32_t area = (uint32_t)(kx * ky);
+    const uint64_t stride = GetImageStride(source);
+    const MagickQuantum *restrict row =
+        (const MagickQuantum *)GetImageRow(source, y * ky);
+    for (uint64_t x = 0; x < columns; x++) {
+        uint32_t red = 0, green = 0, blue = 0, alpha = 0;
+        for (uint64_t j = 0; j < ky; j++) {
+            const MagickPixelPacket4 *restrict p =
+                (const MagickPixelPacket4 *)(row + j * stride) + x * kx;
+            for (uint64_t i = 0; i < kx; i++) {
+                uint32_t a = GET_PIXEL_PACKET(p[i], so.opacity);
+                uint32_t w = premultiplied ? 1 : a;
+                red += w * GET_PIXEL_PACKET(p[i], so.red);
+                green += w * GET_PIXEL_PACKET(p[i], so.green);
+                blue += w * GET_PIXEL_PACKET(p[i], so.blue);
+                alpha += a;
+            }
+        }
+        if (premultiplied) {
+            SET_PIXEL_PACKET(q[x], dst.red, (2 * red + area) / (2 * area));
+            SET_PIXEL_PACKET(q[x], dst.green, (2 * green + area) / (2 * area));
+            SET_PIXEL_PACKET(q[x], dst.blue, (2 * blue + area) / (2 * area));
+            SET_PIXEL_PACKET(
+                q[x], dst.opacity, (2 * alpha + area) / (2 * area));
+            continue;
+        }
+        if (alpha == 0) {
+            // the filters normalize a fully transparent color to 0 as well
+            memset(q[x], 0, sizeof(MagickPixelPacket4));
+            continue;
+        }
+        SET_PIXEL_PACKET(q[x], dst.red, (2 * red + alpha) / (2 * alpha));
+        SET_PIXEL_PACKET(q[x], dst.green, (2 * green + alpha) / (2 * alpha));
+        SET_PIXEL_PACKET(q[x], dst.blue, (2 * blue + alpha) / (2 * alpha));
+        SET_PIXEL_PACKET(q[x], dst.opacity, (2 * alpha + area) / (2 * area));
+    }
+}
+
+/*
+    BoxAverageRow for the other formats and premultiplied pixels, 64 bit
+    sums hold 16 bit samples. Without alpha every pixel weighs 1.
+*/
+MAGICK_FORCE_INLINE void BoxAverageFormatRow(const FastPathPass *pass,
+                                             const uint64_t y,
+                                             const uint64_t kx,
+                                             const uint64_t ky,
+                                             MagickQuantum *restrict q,
+                                             const int samples,
+                                             const int colors,
+                                             const bool matte,
+                                             const bool wide) {
+    const int *sc = pass->source_channels, *dc = pass->destination_channels;
+    const uint64_t size = (uint64_t)samples * (wide ? 2 : 1);
+    const uint64_t area = kx * ky;
+    const uint64_t stride = GetImageStride(pass->source);
+    const MagickQuantum *restrict row =
+        (const MagickQuantum *)GetImageRow(pass->source, y * ky);
+    for (uint64_t x = 0; x < pass->destination->columns; x++) {
+        uint64_t sums[4] = {0, 0, 0, 0}, alpha = 0;
+        for (uint64_t j = 0; j < ky; j++) {
+            const MagickQuantum *restrict p =
+                row + j * stride + x * kx * size;
+            for (uint64_t i = 0; i < kx; i++, p += size) {
+                uint64_t a = matte ? GetQuantum(p, sc[colors], wide) : 1;
+                for (int k = 0; k < colors; k++) {
+                    sums[k] += a * GetQuantum(p, sc[k], wide);
+                }
+                alpha += a;
+            }
+        }
+        if (alpha == 0) {
+            memset(q + x * size, 0, size);
+            continue;
+        }
+        for (int k = 0; k < colors; k++) {
+            SetQuantum(q + x * size,
+                       dc[k],
+                       (uint32_t)((2 * sums[k] + alpha) / (2 * alpha)),
+                       wide);
+        }
+        if (matte) {
+            SetQuantum(q + x * size,
+                       dc[colors],
+                       (uint32_t)((2 * alpha + area) / (2 * area)),
+                       wide);
+        }
+    }
+}
+
+static void BoxAverageBand(void *arg, const uint64_t band) {
+    const FastPathPass *pass = (const FastPathPass *)arg;
+    const MagickImage *source = pass->source;
+    const MagickImage *destination = pass->destination;
+    const MagickPixelOrder dst = destination->order;
+    const uint64_t columns = destination->columns;
+    const uint64_t kx = source->columns / columns;
+    const uint64_t ky = source->rows / destination->rows;
+    uint64_t y = band * pass->band_rows;
+    uint64_t stop = Min(y + pass->band_rows, destination->rows);
+
+    for (; y < stop; y++) {
+        MagickPixelPacket4 *q = GetImageRow(destination, y);
+        switch (source->format) {
+            case RGB24PixelFormat:
+                BoxAverageFormatRow(
+                    pass, y, kx, ky, (MagickQuantum *)q, 3, 3, false, false);
+                continue;
+            case Gray8PixelFormat:
+                BoxAverageFormatRow(
+                    pass, y, kx, ky, (MagickQuantum *)q, 1, 1, false, false);
+                continue;
+            case GrayAlpha16PixelFormat:
+                if (pass->premultiplied) {
+                    BoxAverageFormatRow(pass,
+                                        y,
+                                        kx,
+                                        ky,
+                                        (MagickQuantum *)q,
+                                        2,
+                                        2,
+                                        false,
+                                        false);
+                } else {
+                    BoxAverageFormatRow(
+                        pass, y, kx, ky, (MagickQuantum *)q, 2, 1, true, false);
+                }
+                continue;
+            case RGBA64PixelFormat:
+                if (pass->premultiplied) {
+                    BoxAverageFormatRow(
+                        pass, y, kx, ky, (MagickQuantum *)q, 4, 4, false, true);
+                } else {
+                    BoxAverageFormatRow(
+                        pass, y, kx, ky, (MagickQuantum *)q, 4, 3, true, true);
+                }
+                continue;
+            default:
+                break;
+        }
+        if (pass->premultiplied) {
+            BoxAverageRow(source, y, kx, ky, q, columns, dst, true);
+        } else if (kx == 2 && ky == 2) {
+            BoxAverageRow(source, y, 2, 2, q, columns, dst, false);
+        } else {
+            BoxAverageRow(source, y, kx, ky, q, columns, dst, false);
+        }
+    }
+}
+
+void RunResizeFastPath(const ResizeFastPath fast_path,
+                       const MagickImage *source,
+                       const MagickImage *destination,
+                       const bool premultiplied,
+                       MagickThreadPool *pool) {
+    FastPathPass pass;
+    PixelFormatInfo info = MagickPixelFormats[source->format];
+    MagickTaskFunction band_function = CopyBand;
+    uint64_t bands = (uint64_t)GetThreadPoolSize(pool) * 4;
+    bands = Min(bands, destination->rows);
+    pass.source = source;
+    pass.destination = destination;
+    pass.premultiplied = premultiplied && info.matte;
+    if (pass.premultiplied) {
+        info.colors++;
+        info.matte = false;
+    }
+    pass.info = &info;
+    pass.size = GetPixelSize(source->format);
+    GetPixelChannels(source->format, source->order, pass.source_channels);
+    GetPixelChannels(
+        destination->format, destination->order, pass.destination_channels);
+    pass.band_rows = (destination->rows + bands - 1) / bands;
+    bands = (destination->rows + pass.band_rows - 1) / pass.band_rows;
+    if (fast_path == SampleResizeFastPath) {
+        band_function = SampleBand;
+    } else if (fast_path == BoxAverageResizeFastPath) {
+        band_function = BoxAverageBand;
+    }
+    ThreadPoolRun(pool, band_function, &pass, bands);
+}
+
+/*
+    Averages the pixels a, b, c and d into q like BoxAverageFormatRow.
+*/
+MAGICK_FORCE_INLINE void HalvePixel(MagickQuantum *restrict q,
+                                    const MagickQuantum *restrict a,
+                                    const MagickQuantum *restrict b,
+                                    const MagickQuantum *restrict c,
+                                    const MagickQuantum *restrict d,
+                                    const int *restrict sc,
+                                    const int *restrict dc,
+                                    const int colors,
+                                    const bool matte,
+                                    const bool wide) {
+    const MagickQuantum *block[4] = {a, b, c, d};
+    uint64_t sums[4] = {0, 0, 0, 0}, alpha = 0;
+    for (int i = 0; i < 4; i++) {
+        uint64_t w = matte ? GetQuantum(block[i], sc[colors], wide) : 1;
+        for (int k = 0; k < colors; k++) {
+            sums[k] += w * GetQuantum(block[i], sc[k], wide);
+        }
+        alpha += w;
+    }
+    if (alpha == 0) {
+        for (int k = 0; k <= colors; k++) SetQuantum(q, dc[k], 0, wide);
+        return;
+    }
+    for (int k = 0; k < colors; k++) {
+        SetQuantum(q,
+                   dc[k],
+                   (uint32_t)((2 * sums[k] + alpha) / (2 * alpha)),
+                   wide);
+    }
+    if (matte) {
+        SetQuantum(q, dc[colors], (uint32_t)((alpha + 2) / 4), wide);
+    }
+}
+
+/*
+    Halves rows p0 and p1 into q, the last column stands in for the missing
+    one of an odd width and for the second one when the columns are not
+    halved.
+*/
+MAGICK_FORCE_INLINE void HalveRow(const FastPathPass *pass,
+                                  const MagickQuantum *restrict p0,
+                                  const MagickQuantum *restrict p1,
+                                  MagickQuantum *restrict q,
+                                  const int samples,
+                                  const int colors,
+                                  const bool matte,
+                                  const bool wide) {
+    const uint64_t size = (uint64_t)samples * (wide ? 2 : 1);
+    const uint64_t source_columns = pass->source->columns;
+    const uint64_t columns = pass->destination->columns;
+    const uint64_t kx = columns == source_columns ? 1 : 2;
+    const uint64_t pairs = kx == 2 ? source_columns / 2 : 0;
+    int sc[4], dc[4];  // locals, the byte stores cannot alias them
+    memcpy(sc, pass->source_channels, sizeof(sc));
+    memcpy(dc, pass->destination_channels, sizeof(dc));
+    if (!matte) {
+        // plain sums weigh every sample alike, whatever its channel, the
+        // orders of both sides are the same
+        for (uint64_t x = 0; x < pairs; x++) {
+            const MagickQuantum *restrict a = p0 + 2 * x * size;
+            const MagickQuantum *restrict c = p1 + 2 * x * size;
+            for (int k = 0; k < samples; k++) {
+                uint32_t sum = GetQuantum(a, k, wide) +
+                               GetQuantum(a, k + samples, wide) +
+                               GetQuantum(c, k, wide) +
+                               GetQuantum(c, k + samples, wide);
+                SetQuantum(q + x * size, k, (sum + 2) / 4, wide);
+            }
+        }
+    }
+    for (uint64_t x = matte ? 0 : pairs; x < pairs; x++) {
+        const MagickQuantum *restrict a = p0 + 2 * x * size;
+        const MagickQuantum *restrict c = p1 + 2 * x * size;
+        HalvePixel(q + x * size,
+                   a,
+                   a + size,
+                   c,
+                   c + size,
+                   sc,
+                   dc,
+                   colors,
+                   matte,
+                   wide);
+    }
+    for (uint64_t x = pairs; x < columns; x++) {
+        const uint64_t x0 = x * kx, x1 = Min(x0 + kx - 1, source_columns - 1);
+        HalvePixel(q + x * size,
+                   p0 + x0 * size,
+                   p0 + x1 * size,
+                   p1 + x0 * size,
+                   p1 + x1 * size,
+                   sc,
+                   dc,
+                   colors,
+                   matte,
+                   wide);
+    }
+}
+
+static void HalveBand(void *arg, const uint64_t band) {
+    const FastPathPass *pass = (const FastPathPass *)arg;
+    const MagickImage *source = pass->source;
+    const MagickImage *destination = pass->destination;
+    const bool premultiplied = pass->premultiplied;
+    const uint64_t ky = destination->rows == source->rows ? 1 : 2;
+    const uint64_t row_size = source->columns * GetPixelSize(RGBA64PixelFormat);
+    uint64_t y = band * pass->band_rows;
+    uint64_t stop = Min(y + pass->band_rows, destination->rows);
+
+    for (; y < stop; y++) {
+        const uint64_t y0 = y * ky, y1 = Min(y0 + ky - 1, source->rows - 1);
+        const MagickQuantum *p0 =
+            (const MagickQuantum *)GetImageRow(source, y0);
+        const MagickQuantum *p1 =
+            (const MagickQuantum *)GetImageRow(source, y1);
+        MagickQuantum *q = (MagickQuantum *)GetImageRow(destination, y);
+        if (pass->linear_rows != NULL) {
+            MagickQuantum *rows =
+                (MagickQuantum *)pass->linear_rows + band * 2 * row_size;
+            DecodeLinearRow(source->format,
+                            source->order,
+                            (const MagickPixelPacket4 *)p0,
+                            source->columns,
+                            (MagickPixelPacket4 *)rows);
+            if (y1 != y0) {
+                DecodeLinearRow(source->format,
+                                source->order,
+                                (const MagickPixelPacket4 *)p1,
+                                source->columns,
+                                (MagickPixelPacket4 *)(rows + row_size));
+            }
+            p0 = rows;
+            p1 = y1 != y0 ? rows + row_size : rows;
+        }
+        switch (destination->format) {
+            case RGBA32PixelFormat:
+                if (premultiplied) {
+                    HalveRow(pass, p0, p1, q, 4, 4, false, false);
+                } else {
+                    HalveRow(pass, p0, p1, q, 4, 3, true, false);
+                }
+                break;
+            case RGB24PixelFormat:
+                HalveRow(pass, p0, p1, q, 3, 3, false, false);
+                break;
+            case Gray8PixelFormat:
+                HalveRow(pass, p0, p1, q, 1, 1, false, false);
+                break;
+            case GrayAlpha16PixelFormat:
+                if (premultiplied) {
+                    HalveRow(pass, p0, p1, q, 2, 2, false, false);
+                } else {
+                    HalveRow(pass, p0, p1, q, 2, 1, true, false);
+                }
+                break;
+            case RGBA64PixelFormat:
+                if (premultiplied) {
+                    HalveRow(pass, p0, p1, q, 4, 4, false, true);
+                } else {
+                    HalveRow(pass, p0, p1, q, 4, 3, true, true);
+                }
+                break;
+        }
+    }
+}
+
+MagickPassFail HalveImage(const MagickImage *source,
+                          const MagickImage *destination,
+                          const bool premultiplied,
+                          MagickThreadPool *pool,
+                          MagickArena *scratch) {
+    FastPathPass pass;
+    const bool linear = source->format != destination->format;
+    uint64_t bands = (uint64_t)GetThreadPoolSize(pool) * 4;
+    bands = Min(bands, destination->rows);
+    pass.source = source;
+    pass.destination = destination;
+    pass.info = &MagickPixelFormats[destination->format];
+    pass.premultiplied = premultiplied && pass.info->matte;
+    pass.size = GetPixelSize(destination->format);
+    // decoded rows are laid out like destination
+    GetPixelChannels(linear ? destination->format : source->format,
+                     linear ? destination->order : source->order,
+                     pass.source_channels);
+    GetPixelChannels(
+        destination->format, destination->order, pass.destination_channels);
+    pass.band_rows = (destination->rows + bands - 1) / bands;
+    bands = (destination->rows + pass.band_rows - 1) / pass.band_rows;
+    pass.linear_rows = NULL;
+    if (linear) {
+        InitializeLinearLight();
+        pass.linear_rows = (MagickPixelPacket4 *)ArenaAllocate(
+            scratch,
+            bands * 2 * source->columns * GetPixelSize(RGBA64PixelFormat));
+        if (pass.linear_rows == NULL) return MagickFail;
+    }
+    ThreadPoolRun(pool, HalveBand, &pass, bands);
+    return MagickPass;
+}
@@ -0,0 +1,258 @@
+#include <math.h>
+
+#include "resize_private.h"
+
+/*
+    FixedPointResizeEngine: the normalized weights are quantized to signed
+    16 bit integers and summed in int32. The first pass filters RGBA32 rows
+    into an RGBA64 intermediate of samples * 128, the second one rounds it
+    back to RGBA32. A product of a weight and a 15 bit sample, and the sum
+    of two of them, fits an int32, which lets the vector kernels multiply
+    with _mm_madd_epi16.
+
+    Straight alpha is premultiplied as the first pass reads it: the opacity
+    lane holds alpha * 128 and the color lanes alpha * color / 2, so the
+    second pass gets the colors back with a single float reciprocal of the
+    alpha per pixel. The plain kernels of opaque and premultiplied pixels
+    only shift.
+*/
+
+#define MaxFixedBits 14
+#define MinFixedBits 8
+
+MagickPassFail BuildFixedContributionTable(ContributionTable *table,
+                                           MagickArena *arena) {
+    uint64_t x, total = 0;
+    double max_sum = 0.0;
+    int64_t max_runs = 0;
+    int bits;
+    for (x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const double *weights = table->weights + window->offset;
+        double sum = 0.0;
+        int64_t runs = 0;
+        bool negative = false;
+        for (int64_t i = 0; i < window->count; i++) {
+            sum += AbsoluteValue(weights[i]);
+            if (weights[i] == 0.0) continue;
+            if (runs == 0 || (weights[i] < 0.0) != negative) runs++;
+            negative = weights[i] < 0.0;
+        }
+        max_sum = Max(max_sum, sum);
+        max_runs = Max(max_runs, runs);
+        total += window->count;
+    }
+    /*
+        sum(|w|) of the quantized weights, at most one more per run of taps
+        of the same sign after the rounding below, has to fit an int16. Then
+        sum(|w| * 32640) fits the int32 accumulators, and filters with large
+        negative lobes lose precision.
+    */
+    for (bits = MaxFixedBits; bits > MinFixedBits; bits--) {
+        double one = (double)(1 << bits);
+        if (max_sum * one + (double)max_runs < 32767.0) break;
+    }
+    table->fixed_bits = bits;
+    table->fixed_weights =
+        (int16_t *)ArenaAllocate(arena, total * sizeof(int16_t));
+    if (table->fixed_weights == NULL) return MagickFail;
+    for (x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const double *weights = table->weights + window->offset;
+        int16_t *fixed = table->fixed_weights + window->offset;
+        /*
+            Quantize the running sums, every tap is then within one unit of
+            its weight and the window sums to 1 << bits when its weights sum
+            to 1, so flat areas stay exact however wide the window is.
+        */
+        double sum = 0.0;
+        long previous = 0;
+        for (int64_t i = 0; i < window->count; i++) {
+            sum += weights[i];
+            long next = lrint(sum * (1 << bits));
+            fixed[i] = (int16_t)(next - previous);
+            previous = next;
+        }
+    }
+    return MagickPass;
+}
+
+/*
+    The 15 bit samples of pixel index of a row in source order: wide rows
+    hold them already, RGBA32 ones are shifted or premultiplied.
+*/
+MAGICK_FORCE_INLINE void LoadFixedSamples(int32_t *restrict sample,
+                                          const MagickPixelPacket4 *restrict p,
+                                          const int64_t index,
+                                          const int opacity,
+                                          const bool wide,
+                                          const bool matte) {
+    if (wide) {
+        const uint16_t *restrict s = (const uint16_t *)p + index * 4;
+        for (int k = 0; k < 4; k++) sample[k] = s[k];
+        return;
+    }
+    const MagickQuantum *restrict s = p[index];
+    for (int k = 0; k < 4; k++) {
+        if (matte) {
+            sample[k] = (s[k] * (k == opacity ? 256 : s[opacity])) >> 1;
+        } else {
+            sample[k] = s[k] << FixedIntermediateShift;
+        }
+    }
+}
+
+MAGICK_FORCE_INLINE void StoreFixedPixel(
+    MagickPixelPacket4 *restrict q,
+    const uint64_t x,
+    const int32_t *restrict pixel,
+    const int bits,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order,
+    const bool wide,
+    const bool matte) {
+    if (wide) {
+        SetFixedPixelPacket(
+            q[x], pixel, bits, matte, source_order, destination_order);
+    } else {
+        SetFixedWidePixelPacket((uint16_t *)q + x * 4,
+                                pixel,
+                                bits,
+                                matte,
+                                source_order,
+                                destination_order);
+    }
+}
+
+MAGICK_FORCE_INLINE void HorizontalFilterFixedPixels(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const MagickPixelOrder destination_order,
+    const bool wide,
+    const bool matte) {
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const int16_t *restrict weights = table->fixed_weights + window->offset;
+        int32_t pixel[4] = {0, 0, 0, 0}, sample[4];
+        for (int64_t i = 0; i < window->count; i++) {
+            LoadFixedSamples(sample,
+                             p,
+                             window->start + i,
+                             source_order.opacity,
+                             wide,
+                             matte);
+            for (int k = 0; k < 4; k++) pixel[k] += weights[i] * sample[k];
+        }
+        StoreFixedPixel(q,
+                        x,
+                        pixel,
+                        table->fixed_bits,
+                        source_order,
+                        destination_order,
+                        wide,
+                        matte);
+    }
+}
+
+MAGICK_FORCE_INLINE void VerticalFilterFixedPixels(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const bool wide,
+    const bool matte) {
+    const ContributionWindow *window = &table->windows[y];
+    const int16_t *restrict weights = table->fixed_weights + window->offset;
+    for (uint64_t x = 0; x < columns; x++) {
+        int32_t pixel[4] = {0, 0, 0, 0}, sample[4];
+        for (int64_t i = 0; i < window->count; i++) {
+            LoadFixedSamples(
+                sample, rows[i], (int64_t)x, source_order.opacity, wide, matte);
+            for (int k = 0; k < 4; k++) pixel[k] += weights[i] * sample[k];
+        }
+        StoreFixedPixel(q,
+                        x,
+                        pixel,
+                        table->fixed_bits,
+                        source_order,
+                        destination_order,
+                        wide,
+                        matte);
+    }
+}
+
+/*
+    Defines horizontal and vertical for RGBA32 or wide source rows, with
+    their constant pixel layout versions.
+*/
+#define DefineFixedRowKernels(horizontal, vertical, wide, matte)          \
+    MAGICK_FORCE_INLINE void horizontal##Body(                            \
+        const ContributionTable *restrict table,                          \
+        const MagickPixelPacket4 *restrict p,                             \
+        const MagickPixelOrder source_order,                              \
+        MagickPixelPacket4 *restrict q,                                   \
+        const MagickPixelOrder destination_order) {                       \
+        HorizontalFilterFixedPixels(                                      \
+            table, p, source_order, q, destination_order, wide, matte);   \
+    }                                                                     \
+    MAGICK_FORCE_INLINE void vertical##Body(                              \
+        const ContributionTable *restrict table,                          \
+        const uint64_t y,                                                 \
+        const MagickPixelPacket4 *const *restrict rows,                   \
+        const MagickPixelOrder source_order,                              \
+        MagickPixelPacket4 *restrict q,                                   \
+        const uint64_t columns,                                           \
+        const MagickPixelOrder destination_order) {                       \
+        VerticalFilterFixedPixels(table,                                  \
+                                  y,                                      \
+                                  rows,                                   \
+                                  source_order,                           \
+                                  q,                                      \
+                                  columns,                                \
+                                  destination_order,                      \
+                                  wide,                                   \
+                                  matte);                                 \
+    }                                                                     \
+    void horizontal(const ContributionTable *restrict table,              \
+                    const MagickPixelPacket4 *restrict p,                 \
+                    const MagickPixelOrder source_order,                  \
+                    MagickPixelPacket4 *restrict q,                       \
+                    const MagickPixelOrder destination_order) {           \
+        horizontal##Body(table, p, source_order, q, destination_order);   \
+    }                                                                     \
+    void vertical(const ContributionTable *restrict table,                \
+                  const uint64_t y,                                       \
+                  const MagickPixelPacket4 *const *restrict rows,         \
+                  const MagickPixelOrder source_order,                    \
+                  MagickPixelPacket4 *restrict q,                         \
+                  const uint64_t columns,                                 \
+                  const MagickPixelOrder destination_order) {             \
+        vertical##Body(                                                   \
+            table, y, rows, source_order, q, columns, destination_order); \
+    }                                                                     \
+    DefineOrderedRowKernels(                                              \
+        , horizontal, vertical, OpacityLast, OpacityLastOrder)            \
+    DefineOrderedRowKernels(                                              \
+        , horizontal, vertical, OpacityFirst, OpacityFirstOrder)
+
+DefineFixedRowKernels(HorizontalFilterRowFixed,
+                      VerticalFilterRowFixed,
+                      false,
+                      true)
+DefineFixedRowKernels(HorizontalPlainFilterRowFixed,
+                      VerticalPlainFilterRowFixed,
+                      false,
+                      false)
+DefineFixedRowKernels(HorizontalWideFilterRowFixed,
+                      VerticalWideFilterRowFixed,
+                      true,
+                      true)
+DefineFixedRowKernels(HorizontalWidePlainFilterRowFixed,
+                      VerticalWidePlainFilterRowFixed,
+                      true,
+                      false)
@@ -0,0 +1,211 @@
+#include "resize_private.h"
+
+/*
+    FloatResizeEngine: the normalized weights are rounded to float once per
+    plan and every pixel is accumulated in float, four lanes in source byte
+    order. The straight alpha kernels weight the colors by
+    weight * alpha / MaxRGB and the opacity by the weight, like the double
+    kernels. The plain kernels filter opaque and premultiplied pixels as
+    weighted sums: the weights of a window sum to one, so an opaque alpha
+    rounds back to MaxRGB.
+
+    Windows are summed as two interleaved halves, even and odd taps, which
+    are added at the end. The AVX2 kernels filter two taps per instruction
+    in the same order, so both give the same bytes.
+*/
+
+MagickPassFail BuildFloatContributionTable(ContributionTable *table,
+                                           MagickArena *arena) {
+    table->float_weights =
+        (float *)ArenaAllocate(arena, table->taps * sizeof(float));
+    if (table->float_weights == NULL) return MagickFail;
+    for (uint64_t i = 0; i < table->taps; i++) {
+        table->float_weights[i] = (float)table->weights[i];
+    }
+    return MagickPass;
+}
+
+MAGICK_FORCE_INLINE void AccumulateFloatPixelPacket(
+    float *restrict pixel,
+    float *restrict normalize,
+    const MagickQuantum *restrict s,
+    const float weight,
+    const MagickPixelOrder source_order,
+    const bool matte) {
+    if (!matte) {
+        for (int k = 0; k < 4; k++) pixel[k] += weight * (float)s[k];
+        return;
+    }
+    const float alpha = (float)s[source_order.opacity];
+    const float transparency_coeff = weight * (alpha * (1.0f / MaxRGBFloat));
+    pixel[source_order.red] += transparency_coeff * (float)s[source_order.red];
+    pixel[source_order.green] +=
+        transparency_coeff * (float)s[source_order.green];
+    pixel[source_order.blue] +=
+        transparency_coeff * (float)s[source_order.blue];
+    pixel[source_order.opacity] += weight * (MaxRGBFloat - alpha);
+    *normalize += transparency_coeff;
+}
+
+MAGICK_FORCE_INLINE void SetFloatPixel(MagickQuantum *restrict q,
+                                       const float *restrict pixel,
+                                       const float normalize,
+                                       const MagickPixelOrder source_order,
+                                       const MagickPixelOrder destination_order,
+                                       const bool matte) {
+    if (matte) {
+        SetFloatPixelPacket(
+            q, pixel, normalize, source_order, destination_order);
+    } else {
+        SetFloatPlainPixelPacket(q, pixel, source_order, destination_order);
+    }
+}
+
+MAGICK_FORCE_INLINE void FilterFloatWindow(
+    MagickQuantum *restrict q,
+    const MagickPixelPacket4 *restrict pixels,
+    const float *restrict weights,
+    const int64_t count,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order,
+    const bool matte) {
+    float even[4] = {0.0f, 0.0f, 0.0f, 0.0f}, odd[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float even_normalize = 0.0f, odd_normalize = 0.0f;
+    int64_t i;
+    for (i = 0; i + 1 < count; i += 2) {
+        AccumulateFloatPixelPacket(
+            even, &even_normalize, pixels[i], weights[i], source_order, matte);
+        AccumulateFloatPixelPacket(odd,
+                                   &odd_normalize,
+                                   pixels[i + 1],
+                                   weights[i + 1],
+                                   source_order,
+                                   matte);
+    }
+    if (i < count) {
+        AccumulateFloatPixelPacket(
+            even, &even_normalize, pixels[i], weights[i], source_order, matte);
+    }
+    for (int k = 0; k < 4; k++) even[k] += odd[k];
+    SetFloatPixel(q,
+                  even,
+                  even_normalize + odd_normalize,
+                  source_order,
+                  destination_order,
+                  matte);
+}
+
+MAGICK_FORCE_INLINE void HorizontalFloatPixels(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const MagickPixelOrder destination_order,
+    const bool matte) {
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const float *restrict weights = table->float_weights + window->offset;
+        const MagickPixelPacket4 *restrict pixels = p + window->start;
+        switch (window->count) {
+            case 2:
+                FilterFloatWindow(q[x],
+                                  pixels,
+                                  weights,
+                                  2,
+                                  source_order,
+                                  destination_order,
+                                  matte);
+                break;
+            case 4:
+                FilterFloatWindow(q[x],
+                                  pixels,
+                                  weights,
+                                  4,
+                                  source_order,
+                                  destination_order,
+                                  matte);
+                break;
+            default:
+                FilterFloatWindow(q[x],
+                                  pixels,
+                                  weights,
+                                  window->count,
+                                  source_order,
+                                  destination_order,
+                                  matte);
+                break;
+        }
+    }
+}
+
+MAGICK_FORCE_INLINE void VerticalFloatPixels(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const bool matte) {
+    const ContributionWindow *window = &table->windows[y];
+    const float *restrict weights = table->float_weights + window->offset;
+    for (uint64_t x = 0; x < columns; x++) {
+        float pixel[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        float normalize = 0.0f;
+        for (int64_t i = 0; i < window->count; i++) {
+            AccumulateFloatPixelPacket(
+                pixel, &normalize, rows[i][x], weights[i], source_order, matte);
+        }
+        SetFloatPixel(
+            q[x], pixel, normalize, source_order, destination_order, matte);
+    }
+}
+
+#define DefineFloatRowKernels(horizontal, vertical, matte)                  \
+    MAGICK_FORCE_INLINE void horizontal##Body(                              \
+        const ContributionTable *restrict table,                            \
+        const MagickPixelPacket4 *restrict p,                               \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const MagickPixelOrder destination_order) {                         \
+        HorizontalFloatPixels(                                              \
+            table, p, source_order, q, destination_order, matte);           \
+    }                                                                       \
+    MAGICK_FORCE_INLINE void vertical##Body(                                \
+        const ContributionTable *restrict table,                            \
+        const uint64_t y,                                                   \
+        const MagickPixelPacket4 *const *restrict rows,                     \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const uint64_t columns,                                             \
+        const MagickPixelOrder destination_order) {                         \
+        VerticalFloatPixels(                                                \
+            table, y, rows, source_order, q, columns, destination_order,    \
+            matte);                                                         \
+    }                                                                       \
+    void horizontal(const ContributionTable *restrict table,                \
+                    const MagickPixelPacket4 *restrict p,                   \
+                    const MagickPixelOrder source_order,                    \
+                    MagickPixelPacket4 *restrict q,                         \
+                    const MagickPixelOrder destination_order) {             \
+        horizontal##Body(table, p, source_order, q, destination_order);     \
+    }                                                                       \
+    void vertical(const ContributionTable *restrict table,                  \
+                  const uint64_t y,                                         \
+                  const MagickPixelPacket4 *const *restrict rows,           \
+                  const MagickPixelOrder source_order,                      \
+                  MagickPixelPacket4 *restrict q,                           \
+                  const uint64_t columns,                                   \
+                  const MagickPixelOrder destination_order) {               \
+        vertical##Body(                                                     \
+            table, y, rows, source_order, q, columns, destination_order);   \
+    }                                                                       \
+    DefineOrderedRowKernels(, horizontal, vertical, OpacityLast,            \
+                            OpacityLastOrder)                               \
+    DefineOrderedRowKernels(, horizontal, vertical, OpacityFirst,           \
+                            OpacityFirstOrder)
+
+DefineFloatRowKernels(HorizontalFilterRowFloat, VerticalFilterRowFloat, true)
+DefineFloatRowKernels(HorizontalPlainFilterRowFloat,
+                      VerticalPlainFilterRowFloat,
+                      false)
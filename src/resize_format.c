@@ -0,0 +1,383 @@
+#include <string.h>
+
+#include "resize_private.h"
+
+const PixelFormatInfo MagickPixelFormats[RGBA64PixelFormat + 1] = {
+    {4, 1, 3, true},   // RGBA32PixelFormat
+    {3, 1, 3, false},  // RGB24PixelFormat
+    {1, 1, 1, false},  // Gray8PixelFormat
+    {2, 1, 1, true},   // GrayAlpha16PixelFormat
+    {4, 2, 3, true}};  // RGBA64PixelFormat
+
+uint64_t GetPixelFormatSize(const MagickPixelFormat format) {
+    if ((unsigned int)format > RGBA64PixelFormat) return 0;
+    return GetPixelSize(format);
+}
+
+MAGICK_FORCE_INLINE double GetSample(const MagickQuantum *restrict p,
+                                     const int k,
+                                     const bool wide) {
+    return wide ? (double)((const uint16_t *)p)[k] : (double)p[k];
+}
+
+MAGICK_FORCE_INLINE void SetSample(MagickQuantum *restrict q,
+                                   const int k,
+                                   const double value,
+                                   const bool wide) {
+    if (wide) {
+        ((uint16_t *)q)[k] = (uint16_t)(value < 0.0              ? 0U
+                                        : value > MaxRGB16Double ? MaxRGB16
+                                                                 : value + 0.5);
+    } else {
+        q[k] = RoundDoubleToQuantum(value);
+    }
+}
+
+/*
+    Adds one tap to the color accumulators, weighted by the alpha of the
+    tap when the format has one, in the same way as the RGBA32 kernels.
+*/
+MAGICK_FORCE_INLINE void AccumulateSamples(double *restrict pixel,
+                                           double *restrict normalize,
+                                           const MagickQuantum *restrict s,
+                                           const double weight,
+                                           const int *restrict channels,
+                                           const int colors,
+                                           const bool matte,
+                                           const bool wide) {
+    if (!matte) {
+        for (int k = 0; k < colors; k++) {
+            pixel[k] += weight * GetSample(s, channels[k], wide);
+        }
+        return;
+    }
+    double alpha = GetSample(s, channels[colors], wide);
+    double transparency_coeff =
+        weight * (wide ? alpha * (1.0 / MaxRGB16Double)
+                       : MagickTransparencyTable[(MagickQuantum)alpha]);
+    for (int k = 0; k < colors; k++) {
+        pixel[k] += transparency_coeff * GetSample(s, channels[k], wide);
+    }
+    pixel[colors] += weight * ((wide ? MaxRGB16Double : MaxRGBDouble) - alpha);
+    *normalize += transparency_coeff;
+}
+
+MAGICK_FORCE_INLINE void SetSamples(MagickQuantum *restrict q,
+                                    const double *restrict pixel,
+                                    double normalize,
+                                    const int *restrict channels,
+                                    const int colors,
+                                    const bool matte,
+                                    const bool wide) {
+    normalize = !matte ? 1.0
+                       : 1.0 / (AbsoluteValue(normalize) <= MagickEpsilon
+                                    ? 1.0
+                                    : normalize);
+    for (int k = 0; k < colors; k++) {
+        SetSample(q, channels[k], pixel[k] * normalize, wide);
+    }
+    if (matte) {
+        // rounds the opacity before turning it back into alpha
+        const double max = wide ? MaxRGB16Double : MaxRGBDouble;
+        double opacity = pixel[colors];
+        opacity = opacity < 0.0   ? 0.0
+                  : opacity > max ? max
+                                  : (double)(uint32_t)(opacity + 0.5);
+        SetSample(q, channels[colors], max - opacity, wide);
+    }
+}
+
+MAGICK_FORCE_INLINE void HorizontalFormatRow(
+    const ContributionTable *restrict table,
+    const MagickQuantum *restrict p,
+    const int *restrict source_channels,
+    MagickQuantum *restrict q,
+    const int *restrict destination_channels,
+    const int samples,
+    const int colors,
+    const bool matte,
+    const bool wide) {
+    const uint64_t size = (uint64_t)samples * (wide ? 2 : 1);
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const double *restrict weights = table->weights + window->offset;
+        const MagickQuantum *restrict s = p + window->start * size;
+        double pixel[4] = {0.0, 0.0, 0.0, 0.0};
+        double normalize = 0.0;
+        for (int64_t i = 0; i < window->count; i++) {
+            AccumulateSamples(pixel,
+                              &normalize,
+                              s + i * size,
+                              weights[i],
+                              source_channels,
+                              colors,
+                              matte,
+                              wide);
+        }
+        SetSamples(q + x * size,
+                   pixel,
+                   normalize,
+                   destination_channels,
+                   colors,
+                   matte,
+                   wide);
+    }
+}
+
+MAGICK_FORCE_INLINE void VerticalFormatRow(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickQuantum *const *restrict rows,
+    const int *restrict source_channels,
+    MagickQuantum *restrict q,
+    const uint64_t columns,
+    const int *restrict destination_channels,
+    const int samples,
+    const int colors,
+    const bool matte,
+    const bool wide) {
+    const ContributionWindow *window = &table->windows[y];
+    const double *restrict weights = table->weights + window->offset;
+    const uint64_t size = (uint64_t)samples * (wide ? 2 : 1);
+    if (!matte && !wide && source_channels == destination_channels) {
+        // every sample of the row is filtered alike, 8 at a time
+        uint64_t x = 0;
+        for (; x + 8 <= columns * size; x += 8) {
+            double value[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+            for (int64_t i = 0; i < window->count; i++) {
+                for (int k = 0; k < 8; k++) {
+                    value[k] += weights[i] * rows[i][x + k];
+                }
+            }
+            for (int k = 0; k < 8; k++) {
+                q[x + k] = RoundDoubleToQuantum(value[k]);
+            }
+        }
+        for (; x < columns * size; x++) {
+            double value = 0.0;
+            for (int64_t i = 0; i < window->count; i++) {
+                value += weights[i] * rows[i][x];
+            }
+            q[x] = RoundDoubleToQuantum(value);
+        }
+        return;
+    }
+    for (uint64_t x = 0; x < columns; x++) {
+        double pixel[4] = {0.0, 0.0, 0.0, 0.0};
+        double normalize = 0.0;
+        for (int64_t i = 0; i < window->count; i++) {
+            AccumulateSamples(pixel,
+                              &normalize,
+                              rows[i] + x * size,
+                              weights[i],
+                              source_channels,
+                              colors,
+                              matte,
+                              wide);
+        }
+        SetSamples(q + x * size,
+                   pixel,
+                   normalize,
+                   destination_channels,
+                   colors,
+                   matte,
+                   wide);
+    }
+}
+
+/*
+    Channel positions of a pixel of format, constant when both sides use the
+    same order and alpha, if weighted by, is the last sample: the colors are
+    then filtered alike whatever their order.
+*/
+static inline bool GetFormatChannels(const MagickPixelFormat format,
+                                     const MagickPixelOrder source_order,
+                                     const MagickPixelOrder destination_order,
+                                     const bool matte,
+                                     int *restrict source_channels,
+                                     int *restrict destination_channels) {
+    const PixelFormatInfo *info = &MagickPixelFormats[format];
+    GetPixelChannels(format, source_order, source_channels);
+    GetPixelChannels(format, destination_order, destination_channels);
+    return info->colors == 1 ||
+           (memcmp(&source_order, &destination_order,
+                   sizeof(MagickPixelOrder)) == 0 &&
+            (!matte || source_order.opacity == info->colors));
+}
+
+static const int SequentialChannels[4] = {0, 1, 2, 3};
+
+/*
+    Defines the row kernels name of format, samples, colors, matte and wide
+    (16 bit samples) are constants so every variant gets its own loops.
+    Premultiplied pixels count their alpha as one more color.
+*/
+#define DefineFormatRowKernels(name, format, samples, colors, matte, wide)    \
+    static void HorizontalFilterRow##name(                                    \
+        const ContributionTable *restrict table,                              \
+        const MagickPixelPacket4 *restrict p,                                 \
+        const MagickPixelOrder source_order,                                  \
+        MagickPixelPacket4 *restrict q,                                       \
+        const MagickPixelOrder destination_order) {                           \
+        int source_channels[4], destination_channels[4];                      \
+        if (GetFormatChannels(format##PixelFormat,                            \
+                              source_order,                                   \
+                              destination_order,                              \
+                              matte,                                          \
+                              source_channels,                                \
+                              destination_channels)) {                        \
+            HorizontalFormatRow(table,                                        \
+                                (const MagickQuantum *)p,                     \
+                                SequentialChannels,                           \
+                                (MagickQuantum *)q,                           \
+                                SequentialChannels,                           \
+                                samples,                                      \
+                                colors,                                       \
+                                matte,                                        \
+                                wide);                                        \
+            return;                                                           \
+        }                                                                     \
+        HorizontalFormatRow(table,                                            \
+                            (const MagickQuantum *)p,                         \
+                            source_channels,                                  \
+                            (MagickQuantum *)q,                               \
+                            destination_channels,                             \
+                            samples,                                          \
+                            colors,                                           \
+                            matte,                                            \
+                            wide);                                            \
+    }                                                                         \
+    static void VerticalFilterRow##name(                                      \
+        const ContributionTable *restrict table,                              \
+        const uint64_t y,                                                     \
+        const MagickPixelPacket4 *const *restrict rows,                       \
+        const MagickPixelOrder source_order,                                  \
+        MagickPixelPacket4 *restrict q,                                       \
+        const uint64_t columns,                                               \
+        const MagickPixelOrder destination_order) {                           \
+        int source_channels[4], destination_channels[4];                      \
+        if (GetFormatChannels(format##PixelFormat,                            \
+                              source_order,                                   \
+                              destination_order,                              \
+                              matte,                                          \
+                              source_channels,                                \
+                              destination_channels)) {                        \
+            VerticalFormatRow(table,                                          \
+                              y,                                              \
+                              (const MagickQuantum *const *)rows,             \
+                              SequentialChannels,                             \
+                              (MagickQuantum *)q,                             \
+                              columns,                                        \
+                              SequentialChannels,                             \
+                              samples,                                        \
+                              colors,                                         \
+                              matte,                                          \
+                              wide);                                          \
+            return;                                                           \
+        }                                                                     \
+        VerticalFormatRow(table,                                              \
+                          y,                                                  \
+                          (const MagickQuantum *const *)rows,                 \
+                          source_channels,                                    \
+                          (MagickQuantum *)q,                                 \
+                          columns,                                            \
+                          destination_channels,                               \
+                          samples,                                            \
+                          colors,                                             \
+                          matte,                                              \
+                          wide);                                              \
+    }
+
+DefineFormatRowKernels(RGB24, RGB24, 3, 3, false, false)
+DefineFormatRowKernels(Gray8, Gray8, 1, 1, false, false)
+DefineFormatRowKernels(GrayAlpha16, GrayAlpha16, 2, 1, true, false)
+DefineFormatRowKernels(RGBA64, RGBA64, 4, 3, true, true)
+DefineFormatRowKernels(
+    PremultipliedGrayAlpha16, GrayAlpha16, 2, 2, false, false)
+DefineFormatRowKernels(PremultipliedRGBA64, RGBA64, 4, 4, false, true)
+
+HorizontalRowKernel GetFormatHorizontalRowKernel(
+    const MagickPixelFormat format, const bool premultiplied) {
+    switch (format) {
+        case RGB24PixelFormat:
+            return HorizontalFilterRowRGB24;
+        case Gray8PixelFormat:
+            return HorizontalFilterRowGray8;
+        case GrayAlpha16PixelFormat:
+            return premultiplied ? HorizontalFilterRowPremultipliedGrayAlpha16
+                                 : HorizontalFilterRowGrayAlpha16;
+        case RGBA64PixelFormat:
+            return premultiplied ? HorizontalFilterRowPremultipliedRGBA64
+                                 : HorizontalFilterRowRGBA64;
+        default:
+            return NULL;
+    }
+}
+
+VerticalRowKernel GetFormatVerticalRowKernel(const MagickPixelFormat format,
+                                             const bool premultiplied) {
+    switch (format) {
+        case RGB24PixelFormat:
+            return VerticalFilterRowRGB24;
+        case Gray8PixelFormat:
+            return VerticalFilterRowGray8;
+        case GrayAlpha16PixelFormat:
+            return premultiplied ? VerticalFilterRowPremultipliedGrayAlpha16
+                                 : VerticalFilterRowGrayAlpha16;
+        case RGBA64PixelFormat:
+            return premultiplied ? VerticalFilterRowPremultipliedRGBA64
+                                 : VerticalFilterRowRGBA64;
+        default:
+            return NULL;
+    }
+}
+
+/*
+    Multiplies or divides the colors of every pixel by its alpha, rounding
+    to nearest like the box average. Fully transparent colors become 0.
+*/
+static int ConvertImageAlpha(const MagickImage *image, const bool premultiply) {
+    const PixelFormatInfo *info;
+    int channels[4];
+
+    if (!IsValidImageLayout(image)) return 1;
+    info = &MagickPixelFormats[image->format];
+    if (!info->matte) return 0;
+    const bool wide = info->depth == 2;
+    const uint64_t max = wide ? MaxRGB16 : MaxRGB;
+    const uint64_t size = GetPixelSize(image->format);
+    GetPixelChannels(image->format, image->order, channels);
+    for (uint64_t y = 0; y < image->rows; y++) {
+        MagickQuantum *p = (MagickQuantum *)GetImageRow(image, y);
+        for (uint64_t x = 0; x < image->columns; x++, p += size) {
+            uint64_t alpha = wide ? ((uint16_t *)p)[channels[info->colors]]
+                                  : p[channels[info->colors]];
+            for (int k = 0; k < info->colors; k++) {
+                uint64_t value = wide ? ((uint16_t *)p)[channels[k]]
+                                      : p[channels[k]];
+                if (premultiply) {
+                    value = (2 * value * alpha + max) / (2 * max);
+                } else {
+                    value = alpha == 0 ? 0
+                                       : Min((2 * value * max + alpha) /
+                                                 (2 * alpha),
+                                             max);
+                }
+                if (wide) {
+                    ((uint16_t *)p)[channels[k]] = (uint16_t)value;
+                } else {
+                    p[channels[k]] = (MagickQuantum)value;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int PremultiplyImage(const MagickImage *image) {
+    return ConvertImageAlpha(image, true);
+}
+
+int UnpremultiplyImage(const MagickImage *image) {
+    return ConvertImageAlpha(image, false);
+}
@@ -0,0 +1,131 @@
+#include <math.h>
+
+#include "resize_private.h"
+#include "thread.h"
+
+/*
+    sRGB transfer tables: linear_table decodes every 8 bit sample to 16 bit
+    linear light, srgb_table encodes every 16 bit value to the nearest 8 bit
+    sample, so a pixel the filters leave alone comes back unchanged.
+*/
+static uint16_t linear_table[MaxRGB + 1];
+static MagickQuantum srgb_table[MaxRGB16 + 1];
+static MagickOnce linear_tables_once = MAGICK_ONCE_INIT;
+
+static double SRGBToLinear(const double value) {
+    return value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+}
+
+static void InitializeLinearTables(void) {
+    uint64_t x = 0;
+    for (unsigned int i = 0; i <= MaxRGB; i++) {
+        linear_table[i] = (uint16_t)(
+            SRGBToLinear(i / MaxRGBDouble) * MaxRGB16Double + 0.5);
+    }
+    // 16 bit values below the midpoint of i and i + 1 encode to i
+    for (unsigned int i = 0; i < MaxRGB; i++) {
+        double stop =
+            SRGBToLinear((i + 0.5) / MaxRGBDouble) * MaxRGB16Double;
+        for (; x < stop; x++) srgb_table[x] = (MagickQuantum)i;
+    }
+    for (; x <= MaxRGB16; x++) srgb_table[x] = MaxRGB;
+}
+
+void InitializeLinearLight(void) {
+    MagickCallOnce(&linear_tables_once, InitializeLinearTables);
+}
+
+MAGICK_FORCE_INLINE void DecodeLinearPixels(const MagickQuantum *restrict p,
+                                            const int *restrict channels,
+                                            const uint64_t columns,
+                                            uint16_t *restrict q,
+                                            const int samples,
+                                            const int colors,
+                                            const bool matte) {
+    for (uint64_t x = 0; x < columns; x++, p += samples, q += 4) {
+        if (colors == 1) {
+            q[0] = q[1] = q[2] = linear_table[p[0]];
+        } else {
+            q[0] = linear_table[p[channels[0]]];
+            q[1] = linear_table[p[channels[1]]];
+            q[2] = linear_table[p[channels[2]]];
+        }
+        q[3] = matte ? (uint16_t)(p[channels[colors]] * 257U) : MaxRGB16;
+    }
+}
+
+MAGICK_FORCE_INLINE void EncodeLinearPixels(const uint16_t *restrict p,
+                                            const uint64_t columns,
+                                            MagickQuantum *restrict q,
+                                            const int *restrict channels,
+                                            const int samples,
+                                            const int colors,
+                                            const bool matte) {
+    for (uint64_t x = 0; x < columns; x++, p += 4, q += samples) {
+        if (colors == 1) {
+            q[0] = srgb_table[p[0]];
+        } else {
+            q[channels[0]] = srgb_table[p[0]];
+            q[channels[1]] = srgb_table[p[1]];
+            q[channels[2]] = srgb_table[p[2]];
+        }
+        if (matte) {
+            q[channels[colors]] =
+                (MagickQuantum)((p[3] * MaxRGB + MaxRGB16 / 2) / MaxRGB16);
+        }
+    }
+}
+
+void DecodeLinearRow(const MagickPixelFormat format,
+                     const MagickPixelOrder order,
+                     const MagickPixelPacket4 *restrict p,
+                     const uint64_t columns,
+                     MagickPixelPacket4 *restrict q) {
+    const MagickQuantum *s = (const MagickQuantum *)p;
+    uint16_t *d = (uint16_t *)q;
+    int channels[4] = {0, 1, 2, 3};  // gray only sets two
+    GetPixelChannels(format, order, channels);
+    switch (format) {
+        case RGBA32PixelFormat:
+            DecodeLinearPixels(s, channels, columns, d, 4, 3, true);
+            break;
+        case RGB24PixelFormat:
+            DecodeLinearPixels(s, channels, columns, d, 3, 3, false);
+            break;
+        case Gray8PixelFormat:
+            DecodeLinearPixels(s, channels, columns, d, 1, 1, false);
+            break;
+        case GrayAlpha16PixelFormat:
+            DecodeLinearPixels(s, channels, columns, d, 2, 1, true);
+            break;
+        default:
+            break;
+    }
+}
+
+void EncodeLinearRow(const MagickPixelPacket4 *restrict p,
+                     const uint64_t columns,
+                     const MagickPixelFormat format,
+                     const MagickPixelOrder order,
+                     MagickPixelPacket4 *restrict q) {
+    const uint16_t *s = (const uint16_t *)p;
+    MagickQuantum *d = (MagickQuantum *)q;
+    int channels[4] = {0, 1, 2, 3};  // gray only sets two
+    GetPixelChannels(format, order, channels);
+    switch (format) {
+        case RGBA32PixelFormat:
+            EncodeLinearPixels(s, columns, d, channels, 4, 3, true);
+            break;
+        case RGB24PixelFormat:
+            EncodeLinearPixels(s, columns, d, channels, 3, 3, false);
+            break;
+        case Gray8PixelFormat:
+            EncodeLinearPixels(s, columns, d, channels, 1, 1, false);
+            break;
+        case GrayAlpha16PixelFormat:
+            EncodeLinearPixels(s, columns, d, channels, 2, 1, true);
+            break;
+        default:
+            break;
+    }
+}
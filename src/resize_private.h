@@ -0,0 +1,683 @@
+#ifndef _MAGICK_RESIZE_PRIVATE_H
+#define _MAGICK_RESIZE_PRIVATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "resize.h"
+
+#define ARG_NOT_USED(arg) (void)arg
+#define MaxRGB 255U
+#define MagickEpsilon 1.0e-12
+#define MagickPI 3.14159265358979323846264338327950288419716939937510
+#define OpaqueOpacity 0UL
+#define TransparentOpacity MaxRGB
+#define MaxRGBFloat 255.0f
+#define MaxRGBDouble 255.0
+#define MaxRGB16 65535U
+#define MaxRGB16Double 65535.0
+// samples of the fixed point intermediate are RGBA32 samples * 128
+#define FixedIntermediateShift 7
+#define MaxFixedIntermediate (MaxRGB << FixedIntermediateShift)
+#define RoundDoubleToQuantum(value)              \
+    ((Quantum)(value < 0.0              ? 0U     \
+               : (value > MaxRGBDouble) ? MaxRGB \
+                                        : value + 0.5))
+
+#define RoundFloatToQuantum(value)              \
+    ((Quantum)(value < 0.0f            ? 0U     \
+               : (value > MaxRGBFloat) ? MaxRGB \
+                                       : value + 0.5f))
+
+#define AbsoluteValue(x) ((x) < 0 ? -(x) : (x))
+
+#define DefaultResizeFilter LanczosFilter
+#define DefaultThumbnailFilter BoxFilter
+#define Max(x, y) (((x) > (y)) ? (x) : (y))
+#define Min(x, y) (((x) < (y)) ? (x) : (y))
+// inlined even where the compiler would not, so constant arguments such
+// as tap counts and channel orders specialize the body
+#if defined(_MSC_VER) && !defined(__clang__)
+#define MAGICK_FORCE_INLINE static __forceinline
+#else
+#define MAGICK_FORCE_INLINE static inline __attribute__((always_inline))
+#endif
+#define MagickPassFail uint8_t
+#define MagickPass 1
+#define MagickFail 0
+
+typedef struct _ContributionWindow {
+    int64_t start;    // first source pixel
+    int64_t count;    // number of taps
+    uint64_t offset;  // index of the first weight in weights
+} ContributionWindow;
+
+typedef struct _ContributionTable {
+    ContributionWindow *windows;  // one window per destination pixel
+    double *weights;              // normalized weights of all windows
+    double *densities;            // sum of the weights of each window
+    int16_t *fixed_weights;       // weights scaled by 1 << fixed_bits
+    int fixed_bits;               // precision of fixed_weights
+    float *float_weights;         // weights rounded to float
+    uint64_t length;              // number of windows
+    int64_t max_count;            // largest window
+    uint64_t taps;                // sum of the window counts
+    double support;               // half width of the windows
+} ContributionTable;
+
+typedef enum {
+    NoResizeFastPath,
+    CopyResizeFastPath,        // same size, copy or reorder channels
+    SampleResizeFastPath,      // one tap per pixel, replicate or decimate
+    BoxAverageResizeFastPath   // integer downscale with BoxFilter
+} ResizeFastPath;
+
+struct _ResizePlan {
+    uint64_t src_columns, src_rows;
+    uint64_t columns, rows;
+    FilterTypes filter;  // filter after UndefinedFilter mapping
+    double blur;
+    bool tabulate_filters;  // weights interpolated from the filter tables
+    bool order;             // horizontal pass first
+    double progressive_factor;
+    ResizeCostModel cost_model;  // the order was picked with
+    // 2x box reductions of each axis before the filters, the tables start
+    // from the reduced image
+    int x_halvings, y_halvings;
+    ContributionTable horizontal;
+    ContributionTable vertical;
+    ResizeFastPath fast_path;
+    MagickArena arena;  // storage of both tables
+};
+
+typedef struct _DoublePixelPacket {
+    double red, green, blue, opacity;
+} DoublePixelPacket;
+
+typedef unsigned char Quantum;
+
+#define GET_PIXEL_PACKET(p, k) p[k]
+#define SET_PIXEL_PACKET(p, k, v) p[k] = v
+
+typedef struct _PixelFormatInfo {
+    int channels;  // samples per pixel
+    int depth;     // bytes per sample
+    int colors;    // color samples, followed by alpha when matte
+    bool matte;
+} PixelFormatInfo;
+
+extern const PixelFormatInfo MagickPixelFormats[RGBA64PixelFormat + 1];
+
+static inline uint64_t GetPixelSize(const MagickPixelFormat format) {
+    return (uint64_t)(MagickPixelFormats[format].channels *
+                      MagickPixelFormats[format].depth);
+}
+
+static inline uint64_t GetImageStride(const MagickImage *image) {
+    return image->stride != 0 ? image->stride
+                              : image->columns * GetPixelSize(image->format);
+}
+
+/*
+    A known format with rows that hold columns pixels, 16 bit samples
+    aligned.
+*/
+static inline bool IsValidImageLayout(const MagickImage *image) {
+    if ((unsigned int)image->format > RGBA64PixelFormat) return false;
+    if (GetImageStride(image) < image->columns * GetPixelSize(image->format)) {
+        return false;
+    }
+    if (MagickPixelFormats[image->format].depth == 2 &&
+        (GetImageStride(image) % 2 != 0 || (uintptr_t)image->pixels % 2 != 0)) {
+        return false;
+    }
+    return true;
+}
+
+/*
+    Positions of the color samples of a pixel, then of its alpha sample, in
+    the order of red, green, blue and opacity.
+*/
+static inline void GetPixelChannels(const MagickPixelFormat format,
+                                    const MagickPixelOrder order,
+                                    int *channels) {
+    const PixelFormatInfo *info = &MagickPixelFormats[format];
+    if (info->colors == 1) {
+        channels[0] = 0;
+        channels[1] = 1;
+        return;
+    }
+    channels[0] = order.red;
+    channels[1] = order.green;
+    channels[2] = order.blue;
+    channels[3] = order.opacity;
+}
+
+static inline MagickPixelPacket4 *GetImageRow(const MagickImage *image,
+                                              const uint64_t y) {
+    return (MagickPixelPacket4 *)((MagickQuantum *)image->pixels +
+                                  y * GetImageStride(image));
+}
+
+#define TransparencyCoeff(alpha) \
+    (1 - ((double)(TransparentOpacity - (alpha)) / TransparentOpacity))
+
+/*
+    TransparencyCoeff of every alpha byte, replaces a division per tap.
+*/
+extern const double MagickTransparencyTable[MaxRGB + 1];
+
+typedef void (*HorizontalRowKernel)(const ContributionTable *restrict table,
+                                    const MagickPixelPacket4 *restrict p,
+                                    const MagickPixelOrder source_order,
+                                    MagickPixelPacket4 *restrict q,
+                                    const MagickPixelOrder destination_order);
+
+typedef void (*VerticalRowKernel)(const ContributionTable *restrict table,
+                                  const uint64_t y,
+                                  const MagickPixelPacket4 *const *restrict rows,
+                                  const MagickPixelOrder source_order,
+                                  MagickPixelPacket4 *restrict q,
+                                  const uint64_t columns,
+                                  const MagickPixelOrder destination_order);
+
+/*
+    Source and destination orders a kernel is specialized for. With the same
+    order on both sides the three colors are filtered alike, so rgba and
+    bgra share the opacity last kernels.
+*/
+typedef enum {
+    AnyPixelLayout,           // any orders, read from the arguments
+    OpacityLastPixelLayout,   // same order on both sides, opacity in byte 3
+    OpacityFirstPixelLayout,  // same order on both sides, opacity in byte 0
+    PixelLayoutCount
+} PixelLayout;
+
+#define OpacityLastOrder ((MagickPixelOrder){0, 1, 2, 3})
+#define OpacityFirstOrder ((MagickPixelOrder){1, 2, 3, 0})
+
+typedef struct _ResizeKernels {
+    const char *name;
+    HorizontalRowKernel horizontal[PixelLayoutCount];
+    VerticalRowKernel vertical[PixelLayoutCount];
+    // fixed point, RGBA32 rows to the RGBA64 intermediate and wide ones
+    // from it back to RGBA32, plain for opaque and premultiplied pixels
+    HorizontalRowKernel fixed_horizontal[PixelLayoutCount];
+    VerticalRowKernel fixed_vertical[PixelLayoutCount];
+    HorizontalRowKernel fixed_plain_horizontal[PixelLayoutCount];
+    VerticalRowKernel fixed_plain_vertical[PixelLayoutCount];
+    HorizontalRowKernel fixed_wide_horizontal[PixelLayoutCount];
+    VerticalRowKernel fixed_wide_vertical[PixelLayoutCount];
+    HorizontalRowKernel fixed_wide_plain_horizontal[PixelLayoutCount];
+    VerticalRowKernel fixed_wide_plain_vertical[PixelLayoutCount];
+    HorizontalRowKernel float_horizontal[PixelLayoutCount];  // float engine
+    VerticalRowKernel float_vertical[PixelLayoutCount];
+    // float plain weighted sums, opaque and premultiplied
+    HorizontalRowKernel float_plain_horizontal[PixelLayoutCount];
+    VerticalRowKernel float_plain_vertical[PixelLayoutCount];
+    HorizontalRowKernel opaque_horizontal[PixelLayoutCount];  // alpha 255
+    VerticalRowKernel opaque_vertical[PixelLayoutCount];
+    HorizontalRowKernel premultiplied_horizontal[PixelLayoutCount];
+    VerticalRowKernel premultiplied_vertical[PixelLayoutCount];
+    // RGBA64 in OpacityLastPixelLayout, the linear light intermediate, NULL
+    // keeps the format kernels
+    HorizontalRowKernel wide_horizontal;
+    VerticalRowKernel wide_vertical;
+    HorizontalRowKernel wide_premultiplied_horizontal;
+    VerticalRowKernel wide_premultiplied_vertical;
+} ResizeKernels;
+
+/*
+    Defines horizontal##suffix and vertical##suffix, which call the force
+    inlined horizontal##Body and vertical##Body with constant orders so the
+    channel indices fold into the code.
+*/
+#define DefineOrderedRowKernels(storage, horizontal, vertical, suffix, order) \
+    storage void horizontal##suffix(                                          \
+        const ContributionTable *restrict table,                              \
+        const MagickPixelPacket4 *restrict p,                                 \
+        const MagickPixelOrder source_order,                                  \
+        MagickPixelPacket4 *restrict q,                                       \
+        const MagickPixelOrder destination_order) {                           \
+        ARG_NOT_USED(source_order);                                           \
+        ARG_NOT_USED(destination_order);                                      \
+        horizontal##Body(table, p, order, q, order);                          \
+    }                                                                         \
+    storage void vertical##suffix(                                            \
+        const ContributionTable *restrict table,                              \
+        const uint64_t y,                                                     \
+        const MagickPixelPacket4 *const *restrict rows,                       \
+        const MagickPixelOrder source_order,                                  \
+        MagickPixelPacket4 *restrict q,                                       \
+        const uint64_t columns,                                               \
+        const MagickPixelOrder destination_order) {                           \
+        ARG_NOT_USED(source_order);                                           \
+        ARG_NOT_USED(destination_order);                                      \
+        vertical##Body(table, y, rows, order, q, columns, order);             \
+    }
+
+/*
+    Row kernels of the engine for the running cpu, the pixel format and the
+    pixel orders. Rows of other formats than RGBA32 are passed as
+    MagickPixelPacket4 pointers to their first byte. alpha is resolved, not
+    DetectResizeAlpha: the opaque kernels of the double RGBA32 engine
+    normalize every window by its density instead of its alpha, the
+    premultiplied ones of every engine round the plain weighted sums. engine
+    is resolved as well, the fixed point kernels filter RGBA32 rows into
+    the RGBA64 intermediate and RGBA64 rows out of it.
+*/
+HorizontalRowKernel GetHorizontalRowKernel(
+    const ResizeEngineType engine,
+    const MagickPixelFormat format,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha);
+VerticalRowKernel GetVerticalRowKernel(
+    const ResizeEngineType engine,
+    const MagickPixelFormat format,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha);
+
+// Every alpha of the RGBA32 image is MaxRGB.
+bool IsOpaqueImage(const MagickImage *image);
+
+/*
+    Alpha mode of both passes of a resize of src, DetectResizeAlpha becomes
+    OpaqueResizeAlpha when the opaque kernels apply and src is opaque, else
+    MatteResizeAlpha. The linear RGBA64 intermediate of an opaque source
+    or one without alpha is filtered as PremultipliedResizeAlpha sums.
+*/
+ResizeAlphaMode GetResizeAlphaMode(const MagickImage *src,
+                                   const ResizeOptions *options);
+
+/*
+    options->linear_light applies to the 8 bit format of src: the passes
+    filter RGBA64 linear light in OpacityLastOrder, horizontal pass first.
+*/
+bool IsLinearResize(const MagickImage *src, const ResizeOptions *options);
+
+/*
+    Engine of the passes of a resize of src, options->engine unless the
+    fixed point engine does not apply: it only filters RGBA32 without
+    linear light, through an RGBA64 intermediate in the order of src.
+*/
+ResizeEngineType GetResizeEngine(const MagickImage *src,
+                                 const ResizeOptions *options);
+
+// Fast path of plan that keeps the result, the box average of linear light
+// and the reduced RGBA64 image of linear light are left to the filters.
+ResizeFastPath GetPlanFastPath(const ResizePlan *plan, const bool linear);
+
+/*
+    One filter pass split into bands of destination rows, each band is an
+    independent task so the result does not depend on the thread count.
+*/
+typedef struct _FilterPass {
+    const MagickImage *source;
+    const MagickImage *destination;
+    const ContributionTable *table;
+    HorizontalRowKernel horizontal;
+    VerticalRowKernel vertical;
+    bool is_horizontal;
+    // linear light, source and destination formats differ outside of the
+    // fixed point engine: the horizontal pass decodes each source row into
+    // linear_rows, the vertical pass filters into linear_rows and encodes
+    // them
+    bool linear;
+    MagickPixelPacket4 *linear_rows;  // one RGBA64 row per band
+    const MagickPixelPacket4 **rows;  // max_count row pointers per band
+    uint64_t band_rows;
+    uint64_t bands;
+} FilterPass;
+
+MagickPassFail PrepareFilterPass(FilterPass *pass,
+                                 const MagickImage *source,
+                                 const MagickImage *destination,
+                                 const ContributionTable *table,
+                                 const bool horizontal,
+                                 const ResizeEngineType engine,
+                                 const ResizeAlphaMode alpha,
+                                 MagickThreadPool *pool,
+                                 MagickArena *scratch);
+
+// Runs the bands of independent passes as one parallel-for.
+void RunFilterPasses(const FilterPass *passes,
+                     const uint64_t count,
+                     MagickThreadPool *pool);
+
+bool AllocateImage(MagickImage *image,
+                   const uint64_t columns,
+                   const uint64_t rows,
+                   const MagickPixelFormat format,
+                   const MagickPixelOrder order,
+                   MagickArena *arena);
+
+/*
+    Best vector kernels supported by the running cpu, NULL when there are
+    none. NULL members fall back to the scalar kernels. The environment
+    variable MAGICK_RESIZE_SIMD set to "scalar" or to the name of a
+    supported set ("sse2", "sse4.1", "avx2") picks that one instead.
+*/
+const ResizeKernels *GetSIMDResizeKernels(void);
+
+// Vector kernels of one instruction set, NULL when the cpu lacks it.
+const ResizeKernels *GetSIMDResizeKernelsByName(const char *name);
+
+// Scalar kernels, before the vector ones replace any member.
+const ResizeKernels *GetScalarResizeKernels(void);
+
+/*
+    filter at x, interpolated from its table like the weights of
+    ResizeOptions.tabulate_filters when tabulated is set and the filter has
+    one, else the analytic function.
+*/
+double GetFilterValue(const FilterTypes filter,
+                      const double x,
+                      const bool tabulated);
+
+/*
+    resize_fixed.c
+*/
+MagickPassFail BuildFixedContributionTable(ContributionTable *table,
+                                           MagickArena *arena);
+
+#define DeclareOrderedRowKernels(horizontal, vertical, suffix)             \
+    void horizontal##suffix(const ContributionTable *restrict table,      \
+                            const MagickPixelPacket4 *restrict p,         \
+                            const MagickPixelOrder source_order,          \
+                            MagickPixelPacket4 *restrict q,               \
+                            const MagickPixelOrder destination_order);    \
+    void vertical##suffix(const ContributionTable *restrict table,        \
+                          const uint64_t y,                               \
+                          const MagickPixelPacket4 *const *restrict rows, \
+                          const MagickPixelOrder source_order,            \
+                          MagickPixelPacket4 *restrict q,                 \
+                          const uint64_t columns,                         \
+                          const MagickPixelOrder destination_order);
+
+DeclareOrderedRowKernels(HorizontalFilterRowFixed, VerticalFilterRowFixed, )
+DeclareOrderedRowKernels(HorizontalFilterRowFixed,
+                         VerticalFilterRowFixed,
+                         OpacityLast)
+DeclareOrderedRowKernels(HorizontalFilterRowFixed,
+                         VerticalFilterRowFixed,
+                         OpacityFirst)
+DeclareOrderedRowKernels(HorizontalPlainFilterRowFixed,
+                         VerticalPlainFilterRowFixed, )
+DeclareOrderedRowKernels(HorizontalPlainFilterRowFixed,
+                         VerticalPlainFilterRowFixed,
+                         OpacityLast)
+DeclareOrderedRowKernels(HorizontalPlainFilterRowFixed,
+                         VerticalPlainFilterRowFixed,
+                         OpacityFirst)
+DeclareOrderedRowKernels(HorizontalWideFilterRowFixed,
+                         VerticalWideFilterRowFixed, )
+DeclareOrderedRowKernels(HorizontalWideFilterRowFixed,
+                         VerticalWideFilterRowFixed,
+                         OpacityLast)
+DeclareOrderedRowKernels(HorizontalWideFilterRowFixed,
+                         VerticalWideFilterRowFixed,
+                         OpacityFirst)
+DeclareOrderedRowKernels(HorizontalWidePlainFilterRowFixed,
+                         VerticalWidePlainFilterRowFixed, )
+DeclareOrderedRowKernels(HorizontalWidePlainFilterRowFixed,
+                         VerticalWidePlainFilterRowFixed,
+                         OpacityLast)
+DeclareOrderedRowKernels(HorizontalWidePlainFilterRowFixed,
+                         VerticalWidePlainFilterRowFixed,
+                         OpacityFirst)
+
+/*
+    resize_float.c
+*/
+MagickPassFail BuildFloatContributionTable(ContributionTable *table,
+                                           MagickArena *arena);
+
+DeclareOrderedRowKernels(HorizontalFilterRowFloat, VerticalFilterRowFloat, )
+DeclareOrderedRowKernels(HorizontalFilterRowFloat,
+                         VerticalFilterRowFloat,
+                         OpacityLast)
+DeclareOrderedRowKernels(HorizontalFilterRowFloat,
+                         VerticalFilterRowFloat,
+                         OpacityFirst)
+DeclareOrderedRowKernels(HorizontalPlainFilterRowFloat,
+                         VerticalPlainFilterRowFloat, )
+DeclareOrderedRowKernels(HorizontalPlainFilterRowFloat,
+                         VerticalPlainFilterRowFloat,
+                         OpacityLast)
+DeclareOrderedRowKernels(HorizontalPlainFilterRowFloat,
+                         VerticalPlainFilterRowFloat,
+                         OpacityFirst)
+
+/*
+    resize_format.c, double kernels of the formats other than RGBA32,
+    premultiplied selects plain weighted sums for the formats with alpha
+*/
+HorizontalRowKernel GetFormatHorizontalRowKernel(
+    const MagickPixelFormat format, const bool premultiplied);
+VerticalRowKernel GetFormatVerticalRowKernel(const MagickPixelFormat format,
+                                             const bool premultiplied);
+
+/*
+    resize_linear.c, 8 bit sRGB pixels of format to RGBA64 linear light in
+    OpacityLastOrder and back. Formats without alpha decode opaque, gray
+    decodes to three equal colors and encodes from red.
+*/
+void InitializeLinearLight(void);  // before the first row is converted
+
+void DecodeLinearRow(const MagickPixelFormat format,
+                     const MagickPixelOrder order,
+                     const MagickPixelPacket4 *restrict p,
+                     const uint64_t columns,
+                     MagickPixelPacket4 *restrict q);
+
+void EncodeLinearRow(const MagickPixelPacket4 *restrict p,
+                     const uint64_t columns,
+                     const MagickPixelFormat format,
+                     const MagickPixelOrder order,
+                     MagickPixelPacket4 *restrict q);
+
+/*
+    resize_fast.c
+*/
+#define MaxBoxAverageArea 32768  // keeps the uint32 sums from overflowing
+
+ResizeFastPath GetResizeFastPath(const uint64_t src_columns,
+                                 const uint64_t src_rows,
+                                 const uint64_t columns,
+                                 const uint64_t rows,
+                                 const FilterTypes filter,
+                                 const double blur);
+
+// premultiplied pixels are averaged and sampled without alpha weighting
+void RunResizeFastPath(const ResizeFastPath fast_path,
+                       const MagickImage *source,
+                       const MagickImage *destination,
+                       const bool premultiplied,
+                       MagickThreadPool *pool);
+
+/*
+    Averages 2x2 blocks of source into destination, whose lengths are
+    (length + 1) / 2 along the axes to halve and the source lengths along
+    the others, an odd last row or column is averaged with itself. Both
+    have the same order, except that an 8 bit source is decoded to linear
+    light first when destination is RGBA64 in OpacityLastOrder.
+*/
+MagickPassFail HalveImage(const MagickImage *source,
+                          const MagickImage *destination,
+                          const bool premultiplied,
+                          MagickThreadPool *pool,
+                          MagickArena *scratch);
+
+/*
+    Rounds the sums of the first fixed point pass, in source order and
+    scaled by 1 << bits, to the intermediate in destination order. The
+    colors of matte sums stay premultiplied and are kept below their alpha.
+    An alpha above the maximum scales them down, like the straight colors
+    of the double kernels, which are normalized by the unclamped alpha.
+*/
+static inline void SetFixedWidePixelPacket(
+    uint16_t *restrict q,
+    const int32_t *restrict pixel,
+    const int bits,
+    const bool matte,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order) {
+    const int channels[3] = {
+        source_order.red, source_order.green, source_order.blue};
+    const int targets[3] = {destination_order.red,
+                            destination_order.green,
+                            destination_order.blue};
+    const int32_t half = 1 << (bits - 1);
+    int32_t opacity = (pixel[source_order.opacity] + half) >> bits;
+    int32_t overshoot = matte && opacity > (int32_t)MaxFixedIntermediate
+                            ? opacity
+                            : 0;
+    opacity = Min(Max(opacity, 0), (int32_t)MaxFixedIntermediate);
+    const int32_t max = matte ? (opacity * (int32_t)MaxRGB) >> 8
+                              : (int32_t)MaxFixedIntermediate;
+    for (int k = 0; k < 3; k++) {
+        int32_t value = (pixel[channels[k]] + half) >> bits;
+        if (overshoot != 0) {
+            value = (int32_t)((int64_t)value * MaxFixedIntermediate /
+                              overshoot);
+        }
+        q[targets[k]] = (uint16_t)Min(Max(value, 0), max);
+    }
+    q[destination_order.opacity] = (uint16_t)opacity;
+}
+
+/*
+    Rounds the sums of the second fixed point pass to RGBA32. Premultiplied
+    matte colors are divided by their alpha with one float reciprocal.
+*/
+static inline void SetFixedPixelPacket(MagickQuantum *restrict q,
+                                       const int32_t *restrict pixel,
+                                       const int bits,
+                                       const bool matte,
+                                       const MagickPixelOrder source_order,
+                                       const MagickPixelOrder destination_order) {
+    const int channels[3] = {
+        source_order.red, source_order.green, source_order.blue};
+    const int targets[3] = {destination_order.red,
+                            destination_order.green,
+                            destination_order.blue};
+    const int shift = bits + FixedIntermediateShift;
+    const int32_t half = 1 << (shift - 1), alpha = pixel[source_order.opacity];
+    int32_t opacity = (alpha + half) >> shift;
+    SET_PIXEL_PACKET(
+        q,
+        destination_order.opacity,
+        (MagickQuantum)Min(Max(opacity, 0), (int32_t)MaxRGB));
+    if (!matte) {
+        for (int k = 0; k < 3; k++) {
+            int32_t value = (pixel[channels[k]] + half) >> shift;
+            SET_PIXEL_PACKET(q,
+                             targets[k],
+                             (MagickQuantum)Min(Max(value, 0),
+                                                (int32_t)MaxRGB));
+        }
+        return;
+    }
+    // like the double kernels, any alpha but 0 normalizes the colors
+    const float scale = alpha == 0 ? 0.0f : 256.0f / (float)alpha;
+    for (int k = 0; k < 3; k++) {
+        float value = (float)pixel[channels[k]] * scale;
+        value = Min(Max(value, 0.0f), MaxRGBFloat);
+        SET_PIXEL_PACKET(q, targets[k], (MagickQuantum)(value + 0.5f));
+    }
+}
+
+/*
+    Rounds the accumulated channels (in source byte order) of one pixel and
+    stores them in destination order, shared by all double kernels.
+*/
+static inline void SetDoublePixelPacket(MagickQuantum *restrict q,
+                                        const double *restrict pixel,
+                                        double normalize,
+                                        const MagickPixelOrder source_order,
+                                        const MagickPixelOrder destination_order) {
+    normalize = 1.0 / (AbsoluteValue(normalize) <= MagickEpsilon
+                           ? 1.0
+                           : normalize);
+    double red = pixel[source_order.red] * normalize;
+    double green = pixel[source_order.green] * normalize;
+    double blue = pixel[source_order.blue] * normalize;
+    double opacity = pixel[source_order.opacity];
+    SET_PIXEL_PACKET(q, destination_order.red, RoundDoubleToQuantum(red));
+    SET_PIXEL_PACKET(q, destination_order.green, RoundDoubleToQuantum(green));
+    SET_PIXEL_PACKET(q, destination_order.blue, RoundDoubleToQuantum(blue));
+    SET_PIXEL_PACKET(q,
+                     destination_order.opacity,
+                     (TransparentOpacity - RoundDoubleToQuantum(opacity)));
+}
+
+/*
+    Rounds the plain weighted sums of one premultiplied pixel, alpha in the
+    opacity channel like every other channel.
+*/
+static inline void SetPremultipliedPixelPacket(
+    MagickQuantum *restrict q,
+    const double *restrict pixel,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order) {
+    SET_PIXEL_PACKET(q,
+                     destination_order.red,
+                     RoundDoubleToQuantum(pixel[source_order.red]));
+    SET_PIXEL_PACKET(q,
+                     destination_order.green,
+                     RoundDoubleToQuantum(pixel[source_order.green]));
+    SET_PIXEL_PACKET(q,
+                     destination_order.blue,
+                     RoundDoubleToQuantum(pixel[source_order.blue]));
+    SET_PIXEL_PACKET(q,
+                     destination_order.opacity,
+                     RoundDoubleToQuantum(pixel[source_order.opacity]));
+}
+
+/*
+    Float versions of SetDoublePixelPacket and SetPremultipliedPixelPacket,
+    shared by all float kernels.
+*/
+static inline void SetFloatPixelPacket(MagickQuantum *restrict q,
+                                       const float *restrict pixel,
+                                       float normalize,
+                                       const MagickPixelOrder source_order,
+                                       const MagickPixelOrder destination_order) {
+    normalize = 1.0f / (AbsoluteValue(normalize) <= (float)MagickEpsilon
+                            ? 1.0f
+                            : normalize);
+    float red = pixel[source_order.red] * normalize;
+    float green = pixel[source_order.green] * normalize;
+    float blue = pixel[source_order.blue] * normalize;
+    float opacity = pixel[source_order.opacity];
+    SET_PIXEL_PACKET(q, destination_order.red, RoundFloatToQuantum(red));
+    SET_PIXEL_PACKET(q, destination_order.green, RoundFloatToQuantum(green));
+    SET_PIXEL_PACKET(q, destination_order.blue, RoundFloatToQuantum(blue));
+    SET_PIXEL_PACKET(q,
+                     destination_order.opacity,
+                     (TransparentOpacity - RoundFloatToQuantum(opacity)));
+}
+
+static inline void SetFloatPlainPixelPacket(
+    MagickQuantum *restrict q,
+    const float *restrict pixel,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order) {
+    SET_PIXEL_PACKET(q,
+                     destination_order.red,
+                     RoundFloatToQuantum(pixel[source_order.red]));
+    SET_PIXEL_PACKET(q,
+                     destination_order.green,
+                     RoundFloatToQuantum(pixel[source_order.green]));
+    SET_PIXEL_PACKET(q,
+                     destination_order.blue,
+                     RoundFloatToQuantum(pixel[source_order.blue]));
+    SET_PIXEL_PACKET(q,
+                     destination_order.opacity,
+                     RoundFloatToQuantum(pixel[source_order.opacity]));
+}
+
+#endif
@@ -0,0 +1,411 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "resize_private.h"
+#include "thread.h"
+
+#define CancelledResizeJob 16
+#define FullResizeQueue 32
+
+typedef enum {
+    QueuedJobState,
+    RunningJobState,
+    DoneJobState
+} ResizeJobState;
+
+struct _ResizeJob {
+    ResizeQueue *queue;
+    MagickImage src, dst;
+    FilterTypes filter;
+    double blur;
+    ResizeJobCallback callback;
+    void *data;
+    ResizeJobState state;
+    int status;
+    int worker;      // deque holding the job while queued
+    int references;  // the queue until done, and the caller's handle
+    ResizeJob *previous, *next;  // every job not freed yet
+};
+
+/*
+    Jobs queued for one worker in submission order, a ring of depth
+    entries since the queue never holds more.
+*/
+typedef struct _ResizeWorker {
+    ResizeQueue *queue;
+    MagickThread thread;
+    ResizeContext *context;
+    ResizeJob **jobs;
+    uint64_t head, count;
+    bool has_last;  // geometry of the last job, whose plan the context holds
+    uint64_t last_columns, last_rows, last_src_columns, last_src_rows;
+    FilterTypes last_filter;
+    double last_blur;
+} ResizeWorker;
+
+/*
+    One mutex guards every deque: jobs take milliseconds, so the lock is
+    never contended enough to pay for one per worker.
+*/
+struct _ResizeQueue {
+    MagickMutex mutex;
+    MagickCond work;   // a job was queued, or shutdown
+    MagickCond space;  // a queued job started or was cancelled
+    MagickCond done;   // a job is done
+    ResizeWorker *workers;
+    int count;    // workers with a context and a deque
+    int started;  // workers with a thread
+    uint64_t depth;
+    uint64_t pending;  // queued jobs of all workers
+    ResizeOptions options;
+    bool shutdown;
+    bool destroyed;  // only handles still held keep the queue
+    ResizeJob *jobs;
+};
+
+static ResizeJob *GetWorkerJob(const ResizeWorker *worker, const uint64_t i) {
+    return worker->jobs[(worker->head + i) % worker->queue->depth];
+}
+
+static void PushWorkerJob(ResizeWorker *worker, ResizeJob *job) {
+    const uint64_t depth = worker->queue->depth;
+    worker->jobs[(worker->head + worker->count++) % depth] = job;
+}
+
+static ResizeJob *PopWorkerJob(ResizeWorker *worker, const bool newest) {
+    ResizeJob *job;
+    if (newest) {
+        return GetWorkerJob(worker, --worker->count);
+    }
+    job = GetWorkerJob(worker, 0);
+    worker->head = (worker->head + 1) % worker->queue->depth;
+    worker->count--;
+    return job;
+}
+
+static void RemoveWorkerJob(ResizeWorker *worker, const ResizeJob *job) {
+    const uint64_t depth = worker->queue->depth;
+    uint64_t i = 0;
+    while (GetWorkerJob(worker, i) != job) i++;
+    for (; i + 1 < worker->count; i++) {
+        worker->jobs[(worker->head + i) % depth] =
+            GetWorkerJob(worker, i + 1);
+    }
+    worker->count--;
+}
+
+static bool HasJobGeometry(const ResizeWorker *worker, const ResizeJob *job) {
+    return worker->has_last && worker->last_columns == job->dst.columns &&
+           worker->last_rows == job->dst.rows &&
+           worker->last_src_columns == job->src.columns &&
+           worker->last_src_rows == job->src.rows &&
+           worker->last_filter == job->filter && worker->last_blur == job->blur;
+}
+
+/*
+    The worker with the fewest queued jobs, on a tie one whose context
+    already holds the plan of job.
+*/
+static ResizeWorker *AssignJob(ResizeQueue *queue, ResizeJob *job) {
+    ResizeWorker *worker = NULL;
+    uint64_t best = 0;
+    for (int i = 0; i < queue->count; i++) {
+        ResizeWorker *candidate = &queue->workers[i];
+        uint64_t score =
+            candidate->count * 2 + !HasJobGeometry(candidate, job);
+        if (worker == NULL || score < best) {
+            worker = candidate;
+            best = score;
+        }
+    }
+    job->worker = (int)(worker - queue->workers);
+    return worker;
+}
+
+static void SetJobGeometry(ResizeWorker *worker, const ResizeJob *job) {
+    worker->has_last = true;
+    worker->last_columns = job->dst.columns;
+    worker->last_rows = job->dst.rows;
+    worker->last_src_columns = job->src.columns;
+    worker->last_src_rows = job->src.rows;
+    worker->last_filter = job->filter;
+    worker->last_blur = job->blur;
+}
+
+/*
+    Oldest job of worker, else the newest job of the most loaded worker.
+*/
+static ResizeJob *TakeJob(ResizeQueue *queue, ResizeWorker *worker) {
+    ResizeWorker *victim = worker;
+    if (worker->count > 0) return PopWorkerJob(worker, false);
+    for (int i = 0; i < queue->count; i++) {
+        if (queue->workers[i].count > victim->count) {
+            victim = &queue->workers[i];
+        }
+    }
+    if (victim->count == 0) return NULL;
+    return PopWorkerJob(victim, true);
+}
+
+// Called with the queue mutex held.
+static void ReleaseJob(ResizeJob *job) {
+    ResizeQueue *queue = job->queue;
+    if (--job->references > 0) return;
+    if (job->previous != NULL) {
+        job->previous->next = job->next;
+    } else {
+        queue->jobs = job->next;
+    }
+    if (job->next != NULL) job->next->previous = job->previous;
+    free(job);
+}
+
+/*
+    Runs the callback and marks job done, called without the queue mutex.
+*/
+static void FinishJob(ResizeJob *job, const int status) {
+    ResizeQueue *queue = job->queue;
+    if (job->callback != NULL) job->callback(job->data, status);
+    MagickMutexLock(&queue->mutex);
+    job->status = status;
+    job->state = DoneJobState;
+    MagickCondBroadcast(&queue->done);
+    ReleaseJob(job);
+    MagickMutexUnlock(&queue->mutex);
+}
+
+static void ResizeQueueWorker(void *arg) {
+    ResizeWorker *worker = (ResizeWorker *)arg;
+    ResizeQueue *queue = worker->queue;
+    MagickMutexLock(&queue->mutex);
+    for (;;) {
+        ResizeJob *job = NULL;
+        while (!queue->shutdown && (job = TakeJob(queue, worker)) == NULL) {
+            MagickCondWait(&queue->work, &queue->mutex);
+        }
+        if (job == NULL) break;
+        SetJobGeometry(worker, job);
+        job->state = RunningJobState;
+        queue->pending--;
+        MagickCondSignal(&queue->space);
+        MagickMutexUnlock(&queue->mutex);
+        FinishJob(job,
+                  ResizeImageWithContext(worker->context,
+                                         &job->src,
+                                         &job->dst,
+                                         job->filter,
+                                         job->blur,
+                                         &queue->options));
+        MagickMutexLock(&queue->mutex);
+    }
+    MagickMutexUnlock(&queue->mutex);
+}
+
+ResizeQueue *CreateResizeQueue(const int workers,
+                               const uint64_t depth,
+                               const ResizeOptions *options) {
+    const int threads = workers > 0 ? workers : GetMagickCPUCount();
+    ResizeQueue *queue;
+
+    if (depth == 0) return NULL;
+    queue = (ResizeQueue *)malloc(sizeof(ResizeQueue));
+    if (queue == NULL) return NULL;
+    memset(queue, 0, sizeof(ResizeQueue));
+    if (!MagickMutexInit(&queue->mutex)) {
+        free(queue);
+        return NULL;
+    }
+    if (!MagickCondInit(&queue->work) || !MagickCondInit(&queue->space) ||
+        !MagickCondInit(&queue->done)) {
+        MagickMutexDestroy(&queue->mutex);
+        free(queue);
+        return NULL;
+    }
+    queue->depth = depth;
+    if (options != NULL) {
+        queue->options = *options;
+    } else {
+        GetResizeOptions(&queue->options);
+    }
+    queue->options.threads = 1;
+    queue->options.pool = NULL;
+    queue->options.stats = NULL;  // jobs run at once on every worker
+    queue->workers = (ResizeWorker *)calloc(threads, sizeof(ResizeWorker));
+    if (queue->workers == NULL) {
+        DestroyResizeQueue(queue);
+        return NULL;
+    }
+    // workers only start once all of them exist, since they steal
+    for (int i = 0; i < threads; i++) {
+        ResizeWorker *worker = &queue->workers[i];
+        worker->queue = queue;
+        worker->context = CreateResizeContext();
+        worker->jobs = (ResizeJob **)malloc(depth * sizeof(ResizeJob *));
+        if (worker->context == NULL || worker->jobs == NULL) {
+            DestroyResizeContext(worker->context);
+            free(worker->jobs);
+            DestroyResizeQueue(queue);
+            return NULL;
+        }
+        queue->count++;
+    }
+    for (int i = 0; i < threads; i++) {
+        if (!MagickThreadCreate(&queue->workers[i].thread,
+                                ResizeQueueWorker,
+                                (void *)&queue->workers[i])) {
+            DestroyResizeQueue(queue);
+            return NULL;
+        }
+        queue->started++;
+    }
+    return queue;
+}
+
+int SubmitResizeJob(ResizeQueue *queue,
+                    const MagickImage *src,
+                    const MagickImage *dst,
+                    const FilterTypes filter,
+                    const double blur,
+                    ResizeJobCallback callback,
+                    void *data,
+                    const ResizeSubmitFlags flags,
+                    ResizeJob **job) {
+    ResizeJob *entry;
+
+    if (job != NULL) *job = NULL;
+    if (src->columns == 0 || src->rows == 0 || dst->columns == 0 ||
+        dst->rows == 0 || !IsValidImageLayout(src) ||
+        !IsValidImageLayout(dst) || src->format != dst->format) {
+        return 1;
+    }
+    entry = (ResizeJob *)malloc(sizeof(ResizeJob));
+    if (entry == NULL) return 2;
+    entry->queue = queue;
+    entry->src = *src;
+    entry->dst = *dst;
+    entry->filter = filter;
+    entry->blur = blur;
+    entry->callback = callback;
+    entry->data = data;
+    entry->state = QueuedJobState;
+    entry->status = -1;
+    entry->references = job != NULL ? 2 : 1;
+    entry->previous = NULL;
+
+    MagickMutexLock(&queue->mutex);
+    while (queue->pending == queue->depth) {
+        if (flags & NoWaitResizeSubmit) {
+            MagickMutexUnlock(&queue->mutex);
+            free(entry);
+            return FullResizeQueue;
+        }
+        MagickCondWait(&queue->space, &queue->mutex);
+    }
+    entry->next = queue->jobs;
+    if (queue->jobs != NULL) queue->jobs->previous = entry;
+    queue->jobs = entry;
+    PushWorkerJob(AssignJob(queue, entry), entry);
+    queue->pending++;
+    // every worker may be waiting, the owner or a thief has to wake up
+    MagickCondBroadcast(&queue->work);
+    MagickMutexUnlock(&queue->mutex);
+    if (job != NULL) *job = entry;
+    return 0;
+}
+
+int GetResizeJobStatus(const ResizeJob *job) {
+    int status;
+    MagickMutexLock(&job->queue->mutex);
+    status = job->state == DoneJobState ? job->status : -1;
+    MagickMutexUnlock(&job->queue->mutex);
+    return status;
+}
+
+int WaitResizeJob(const ResizeJob *job) {
+    ResizeQueue *queue = job->queue;
+    MagickMutexLock(&queue->mutex);
+    while (job->state != DoneJobState) {
+        MagickCondWait(&queue->done, &queue->mutex);
+    }
+    MagickMutexUnlock(&queue->mutex);
+    return job->status;
+}
+
+bool CancelResizeJob(ResizeJob *job) {
+    ResizeQueue *queue = job->queue;
+    MagickMutexLock(&queue->mutex);
+    if (job->state != QueuedJobState) {
+        MagickMutexUnlock(&queue->mutex);
+        return false;
+    }
+    RemoveWorkerJob(&queue->workers[job->worker], job);
+    job->state = RunningJobState;
+    queue->pending--;
+    MagickCondSignal(&queue->space);
+    MagickMutexUnlock(&queue->mutex);
+    FinishJob(job, CancelledResizeJob);
+    return true;
+}
+
+static void FreeResizeQueue(ResizeQueue *queue) {
+    MagickCondDestroy(&queue->work);
+    MagickCondDestroy(&queue->space);
+    MagickCondDestroy(&queue->done);
+    MagickMutexDestroy(&queue->mutex);
+    free(queue);
+}
+
+void ReleaseResizeJob(ResizeJob *job) {
+    ResizeQueue *queue;
+    bool last;
+    if (job == NULL) return;
+    queue = job->queue;
+    MagickMutexLock(&queue->mutex);
+    ReleaseJob(job);
+    last = queue->destroyed && queue->jobs == NULL;
+    MagickMutexUnlock(&queue->mutex);
+    if (last) FreeResizeQueue(queue);
+}
+
+void DestroyResizeQueue(ResizeQueue *queue) {
+    ResizeJob *job;
+    bool last;
+    if (queue == NULL) return;
+    MagickMutexLock(&queue->mutex);
+    queue->shutdown = true;
+    MagickCondBroadcast(&queue->work);
+    MagickMutexUnlock(&queue->mutex);
+    // workers take no job once shutdown is set
+    for (;;) {
+        job = NULL;
+        MagickMutexLock(&queue->mutex);
+        for (int i = 0; i < queue->count && job == NULL; i++) {
+            if (queue->workers[i].count > 0) {
+                job = GetWorkerJob(&queue->workers[i], 0);
+            }
+        }
+        MagickMutexUnlock(&queue->mutex);
+        if (job == NULL) break;
+        CancelResizeJob(job);
+    }
+    for (int i = 0; i < queue->started; i++) {
+        MagickThreadJoin(queue->workers[i].thread);
+    }
+    for (int i = 0; i < queue->count; i++) {
+        DestroyResizeContext(queue->workers[i].context);
+        free(queue->workers[i].jobs);
+    }
+    free(queue->workers);
+    queue->workers = NULL;
+    queue->count = 0;
+    /*
+        Every job is done and the queue dropped its references, the jobs
+        left belong to handles not released yet: the last release frees
+        the queue.
+    */
+    MagickMutexLock(&queue->mutex);
+    queue->destroyed = true;
+    last = queue->jobs == NULL;
+    MagickMutexUnlock(&queue->mutex);
+    if (last) FreeResizeQueue(queue);
+}
@@ -0,0 +1,2076 @@
+#include "resize_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    x86 vector versions of the double kernels. A pixel is loaded as four
+    lanes in source byte order; the opacity lane is inverted with a xor
+    (255 - alpha == alpha ^ 255) and weighted by the plain weight while the
+    color lanes are weighted by the transparency coefficient. Every lane
+    does exactly the additions and multiplications of the scalar kernel, so
+    the results are byte-identical. The opaque and premultiplied kernels
+    weight every lane of the untouched pixel by the plain weight, the opaque
+    ones clear the opacity lane before the store.
+*/
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+#define MAGICK_HAVE_X86
+#endif
+
+#ifdef MAGICK_HAVE_X86
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define MAGICK_TARGET(isa)
+#else
+#include <cpuid.h>
+#define MAGICK_TARGET(isa) __attribute__((target(isa)))
+#endif
+#include <immintrin.h>
+
+static inline int LoadPixelPacket(const MagickQuantum *pixel) {
+    int value;
+    memcpy(&value, pixel, sizeof(value));
+    return value;
+}
+
+/*
+    SSE2: the four lanes are held in two registers of two doubles.
+*/
+typedef struct _SSE2Lanes {
+    __m128d mask_low, mask_high;  // all ones in the opacity lane
+    __m128i invert;               // 0xff in the opacity byte
+} SSE2Lanes;
+
+MAGICK_TARGET("sse2")
+static inline SSE2Lanes GetSSE2Lanes(const int opacity) {
+    SSE2Lanes lanes;
+    int64_t mask[4] = {0, 0, 0, 0};
+    mask[opacity] = -1;
+    lanes.mask_low = _mm_castsi128_pd(_mm_set_epi64x(mask[1], mask[0]));
+    lanes.mask_high = _mm_castsi128_pd(_mm_set_epi64x(mask[3], mask[2]));
+    lanes.invert = _mm_cvtsi32_si128((int)(0xffU << (8 * opacity)));
+    return lanes;
+}
+
+MAGICK_TARGET("sse2")
+static inline void AccumulateSSE2(__m128d *restrict low,
+                                  __m128d *restrict high,
+                                  const SSE2Lanes *restrict lanes,
+                                  const MagickQuantum *restrict pixel,
+                                  const double weight,
+                                  const double transparency_coeff) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i bytes =
+        _mm_xor_si128(_mm_cvtsi32_si128(LoadPixelPacket(pixel)), lanes->invert);
+    __m128i words = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+    __m128d value_low = _mm_cvtepi32_pd(words);
+    __m128d value_high =
+        _mm_cvtepi32_pd(_mm_shuffle_epi32(words, _MM_SHUFFLE(1, 0, 3, 2)));
+    __m128d w = _mm_set1_pd(weight);
+    __m128d t = _mm_set1_pd(transparency_coeff);
+    __m128d coeff_low = _mm_or_pd(_mm_and_pd(lanes->mask_low, w),
+                                  _mm_andnot_pd(lanes->mask_low, t));
+    __m128d coeff_high = _mm_or_pd(_mm_and_pd(lanes->mask_high, w),
+                                   _mm_andnot_pd(lanes->mask_high, t));
+    *low = _mm_add_pd(*low, _mm_mul_pd(coeff_low, value_low));
+    *high = _mm_add_pd(*high, _mm_mul_pd(coeff_high, value_high));
+}
+
+MAGICK_TARGET("sse2")
+static inline void AccumulatePlainSSE2(__m128d *restrict low,
+                                       __m128d *restrict high,
+                                       const MagickQuantum *restrict pixel,
+                                       const double weight) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i bytes = _mm_cvtsi32_si128(LoadPixelPacket(pixel));
+    __m128i words = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+    __m128d w = _mm_set1_pd(weight);
+    *low = _mm_add_pd(*low, _mm_mul_pd(w, _mm_cvtepi32_pd(words)));
+    *high = _mm_add_pd(
+        *high,
+        _mm_mul_pd(w,
+                   _mm_cvtepi32_pd(
+                       _mm_shuffle_epi32(words, _MM_SHUFFLE(1, 0, 3, 2)))));
+}
+
+MAGICK_TARGET("sse2")
+MAGICK_FORCE_INLINE void AccumulateTapSSE2(__m128d *restrict low,
+                                           __m128d *restrict high,
+                                           const SSE2Lanes *restrict lanes,
+                                           const MagickQuantum *restrict pixel,
+                                           const double weight,
+                                           const int opacity,
+                                           const ResizeAlphaMode alpha,
+                                           double *restrict normalize) {
+    if (alpha != MatteResizeAlpha) {
+        AccumulatePlainSSE2(low, high, pixel, weight);
+        return;
+    }
+    double transparency_coeff =
+        weight * MagickTransparencyTable[pixel[opacity]];
+    AccumulateSSE2(low, high, lanes, pixel, weight, transparency_coeff);
+    *normalize += transparency_coeff;
+}
+
+MAGICK_TARGET("sse2")
+MAGICK_FORCE_INLINE void SetPixelSSE2(MagickQuantum *restrict q,
+                                      const __m128d low,
+                                      const __m128d high,
+                                      const double normalize,
+                                      const MagickPixelOrder source_order,
+                                      const MagickPixelOrder destination_order,
+                                      const ResizeAlphaMode alpha) {
+    double pixel[4];
+    _mm_storeu_pd(pixel, low);
+    _mm_storeu_pd(pixel + 2, high);
+    if (alpha == PremultipliedResizeAlpha) {
+        SetPremultipliedPixelPacket(q, pixel, source_order, destination_order);
+        return;
+    }
+    if (alpha == OpaqueResizeAlpha) pixel[source_order.opacity] = 0.0;
+    SetDoublePixelPacket(q, pixel, normalize, source_order, destination_order);
+}
+
+MAGICK_TARGET("sse2")
+MAGICK_FORCE_INLINE void HorizontalFilterPixelsSSE2(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    const SSE2Lanes lanes = GetSSE2Lanes(source_order.opacity);
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const double *restrict weights = table->weights + window->offset;
+        const MagickPixelPacket4 *restrict pixels = p + window->start;
+        __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+        double normalize =
+            alpha == OpaqueResizeAlpha ? table->densities[x] : 0.0;
+        for (int64_t i = 0; i < window->count; i++) {
+            AccumulateTapSSE2(&low,
+                              &high,
+                              &lanes,
+                              pixels[i],
+                              weights[i],
+                              source_order.opacity,
+                              alpha,
+                              &normalize);
+        }
+        SetPixelSSE2(q[x],
+                     low,
+                     high,
+                     normalize,
+                     source_order,
+                     destination_order,
+                     alpha);
+    }
+}
+
+MAGICK_TARGET("sse2")
+MAGICK_FORCE_INLINE void VerticalFilterPixelsSSE2(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    const ContributionWindow *window = &table->windows[y];
+    const double *restrict weights = table->weights + window->offset;
+    const SSE2Lanes lanes = GetSSE2Lanes(source_order.opacity);
+    for (uint64_t x = 0; x < columns; x++) {
+        __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+        double normalize =
+            alpha == OpaqueResizeAlpha ? table->densities[y] : 0.0;
+        for (int64_t i = 0; i < window->count; i++) {
+            AccumulateTapSSE2(&low,
+                              &high,
+                              &lanes,
+                              rows[i][x],
+                              weights[i],
+                              source_order.opacity,
+                              alpha,
+                              &normalize);
+        }
+        SetPixelSSE2(q[x],
+                     low,
+                     high,
+                     normalize,
+                     source_order,
+                     destination_order,
+                     alpha);
+    }
+}
+
+/*
+    SSE4.1: zero extension and blends are single instructions, and the
+    stores round all lanes at once like the AVX2 ones below.
+*/
+typedef struct _SSE41Lanes {
+    SSE2Lanes lanes;
+    __m128i shuffle;  // source byte order to destination byte order
+} SSE41Lanes;
+
+static inline __m128i GetPixelShuffle(const MagickPixelOrder source_order,
+                                      const MagickPixelOrder destination_order) {
+    int8_t shuffle[16];
+    memset(shuffle, -1, sizeof(shuffle));
+    shuffle[destination_order.red] = (int8_t)source_order.red;
+    shuffle[destination_order.green] = (int8_t)source_order.green;
+    shuffle[destination_order.blue] = (int8_t)source_order.blue;
+    shuffle[destination_order.opacity] = (int8_t)source_order.opacity;
+    return _mm_loadu_si128((const __m128i *)shuffle);
+}
+
+MAGICK_TARGET("sse4.1")
+static inline SSE41Lanes GetSSE41Lanes(
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order) {
+    SSE41Lanes lanes;
+    lanes.lanes = GetSSE2Lanes(source_order.opacity);
+    lanes.shuffle = GetPixelShuffle(source_order, destination_order);
+    return lanes;
+}
+
+MAGICK_TARGET("sse4.1")
+static inline void AccumulateSSE41(__m128d *restrict low,
+                                   __m128d *restrict high,
+                                   const SSE2Lanes *restrict lanes,
+                                   const MagickQuantum *restrict pixel,
+                                   const double weight,
+                                   const double transparency_coeff) {
+    __m128i words = _mm_cvtepu8_epi32(
+        _mm_xor_si128(_mm_cvtsi32_si128(LoadPixelPacket(pixel)), lanes->invert));
+    __m128d value_low = _mm_cvtepi32_pd(words);
+    __m128d value_high =
+        _mm_cvtepi32_pd(_mm_shuffle_epi32(words, _MM_SHUFFLE(1, 0, 3, 2)));
+    __m128d w = _mm_set1_pd(weight);
+    __m128d t = _mm_set1_pd(transparency_coeff);
+    *low = _mm_add_pd(*low,
+                      _mm_mul_pd(_mm_blendv_pd(t, w, lanes->mask_low), value_low));
+    *high = _mm_add_pd(
+        *high, _mm_mul_pd(_mm_blendv_pd(t, w, lanes->mask_high), value_high));
+}
+
+MAGICK_TARGET("sse4.1")
+static inline void AccumulatePlainSSE41(__m128d *restrict low,
+                                        __m128d *restrict high,
+                                        const MagickQuantum *restrict pixel,
+                                        const double weight) {
+    __m128i words =
+        _mm_cvtepu8_epi32(_mm_cvtsi32_si128(LoadPixelPacket(pixel)));
+    __m128d w = _mm_set1_pd(weight);
+    *low = _mm_add_pd(*low, _mm_mul_pd(w, _mm_cvtepi32_pd(words)));
+    *high = _mm_add_pd(
+        *high,
+        _mm_mul_pd(w,
+                   _mm_cvtepi32_pd(
+                       _mm_shuffle_epi32(words, _MM_SHUFFLE(1, 0, 3, 2)))));
+}
+
+/*
+    SetDoublePixelPacket on all lanes: clamping to [0, MaxRGB] before
+    adding 0.5 and truncating is RoundDoubleToQuantum.
+*/
+MAGICK_TARGET("sse4.1")
+static inline __m128i RoundDoubleToQuantumSSE41(__m128d value) {
+    value = _mm_min_pd(_mm_max_pd(value, _mm_setzero_pd()),
+                       _mm_set1_pd(MaxRGBDouble));
+    return _mm_cvttpd_epi32(_mm_add_pd(value, _mm_set1_pd(0.5)));
+}
+
+MAGICK_TARGET("sse4.1")
+static inline void SetDoublePixelPacketSSE41(MagickQuantum *restrict q,
+                                             const __m128d low,
+                                             const __m128d high,
+                                             double normalize,
+                                             const SSE41Lanes *restrict lanes) {
+    normalize = 1.0 / (AbsoluteValue(normalize) <= MagickEpsilon
+                           ? 1.0
+                           : normalize);
+    __m128d scale = _mm_set1_pd(normalize), one = _mm_set1_pd(1.0);
+    __m128i words = _mm_unpacklo_epi64(
+        RoundDoubleToQuantumSSE41(_mm_mul_pd(
+            low, _mm_blendv_pd(scale, one, lanes->lanes.mask_low))),
+        RoundDoubleToQuantumSSE41(_mm_mul_pd(
+            high, _mm_blendv_pd(scale, one, lanes->lanes.mask_high))));
+    __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(words, words), words);
+    bytes = _mm_shuffle_epi8(_mm_xor_si128(bytes, lanes->lanes.invert),
+                             lanes->shuffle);
+    int packet = _mm_cvtsi128_si32(bytes);
+    memcpy(q, &packet, sizeof(packet));
+}
+
+// Rounds all lanes of a premultiplied pixel, no normalize and no inversion.
+MAGICK_TARGET("sse4.1")
+static inline void SetPremultipliedPixelPacketSSE41(
+    MagickQuantum *restrict q,
+    const __m128d low,
+    const __m128d high,
+    const SSE41Lanes *restrict lanes) {
+    __m128i words = _mm_unpacklo_epi64(RoundDoubleToQuantumSSE41(low),
+                                       RoundDoubleToQuantumSSE41(high));
+    __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(words, words), words);
+    bytes = _mm_shuffle_epi8(bytes, lanes->shuffle);
+    int packet = _mm_cvtsi128_si32(bytes);
+    memcpy(q, &packet, sizeof(packet));
+}
+
+/*
+    Stores one pixel of the mode of the kernel, the opaque ones drop the
+    opacity lane that the plain weights accumulated.
+*/
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE void SetPixelSSE41(MagickQuantum *restrict q,
+                                       __m128d low,
+                                       __m128d high,
+                                       const double normalize,
+                                       const SSE41Lanes *restrict lanes,
+                                       const ResizeAlphaMode alpha) {
+    if (alpha == PremultipliedResizeAlpha) {
+        SetPremultipliedPixelPacketSSE41(q, low, high, lanes);
+        return;
+    }
+    if (alpha == OpaqueResizeAlpha) {
+        low = _mm_andnot_pd(lanes->lanes.mask_low, low);
+        high = _mm_andnot_pd(lanes->lanes.mask_high, high);
+    }
+    SetDoublePixelPacketSSE41(q, low, high, normalize, lanes);
+}
+
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE void AccumulateWindowSSE41(
+    __m128d *restrict low,
+    __m128d *restrict high,
+    const SSE2Lanes *restrict lanes,
+    const MagickPixelPacket4 *restrict pixels,
+    const double *restrict weights,
+    const int64_t count,
+    const int opacity,
+    const ResizeAlphaMode alpha,
+    double *restrict normalize) {
+    for (int64_t i = 0; i < count; i++) {
+        if (alpha != MatteResizeAlpha) {
+            AccumulatePlainSSE41(low, high, pixels[i], weights[i]);
+            continue;
+        }
+        double transparency_coeff =
+            weights[i] * MagickTransparencyTable[pixels[i][opacity]];
+        AccumulateSSE41(
+            low, high, lanes, pixels[i], weights[i], transparency_coeff);
+        *normalize += transparency_coeff;
+    }
+}
+
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE void HorizontalFilterPixelsSSE41(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    const SSE41Lanes lanes = GetSSE41Lanes(source_order, destination_order);
+    const int o = source_order.opacity;
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const double *restrict weights = table->weights + window->offset;
+        const MagickPixelPacket4 *restrict pixels = p + window->start;
+        __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+        double normalize =
+            alpha == OpaqueResizeAlpha ? table->densities[x] : 0.0;
+        switch (window->count) {
+            case 2:
+                AccumulateWindowSSE41(&low,
+                                      &high,
+                                      &lanes.lanes,
+                                      pixels,
+                                      weights,
+                                      2,
+                                      o,
+                                      alpha,
+                                      &normalize);
+                break;
+            case 4:
+                AccumulateWindowSSE41(&low,
+                                      &high,
+                                      &lanes.lanes,
+                                      pixels,
+                                      weights,
+                                      4,
+                                      o,
+                                      alpha,
+                                      &normalize);
+                break;
+            case 6:
+                AccumulateWindowSSE41(&low,
+                                      &high,
+                                      &lanes.lanes,
+                                      pixels,
+                                      weights,
+                                      6,
+                                      o,
+                                      alpha,
+                                      &normalize);
+                break;
+            default:
+                AccumulateWindowSSE41(&low,
+                                      &high,
+                                      &lanes.lanes,
+                                      pixels,
+                                      weights,
+                                      window->count,
+                                      o,
+                                      alpha,
+                                      &normalize);
+                break;
+        }
+        SetPixelSSE41(q[x], low, high, normalize, &lanes, alpha);
+    }
+}
+
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE void VerticalFilterColumnsSSE41(
+    const SSE41Lanes *restrict lanes,
+    const double *restrict weights,
+    const int64_t count,
+    const double density,
+    const MagickPixelPacket4 *const *restrict rows,
+    const int opacity,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const ResizeAlphaMode alpha) {
+    for (uint64_t x = 0; x < columns; x++) {
+        __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+        double normalize = alpha == OpaqueResizeAlpha ? density : 0.0;
+        for (int64_t i = 0; i < count; i++) {
+            const MagickQuantum *restrict s = rows[i][x];
+            if (alpha != MatteResizeAlpha) {
+                AccumulatePlainSSE41(&low, &high, s, weights[i]);
+                continue;
+            }
+            double transparency_coeff =
+                weights[i] * MagickTransparencyTable[s[opacity]];
+            AccumulateSSE41(
+                &low, &high, &lanes->lanes, s, weights[i], transparency_coeff);
+            normalize += transparency_coeff;
+        }
+        SetPixelSSE41(q[x], low, high, normalize, lanes, alpha);
+    }
+}
+
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE void VerticalFilterPixelsSSE41(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    const ContributionWindow *window = &table->windows[y];
+    const double *restrict weights = table->weights + window->offset;
+    const double density = table->densities[y];
+    const SSE41Lanes lanes = GetSSE41Lanes(source_order, destination_order);
+    const int o = source_order.opacity;
+    switch (window->count) {
+        case 2:
+            VerticalFilterColumnsSSE41(
+                &lanes, weights, 2, density, rows, o, q, columns, alpha);
+            break;
+        case 4:
+            VerticalFilterColumnsSSE41(
+                &lanes, weights, 4, density, rows, o, q, columns, alpha);
+            break;
+        case 6:
+            VerticalFilterColumnsSSE41(
+                &lanes, weights, 6, density, rows, o, q, columns, alpha);
+            break;
+        default:
+            VerticalFilterColumnsSSE41(&lanes,
+                                       weights,
+                                       window->count,
+                                       density,
+                                       rows,
+                                       o,
+                                       q,
+                                       columns,
+                                       alpha);
+            break;
+    }
+}
+
+/*
+    AVX2: all four lanes fit in one register. The stores round all four
+    lanes at once and move them to destination order with a byte shuffle,
+    and the common tap counts get fully unrolled accumulation loops.
+*/
+typedef struct _AVX2Lanes {
+    __m256d mask;
+    __m128i invert;
+    __m128i shuffle;  // source byte order to destination byte order
+} AVX2Lanes;
+
+MAGICK_TARGET("avx2")
+static inline AVX2Lanes GetAVX2Lanes(const MagickPixelOrder source_order,
+                                     const MagickPixelOrder destination_order) {
+    AVX2Lanes lanes;
+    int64_t mask[4] = {0, 0, 0, 0};
+    mask[source_order.opacity] = -1;
+    lanes.mask = _mm256_castsi256_pd(
+        _mm256_set_epi64x(mask[3], mask[2], mask[1], mask[0]));
+    lanes.invert =
+        _mm_cvtsi32_si128((int)(0xffU << (8 * source_order.opacity)));
+    lanes.shuffle = GetPixelShuffle(source_order, destination_order);
+    return lanes;
+}
+
+MAGICK_TARGET("avx2")
+static inline __m256d AccumulateAVX2(const __m256d sum,
+                                     const AVX2Lanes *restrict lanes,
+                                     const MagickQuantum *restrict pixel,
+                                     const double weight,
+                                     const double transparency_coeff) {
+    __m256d value = _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(
+        _mm_xor_si128(_mm_cvtsi32_si128(LoadPixelPacket(pixel)), lanes->invert)));
+    __m256d coeff = _mm256_blendv_pd(_mm256_set1_pd(transparency_coeff),
+                                     _mm256_set1_pd(weight),
+                                     lanes->mask);
+    return _mm256_add_pd(sum, _mm256_mul_pd(coeff, value));
+}
+
+MAGICK_TARGET("avx2")
+static inline __m256d AccumulatePlainAVX2(const __m256d sum,
+                                          const MagickQuantum *restrict pixel,
+                                          const double weight) {
+    __m256d value = _mm256_cvtepi32_pd(
+        _mm_cvtepu8_epi32(_mm_cvtsi32_si128(LoadPixelPacket(pixel))));
+    return _mm256_add_pd(sum, _mm256_mul_pd(_mm256_set1_pd(weight), value));
+}
+
+/*
+    SetDoublePixelPacket on all lanes: clamping to [0, MaxRGB] before
+    adding 0.5 and truncating is RoundDoubleToQuantum.
+*/
+MAGICK_TARGET("avx2")
+static inline void SetDoublePixelPacketAVX2(MagickQuantum *restrict q,
+                                            const __m256d sum,
+                                            double normalize,
+                                            const AVX2Lanes *restrict lanes) {
+    normalize = 1.0 / (AbsoluteValue(normalize) <= MagickEpsilon
+                           ? 1.0
+                           : normalize);
+    __m256d value = _mm256_mul_pd(
+        sum,
+        _mm256_blendv_pd(
+            _mm256_set1_pd(normalize), _mm256_set1_pd(1.0), lanes->mask));
+    value = _mm256_min_pd(_mm256_max_pd(value, _mm256_setzero_pd()),
+                          _mm256_set1_pd(MaxRGBDouble));
+    __m128i words =
+        _mm256_cvttpd_epi32(_mm256_add_pd(value, _mm256_set1_pd(0.5)));
+    __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(words, words), words);
+    bytes = _mm_shuffle_epi8(_mm_xor_si128(bytes, lanes->invert),
+                             lanes->shuffle);
+    int packet = _mm_cvtsi128_si32(bytes);
+    memcpy(q, &packet, sizeof(packet));
+}
+
+// Rounds all lanes of a premultiplied pixel, no normalize and no inversion.
+MAGICK_TARGET("avx2")
+static inline void SetPremultipliedPixelPacketAVX2(
+    MagickQuantum *restrict q,
+    __m256d value,
+    const AVX2Lanes *restrict lanes) {
+    value = _mm256_min_pd(_mm256_max_pd(value, _mm256_setzero_pd()),
+                          _mm256_set1_pd(MaxRGBDouble));
+    __m128i words =
+        _mm256_cvttpd_epi32(_mm256_add_pd(value, _mm256_set1_pd(0.5)));
+    __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(words, words), words);
+    bytes = _mm_shuffle_epi8(bytes, lanes->shuffle);
+    int packet = _mm_cvtsi128_si32(bytes);
+    memcpy(q, &packet, sizeof(packet));
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void SetPixelAVX2(MagickQuantum *restrict q,
+                                      __m256d sum,
+                                      const double normalize,
+                                      const AVX2Lanes *restrict lanes,
+                                      const ResizeAlphaMode alpha) {
+    if (alpha == PremultipliedResizeAlpha) {
+        SetPremultipliedPixelPacketAVX2(q, sum, lanes);
+        return;
+    }
+    if (alpha == OpaqueResizeAlpha) sum = _mm256_andnot_pd(lanes->mask, sum);
+    SetDoublePixelPacketAVX2(q, sum, normalize, lanes);
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE __m256d AccumulateWindowAVX2(
+    const AVX2Lanes *restrict lanes,
+    const MagickPixelPacket4 *restrict pixels,
+    const double *restrict weights,
+    const int64_t count,
+    const int opacity,
+    const ResizeAlphaMode alpha,
+    double *restrict normalize) {
+    __m256d sum = _mm256_setzero_pd();
+    for (int64_t i = 0; i < count; i++) {
+        if (alpha != MatteResizeAlpha) {
+            sum = AccumulatePlainAVX2(sum, pixels[i], weights[i]);
+            continue;
+        }
+        double transparency_coeff =
+            weights[i] * MagickTransparencyTable[pixels[i][opacity]];
+        sum = AccumulateAVX2(
+            sum, lanes, pixels[i], weights[i], transparency_coeff);
+        *normalize += transparency_coeff;
+    }
+    return sum;
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void HorizontalFilterPixelsAVX2(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    const AVX2Lanes lanes = GetAVX2Lanes(source_order, destination_order);
+    const int o = source_order.opacity;
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const double *restrict weights = table->weights + window->offset;
+        const MagickPixelPacket4 *restrict pixels = p + window->start;
+        __m256d sum;
+        double normalize =
+            alpha == OpaqueResizeAlpha ? table->densities[x] : 0.0;
+        switch (window->count) {
+            case 2:
+                sum = AccumulateWindowAVX2(
+                    &lanes, pixels, weights, 2, o, alpha, &normalize);
+                break;
+            case 4:
+                sum = AccumulateWindowAVX2(
+                    &lanes, pixels, weights, 4, o, alpha, &normalize);
+                break;
+            case 6:
+                sum = AccumulateWindowAVX2(
+                    &lanes, pixels, weights, 6, o, alpha, &normalize);
+                break;
+            default:
+                sum = AccumulateWindowAVX2(&lanes,
+                                           pixels,
+                                           weights,
+                                           window->count,
+                                           o,
+                                           alpha,
+                                           &normalize);
+                break;
+        }
+        SetPixelAVX2(q[x], sum, normalize, &lanes, alpha);
+    }
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void VerticalFilterColumnsAVX2(
+    const AVX2Lanes *restrict lanes,
+    const double *restrict weights,
+    const int64_t count,
+    const double density,
+    const MagickPixelPacket4 *const *restrict rows,
+    const int opacity,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const ResizeAlphaMode alpha) {
+    for (uint64_t x = 0; x < columns; x++) {
+        __m256d sum = _mm256_setzero_pd();
+        double normalize = alpha == OpaqueResizeAlpha ? density : 0.0;
+        for (int64_t i = 0; i < count; i++) {
+            const MagickQuantum *restrict s = rows[i][x];
+            if (alpha != MatteResizeAlpha) {
+                sum = AccumulatePlainAVX2(sum, s, weights[i]);
+                continue;
+            }
+            double transparency_coeff =
+                weights[i] * MagickTransparencyTable[s[opacity]];
+            sum = AccumulateAVX2(sum, lanes, s, weights[i], transparency_coeff);
+            normalize += transparency_coeff;
+        }
+        SetPixelAVX2(q[x], sum, normalize, lanes, alpha);
+    }
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void VerticalFilterPixelsAVX2(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const ResizeAlphaMode alpha) {
+    const ContributionWindow *window = &table->windows[y];
+    const double *restrict weights = table->weights + window->offset;
+    const double density = table->densities[y];
+    const AVX2Lanes lanes = GetAVX2Lanes(source_order, destination_order);
+    const int o = source_order.opacity;
+    switch (window->count) {
+        case 2:
+            VerticalFilterColumnsAVX2(
+                &lanes, weights, 2, density, rows, o, q, columns, alpha);
+            break;
+        case 4:
+            VerticalFilterColumnsAVX2(
+                &lanes, weights, 4, density, rows, o, q, columns, alpha);
+            break;
+        case 6:
+            VerticalFilterColumnsAVX2(
+                &lanes, weights, 6, density, rows, o, q, columns, alpha);
+            break;
+        default:
+            VerticalFilterColumnsAVX2(&lanes,
+                                      weights,
+                                      window->count,
+                                      density,
+                                      rows,
+                                      o,
+                                      q,
+                                      columns,
+                                      alpha);
+            break;
+    }
+}
+
+/*
+    RGBA64 in OpacityLastPixelLayout, one pixel per register like the AVX2
+    kernels above, with the arithmetic of the scalar format kernels: alpha
+    scales the colors by alpha / MaxRGB16 and inverts to opacity with an
+    xor of its 16 bit lane.
+*/
+MAGICK_TARGET("avx2")
+static inline __m256d LoadWidePixelAVX2(const uint16_t *restrict pixel,
+                                        const __m128i invert) {
+    return _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(
+        _mm_xor_si128(_mm_loadl_epi64((const __m128i *)pixel), invert)));
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE __m256d AccumulateWideWindowAVX2(
+    const uint16_t *restrict pixels,
+    const double *restrict weights,
+    const int64_t count,
+    const bool matte,
+    double *restrict normalize) {
+    const __m128i invert = _mm_set_epi16(0, 0, 0, 0, -1, 0, 0, 0);
+    __m256d sum = _mm256_setzero_pd();
+    for (int64_t i = 0; i < count; i++) {
+        const uint16_t *restrict s = pixels + i * 4;
+        if (!matte) {
+            sum = _mm256_add_pd(sum,
+                                _mm256_mul_pd(_mm256_set1_pd(weights[i]),
+                                              LoadWidePixelAVX2(
+                                                  s, _mm_setzero_si128())));
+            continue;
+        }
+        double transparency_coeff =
+            weights[i] * (s[3] * (1.0 / MaxRGB16Double));
+        __m256d coeff = _mm256_set_pd(weights[i],
+                                      transparency_coeff,
+                                      transparency_coeff,
+                                      transparency_coeff);
+        sum = _mm256_add_pd(
+            sum, _mm256_mul_pd(coeff, LoadWidePixelAVX2(s, invert)));
+        *normalize += transparency_coeff;
+    }
+    return sum;
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void SetWidePixelAVX2(uint16_t *restrict q,
+                                          __m256d sum,
+                                          double normalize,
+                                          const bool matte) {
+    if (matte) {
+        normalize = 1.0 / (AbsoluteValue(normalize) <= MagickEpsilon
+                               ? 1.0
+                               : normalize);
+        sum = _mm256_mul_pd(
+            sum, _mm256_set_pd(1.0, normalize, normalize, normalize));
+    }
+    sum = _mm256_min_pd(_mm256_max_pd(sum, _mm256_setzero_pd()),
+                        _mm256_set1_pd(MaxRGB16Double));
+    __m128i words =
+        _mm256_cvttpd_epi32(_mm256_add_pd(sum, _mm256_set1_pd(0.5)));
+    if (matte) {
+        words = _mm_xor_si128(words, _mm_set_epi32(MaxRGB16, 0, 0, 0));
+    }
+    _mm_storel_epi64((__m128i *)q, _mm_packus_epi32(words, words));
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void HorizontalFilterWidePixelsAVX2(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    MagickPixelPacket4 *restrict q,
+    const bool matte) {
+    const uint16_t *restrict s = (const uint16_t *)p;
+    uint16_t *restrict d = (uint16_t *)q;
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const double *restrict weights = table->weights + window->offset;
+        const uint16_t *restrict pixels = s + window->start * 4;
+        double normalize = 0.0;
+        __m256d sum;
+        switch (window->count) {
+            case 2:
+                sum = AccumulateWideWindowAVX2(
+                    pixels, weights, 2, matte, &normalize);
+                break;
+            case 4:
+                sum = AccumulateWideWindowAVX2(
+                    pixels, weights, 4, matte, &normalize);
+                break;
+            case 6:
+                sum = AccumulateWideWindowAVX2(
+                    pixels, weights, 6, matte, &normalize);
+                break;
+            default:
+                sum = AccumulateWideWindowAVX2(
+                    pixels, weights, window->count, matte, &normalize);
+                break;
+        }
+        SetWidePixelAVX2(d + x * 4, sum, normalize, matte);
+    }
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void VerticalFilterWidePixelsAVX2(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const bool matte) {
+    const ContributionWindow *window = &table->windows[y];
+    const double *restrict weights = table->weights + window->offset;
+    const __m128i invert =
+        matte ? _mm_set_epi16(0, 0, 0, 0, -1, 0, 0, 0) : _mm_setzero_si128();
+    uint16_t *restrict d = (uint16_t *)q;
+    for (uint64_t x = 0; x < columns; x++) {
+        __m256d sum = _mm256_setzero_pd();
+        double normalize = 0.0;
+        for (int64_t i = 0; i < window->count; i++) {
+            const uint16_t *restrict s = (const uint16_t *)rows[i] + x * 4;
+            __m256d coeff = _mm256_set1_pd(weights[i]);
+            if (matte) {
+                double transparency_coeff =
+                    weights[i] * (s[3] * (1.0 / MaxRGB16Double));
+                coeff = _mm256_set_pd(weights[i],
+                                      transparency_coeff,
+                                      transparency_coeff,
+                                      transparency_coeff);
+                normalize += transparency_coeff;
+            }
+            sum = _mm256_add_pd(
+                sum, _mm256_mul_pd(coeff, LoadWidePixelAVX2(s, invert)));
+        }
+        SetWidePixelAVX2(d + x * 4, sum, normalize, matte);
+    }
+}
+
+/*
+    Fixed point kernels: _mm_madd_epi16 multiplies 16 bit samples by 16 bit
+    weights and adds the products of neighbouring lanes, which hold two taps
+    of one sample: two pixels of a window horizontally, two rows of a column
+    vertically. RGBA32 samples are shifted or premultiplied to 15 bits as
+    they are loaded. The stores round like SetFixedWidePixelPacket and
+    SetFixedPixelPacket, and leave the rare matte alpha above the maximum to
+    the former.
+*/
+typedef struct _FixedLanes {
+    __m128i pair;            // RGBA32 taps i and i + 1 to interleaved lanes
+    __m128i pair_alpha;      // alpha of the tap under each color lane
+    __m128i pair_opacity;    // 256 in the opacity lanes of a pair
+    __m128i wide_pair;       // the same interleave of RGBA64 taps
+    __m128i column_alpha;    // alpha under each color lane of two pixels
+    __m128i column_opacity;  // 256 in the opacity lanes of two pixels
+    __m128i wide_alpha;      // alpha under every lane of two RGBA64 pixels
+    __m128i wide_opacity;    // 0xffff in the opacity lanes of two pixels
+    __m128i wide_order;      // two RGBA64 pixels to destination order
+    __m128i sum_alpha;       // alpha lane of int32 sums under every lane
+    __m128i sum_opacity;     // all ones in the opacity lane of int32 sums
+    __m128i order;           // four RGBA32 pixels to destination order
+} FixedLanes;
+
+MAGICK_TARGET("sse4.1")
+static inline FixedLanes GetFixedLanes(
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order) {
+    const int o = source_order.opacity;
+    const int sources[4] = {
+        source_order.red, source_order.green, source_order.blue, o};
+    const int targets[4] = {destination_order.red,
+                            destination_order.green,
+                            destination_order.blue,
+                            destination_order.opacity};
+    int8_t pair[16], pair_alpha[16], wide_pair[16], column_alpha[16];
+    int8_t wide_alpha[16], wide_order[16], sum_alpha[16], order[16];
+    int16_t pair_opacity[8], column_opacity[8], wide_opacity[8];
+    int32_t sum_opacity[4] = {0, 0, 0, 0};
+    FixedLanes lanes;
+
+    memset(pair_opacity, 0, sizeof(pair_opacity));
+    memset(column_opacity, 0, sizeof(column_opacity));
+    memset(wide_opacity, 0, sizeof(wide_opacity));
+    memset(column_alpha, -1, sizeof(column_alpha));
+    memset(wide_order, -1, sizeof(wide_order));
+    memset(order, -1, sizeof(order));
+    for (int k = 0; k < 4; k++) {
+        // lane 2k holds sample k of tap i, lane 2k + 1 the one of tap i + 1
+        for (int t = 0; t < 2; t++) {
+            pair[4 * k + 2 * t] = (int8_t)(4 * t + k);
+            pair[4 * k + 2 * t + 1] = -1;
+            pair_alpha[4 * k + 2 * t] = k == o ? -1 : (int8_t)(4 * t + o);
+            pair_alpha[4 * k + 2 * t + 1] = -1;
+            wide_pair[4 * k + 2 * t] = (int8_t)(8 * t + 2 * k);
+            wide_pair[4 * k + 2 * t + 1] = (int8_t)(8 * t + 2 * k + 1);
+        }
+        for (int p = 0; p < 2; p++) {
+            if (k != o) column_alpha[8 * p + 2 * k] = (int8_t)(4 * p + o);
+            wide_alpha[8 * p + 2 * k] = (int8_t)(8 * p + 2 * o);
+            wide_alpha[8 * p + 2 * k + 1] = (int8_t)(8 * p + 2 * o + 1);
+            const int target = 8 * p + 2 * targets[k];
+            wide_order[target] = (int8_t)(8 * p + 2 * sources[k]);
+            wide_order[target + 1] = (int8_t)(8 * p + 2 * sources[k] + 1);
+        }
+        for (int b = 0; b < 4; b++) sum_alpha[4 * k + b] = (int8_t)(4 * o + b);
+        for (int p = 0; p < 4; p++) {
+            order[4 * p + targets[k]] = (int8_t)(4 * p + sources[k]);
+        }
+    }
+    pair_opacity[2 * o] = pair_opacity[2 * o + 1] = 256;
+    column_opacity[o] = column_opacity[4 + o] = 256;
+    wide_opacity[o] = wide_opacity[4 + o] = -1;
+    sum_opacity[o] = -1;
+    lanes.pair = _mm_loadu_si128((const __m128i *)pair);
+    lanes.pair_alpha = _mm_loadu_si128((const __m128i *)pair_alpha);
+    lanes.pair_opacity = _mm_loadu_si128((const __m128i *)pair_opacity);
+    lanes.wide_pair = _mm_loadu_si128((const __m128i *)wide_pair);
+    lanes.column_alpha = _mm_loadu_si128((const __m128i *)column_alpha);
+    lanes.column_opacity = _mm_loadu_si128((const __m128i *)column_opacity);
+    lanes.wide_alpha = _mm_loadu_si128((const __m128i *)wide_alpha);
+    lanes.wide_opacity = _mm_loadu_si128((const __m128i *)wide_opacity);
+    lanes.wide_order = _mm_loadu_si128((const __m128i *)wide_order);
+    lanes.sum_alpha = _mm_loadu_si128((const __m128i *)sum_alpha);
+    lanes.sum_opacity = _mm_loadu_si128((const __m128i *)sum_opacity);
+    lanes.order = _mm_loadu_si128((const __m128i *)order);
+    return lanes;
+}
+
+// weights i and i + 1 in the two halves of an int32, or weight i alone
+static inline int32_t GetFixedWeights(const int16_t *restrict weights,
+                                      const bool pair) {
+    return (int32_t)((uint32_t)(uint16_t)weights[0] |
+                     (pair ? (uint32_t)(uint16_t)weights[1] << 16 : 0U));
+}
+
+// alpha * color and 256 * alpha, halved to 15 bits
+MAGICK_TARGET("sse4.1")
+static inline __m128i PremultiplyFixedSSE41(const __m128i samples,
+                                            const __m128i alpha) {
+    return _mm_srli_epi16(_mm_mullo_epi16(samples, alpha), 1);
+}
+
+// taps i and, with pair, i + 1 of a row in interleaved lanes
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE __m128i LoadFixedTapsSSE41(
+    const MagickQuantum *restrict pixel,
+    const bool pair,
+    const FixedLanes *restrict lanes,
+    const bool wide,
+    const bool matte) {
+    if (wide) {
+        __m128i words = pair ? _mm_loadu_si128((const __m128i *)pixel)
+                             : _mm_loadl_epi64((const __m128i *)pixel);
+        return _mm_shuffle_epi8(words, lanes->wide_pair);
+    }
+    __m128i bytes = pair ? _mm_loadl_epi64((const __m128i *)pixel)
+                         : _mm_cvtsi32_si128(LoadPixelPacket(pixel));
+    __m128i samples = _mm_shuffle_epi8(bytes, lanes->pair);
+    if (!matte) return _mm_slli_epi16(samples, FixedIntermediateShift);
+    return PremultiplyFixedSSE41(
+        samples,
+        _mm_or_si128(_mm_shuffle_epi8(bytes, lanes->pair_alpha),
+                     lanes->pair_opacity));
+}
+
+// pixel x and, with pair, x + 1 of a row in order
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE __m128i LoadFixedPixelsSSE41(
+    const MagickQuantum *restrict pixel,
+    const bool pair,
+    const FixedLanes *restrict lanes,
+    const bool wide,
+    const bool matte) {
+    if (wide) {
+        return pair ? _mm_loadu_si128((const __m128i *)pixel)
+                    : _mm_loadl_epi64((const __m128i *)pixel);
+    }
+    __m128i bytes = pair ? _mm_loadl_epi64((const __m128i *)pixel)
+                         : _mm_cvtsi32_si128(LoadPixelPacket(pixel));
+    __m128i samples = _mm_cvtepu8_epi16(bytes);
+    if (!matte) return _mm_slli_epi16(samples, FixedIntermediateShift);
+    return PremultiplyFixedSSE41(
+        samples,
+        _mm_or_si128(_mm_shuffle_epi8(bytes, lanes->column_alpha),
+                     lanes->column_opacity));
+}
+
+// adds taps i to count of a window to the int32 sums of its pixel
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE __m128i AccumulateFixedTapsSSE41(
+    __m128i sum,
+    const MagickQuantum *restrict pixels,
+    const int16_t *restrict weights,
+    int64_t i,
+    const int64_t count,
+    const FixedLanes *restrict lanes,
+    const bool wide,
+    const bool matte) {
+    const int64_t size = wide ? 8 : 4;
+    for (; i < count; i += 2) {
+        const bool pair = i + 1 < count;
+        __m128i samples =
+            LoadFixedTapsSSE41(pixels + i * size, pair, lanes, wide, matte);
+        sum = _mm_add_epi32(
+            sum,
+            _mm_madd_epi16(samples,
+                           _mm_set1_epi32(GetFixedWeights(weights + i, pair))));
+    }
+    return sum;
+}
+
+/*
+    Colors of the second matte pass, the premultiplied sums divided by the
+    alpha sum, next to the rounded alpha in shifted.
+*/
+MAGICK_TARGET("sse4.1")
+static inline __m128i GetFixedColorsSSE41(const __m128i sum,
+                                          const __m128i shifted,
+                                          const FixedLanes *restrict lanes) {
+    __m128i alpha = _mm_shuffle_epi8(sum, lanes->sum_alpha);
+    __m128 scale = _mm_andnot_ps(
+        _mm_castsi128_ps(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())),
+        _mm_div_ps(_mm_set1_ps(256.0f), _mm_cvtepi32_ps(alpha)));
+    __m128 value = _mm_mul_ps(_mm_cvtepi32_ps(sum), scale);
+    value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()),
+                       _mm_set1_ps(MaxRGBFloat));
+    __m128i colors = _mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f)));
+    return _mm_blendv_epi8(colors, shifted, lanes->sum_opacity);
+}
+
+/*
+    Stores the sums a of pixel x and, with pair, b of pixel x + 1: RGBA32
+    from wide sources, the RGBA64 intermediate from RGBA32 ones.
+*/
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE void StoreFixedPixelsSSE41(
+    MagickPixelPacket4 *restrict q,
+    const uint64_t x,
+    const __m128i a,
+    const __m128i b,
+    const bool pair,
+    const int bits,
+    const FixedLanes *restrict lanes,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order,
+    const bool wide,
+    const bool matte) {
+    if (wide) {
+        const int shift = bits + FixedIntermediateShift;
+        const __m128i half = _mm_set1_epi32(1 << (shift - 1));
+        const __m128i count = _mm_cvtsi32_si128(shift);
+        __m128i low = _mm_sra_epi32(_mm_add_epi32(a, half), count);
+        __m128i high = _mm_sra_epi32(_mm_add_epi32(b, half), count);
+        if (matte) {
+            low = GetFixedColorsSSE41(a, low, lanes);
+            high = GetFixedColorsSSE41(b, high, lanes);
+        }
+        __m128i words = _mm_packs_epi32(low, high);
+        __m128i bytes = _mm_shuffle_epi8(_mm_packus_epi16(words, words),
+                                         lanes->order);
+        if (pair) {
+            _mm_storel_epi64((__m128i *)q[x], bytes);
+        } else {
+            int packet = _mm_cvtsi128_si32(bytes);
+            memcpy(q[x], &packet, sizeof(packet));
+        }
+        return;
+    }
+    const __m128i half = _mm_set1_epi32(1 << (bits - 1));
+    const __m128i count = _mm_cvtsi32_si128(bits);
+    const __m128i max = _mm_set1_epi32((int)MaxFixedIntermediate);
+    __m128i low = _mm_sra_epi32(_mm_add_epi32(a, half), count);
+    __m128i high = _mm_sra_epi32(_mm_add_epi32(b, half), count);
+    uint16_t *restrict d = (uint16_t *)q + x * 4;
+    if (matte &&
+        !_mm_testz_si128(_mm_or_si128(_mm_cmpgt_epi32(low, max),
+                                      _mm_cmpgt_epi32(high, max)),
+                         lanes->sum_opacity)) {
+        int32_t sums[8];
+        _mm_storeu_si128((__m128i *)sums, a);
+        _mm_storeu_si128((__m128i *)(sums + 4), b);
+        for (int p = 0; p < (pair ? 2 : 1); p++) {
+            SetFixedWidePixelPacket(d + 4 * p,
+                                    sums + 4 * p,
+                                    bits,
+                                    matte,
+                                    source_order,
+                                    destination_order);
+        }
+        return;
+    }
+    __m128i words = _mm_min_epu16(
+        _mm_packus_epi32(low, high),
+        _mm_set1_epi16((short)MaxFixedIntermediate));
+    if (matte) {
+        __m128i limit = _mm_mulhi_epu16(
+            _mm_shuffle_epi8(words, lanes->wide_alpha),
+            _mm_set1_epi16((short)(MaxRGB << 8)));
+        words = _mm_min_epu16(words, _mm_or_si128(limit, lanes->wide_opacity));
+    }
+    words = _mm_shuffle_epi8(words, lanes->wide_order);
+    if (pair) {
+        _mm_storeu_si128((__m128i *)d, words);
+    } else {
+        _mm_storel_epi64((__m128i *)d, words);
+    }
+}
+
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE void HorizontalFilterFixedPixelsSSE41(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const MagickPixelOrder destination_order,
+    const bool wide,
+    const bool matte) {
+    const FixedLanes lanes = GetFixedLanes(source_order, destination_order);
+    const int64_t size = wide ? 8 : 4;
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        __m128i sum = AccumulateFixedTapsSSE41(
+            _mm_setzero_si128(),
+            (const MagickQuantum *)p + window->start * size,
+            table->fixed_weights + window->offset,
+            0,
+            window->count,
+            &lanes,
+            wide,
+            matte);
+        StoreFixedPixelsSSE41(q,
+                              x,
+                              sum,
+                              sum,
+                              false,
+                              table->fixed_bits,
+                              &lanes,
+                              source_order,
+                              destination_order,
+                              wide,
+                              matte);
+    }
+}
+
+// columns x to columns of a vertical pass, two pixels at a time
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE void VerticalFilterFixedColumnsSSE41(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    uint64_t x,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const FixedLanes *restrict lanes,
+    const bool wide,
+    const bool matte) {
+    const ContributionWindow *window = &table->windows[y];
+    const int16_t *restrict weights = table->fixed_weights + window->offset;
+    const uint64_t size = wide ? 8 : 4;
+    for (; x < columns; x += 2) {
+        const bool pair = x + 1 < columns;
+        __m128i a = _mm_setzero_si128(), b = _mm_setzero_si128();
+        for (int64_t i = 0; i < window->count; i += 2) {
+            const bool both = i + 1 < window->count;
+            __m128i top = LoadFixedPixelsSSE41(
+                (const MagickQuantum *)rows[i] + x * size,
+                pair,
+                lanes,
+                wide,
+                matte);
+            __m128i bottom =
+                both ? LoadFixedPixelsSSE41(
+                           (const MagickQuantum *)rows[i + 1] + x * size,
+                           pair,
+                           lanes,
+                           wide,
+                           matte)
+                     : _mm_setzero_si128();
+            __m128i weight = _mm_set1_epi32(GetFixedWeights(weights + i, both));
+            a = _mm_add_epi32(
+                a, _mm_madd_epi16(_mm_unpacklo_epi16(top, bottom), weight));
+            b = _mm_add_epi32(
+                b, _mm_madd_epi16(_mm_unpackhi_epi16(top, bottom), weight));
+        }
+        StoreFixedPixelsSSE41(q,
+                              x,
+                              a,
+                              b,
+                              pair,
+                              table->fixed_bits,
+                              lanes,
+                              source_order,
+                              destination_order,
+                              wide,
+                              matte);
+    }
+}
+
+MAGICK_TARGET("sse4.1")
+MAGICK_FORCE_INLINE void VerticalFilterFixedPixelsSSE41(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const bool wide,
+    const bool matte) {
+    const FixedLanes lanes = GetFixedLanes(source_order, destination_order);
+    VerticalFilterFixedColumnsSSE41(table,
+                                    y,
+                                    rows,
+                                    source_order,
+                                    q,
+                                    0,
+                                    columns,
+                                    destination_order,
+                                    &lanes,
+                                    wide,
+                                    matte);
+}
+
+/*
+    AVX2 fixed point kernels take four taps of a window horizontally, the
+    first two in the low half, and four columns vertically, columns x and
+    x + 2 in the sums of the low lanes and x + 1 and x + 3 in the others.
+    The taps and columns left over go through the SSE4.1 code.
+*/
+typedef struct _FixedLanesAVX2 {
+    FixedLanes lanes;
+    __m256i pair, pair_alpha, pair_opacity, wide_pair;
+    __m256i column_alpha, column_opacity;
+    __m256i wide_alpha, wide_opacity, wide_order;
+    __m256i sum_alpha, sum_opacity;
+    __m256i taps;  // weight pairs 0, 1 to the low half and 2, 3 to the high
+} FixedLanesAVX2;
+
+// pattern of the low half in both, reading 8 bytes further in the high one
+MAGICK_TARGET("avx2")
+static inline __m256i GetHighShuffleAVX2(const __m128i low) {
+    __m128i high = _mm_add_epi8(
+        low, _mm_andnot_si128(_mm_cmplt_epi8(low, _mm_setzero_si128()),
+                              _mm_set1_epi8(8)));
+    return _mm256_setr_m128i(low, high);
+}
+
+MAGICK_TARGET("avx2")
+static inline FixedLanesAVX2 GetFixedLanesAVX2(
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order) {
+    FixedLanesAVX2 lanes;
+    lanes.lanes = GetFixedLanes(source_order, destination_order);
+    lanes.pair = GetHighShuffleAVX2(lanes.lanes.pair);
+    lanes.pair_alpha = GetHighShuffleAVX2(lanes.lanes.pair_alpha);
+    lanes.pair_opacity = _mm256_broadcastsi128_si256(lanes.lanes.pair_opacity);
+    lanes.wide_pair = _mm256_broadcastsi128_si256(lanes.lanes.wide_pair);
+    lanes.column_alpha = GetHighShuffleAVX2(lanes.lanes.column_alpha);
+    lanes.column_opacity =
+        _mm256_broadcastsi128_si256(lanes.lanes.column_opacity);
+    lanes.wide_alpha = _mm256_broadcastsi128_si256(lanes.lanes.wide_alpha);
+    lanes.wide_opacity = _mm256_broadcastsi128_si256(lanes.lanes.wide_opacity);
+    lanes.wide_order = _mm256_broadcastsi128_si256(lanes.lanes.wide_order);
+    lanes.sum_alpha = _mm256_broadcastsi128_si256(lanes.lanes.sum_alpha);
+    lanes.sum_opacity = _mm256_broadcastsi128_si256(lanes.lanes.sum_opacity);
+    lanes.taps = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    return lanes;
+}
+
+MAGICK_TARGET("avx2")
+static inline __m256i PremultiplyFixedAVX2(const __m256i samples,
+                                           const __m256i alpha) {
+    return _mm256_srli_epi16(_mm256_mullo_epi16(samples, alpha), 1);
+}
+
+// taps i to i + 3 of a row, i and i + 1 in the low half
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE __m256i LoadFixedTapsAVX2(
+    const MagickQuantum *restrict pixel,
+    const FixedLanesAVX2 *restrict lanes,
+    const bool wide,
+    const bool matte) {
+    if (wide) {
+        return _mm256_shuffle_epi8(
+            _mm256_loadu_si256((const __m256i *)pixel), lanes->wide_pair);
+    }
+    __m256i bytes = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)pixel));
+    __m256i samples = _mm256_shuffle_epi8(bytes, lanes->pair);
+    if (!matte) return _mm256_slli_epi16(samples, FixedIntermediateShift);
+    return PremultiplyFixedAVX2(
+        samples,
+        _mm256_or_si256(_mm256_shuffle_epi8(bytes, lanes->pair_alpha),
+                        lanes->pair_opacity));
+}
+
+// pixels x to x + 3 of a row in order
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE __m256i LoadFixedPixelsAVX2(
+    const MagickQuantum *restrict pixel,
+    const FixedLanesAVX2 *restrict lanes,
+    const bool wide,
+    const bool matte) {
+    if (wide) return _mm256_loadu_si256((const __m256i *)pixel);
+    __m128i bytes = _mm_loadu_si128((const __m128i *)pixel);
+    __m256i samples = _mm256_cvtepu8_epi16(bytes);
+    if (!matte) return _mm256_slli_epi16(samples, FixedIntermediateShift);
+    return PremultiplyFixedAVX2(
+        samples,
+        _mm256_or_si256(
+            _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(bytes),
+                                lanes->column_alpha),
+            lanes->column_opacity));
+}
+
+MAGICK_TARGET("avx2")
+static inline __m256i GetFixedColorsAVX2(const __m256i sum,
+                                         const __m256i shifted,
+                                         const FixedLanesAVX2 *restrict lanes) {
+    __m256i alpha = _mm256_shuffle_epi8(sum, lanes->sum_alpha);
+    __m256 scale = _mm256_andnot_ps(
+        _mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(alpha, _mm256_setzero_si256())),
+        _mm256_div_ps(_mm256_set1_ps(256.0f), _mm256_cvtepi32_ps(alpha)));
+    __m256 value = _mm256_mul_ps(_mm256_cvtepi32_ps(sum), scale);
+    value = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()),
+                          _mm256_set1_ps(MaxRGBFloat));
+    __m256i colors =
+        _mm256_cvttps_epi32(_mm256_add_ps(value, _mm256_set1_ps(0.5f)));
+    return _mm256_blendv_epi8(colors, shifted, lanes->sum_opacity);
+}
+
+// StoreFixedPixelsSSE41 of columns x to x + 3
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void StoreFixedPixelsAVX2(
+    MagickPixelPacket4 *restrict q,
+    const uint64_t x,
+    const __m256i a,
+    const __m256i b,
+    const int bits,
+    const FixedLanesAVX2 *restrict lanes,
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order,
+    const bool wide,
+    const bool matte) {
+    if (wide) {
+        const int shift = bits + FixedIntermediateShift;
+        const __m256i half = _mm256_set1_epi32(1 << (shift - 1));
+        const __m128i count = _mm_cvtsi32_si128(shift);
+        __m256i low = _mm256_sra_epi32(_mm256_add_epi32(a, half), count);
+        __m256i high = _mm256_sra_epi32(_mm256_add_epi32(b, half), count);
+        if (matte) {
+            low = GetFixedColorsAVX2(a, low, lanes);
+            high = GetFixedColorsAVX2(b, high, lanes);
+        }
+        __m256i words = _mm256_packs_epi32(low, high);
+        __m256i bytes = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(words, words), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i *)q[x],
+                         _mm_shuffle_epi8(_mm256_castsi256_si128(bytes),
+                                          lanes->lanes.order));
+        return;
+    }
+    const __m256i half = _mm256_set1_epi32(1 << (bits - 1));
+    const __m128i count = _mm_cvtsi32_si128(bits);
+    const __m256i max = _mm256_set1_epi32((int)MaxFixedIntermediate);
+    __m256i low = _mm256_sra_epi32(_mm256_add_epi32(a, half), count);
+    __m256i high = _mm256_sra_epi32(_mm256_add_epi32(b, half), count);
+    uint16_t *restrict d = (uint16_t *)q + x * 4;
+    if (matte &&
+        !_mm256_testz_si256(_mm256_or_si256(_mm256_cmpgt_epi32(low, max),
+                                            _mm256_cmpgt_epi32(high, max)),
+                            lanes->sum_opacity)) {
+        int32_t sums[16];
+        _mm256_storeu_si256((__m256i *)sums, a);
+        _mm256_storeu_si256((__m256i *)(sums + 8), b);
+        for (int p = 0; p < 4; p++) {
+            SetFixedWidePixelPacket(d + 4 * p,
+                                    sums + (p % 2) * 8 + (p / 2) * 4,
+                                    bits,
+                                    matte,
+                                    source_order,
+                                    destination_order);
+        }
+        return;
+    }
+    __m256i words = _mm256_min_epu16(
+        _mm256_packus_epi32(low, high),
+        _mm256_set1_epi16((short)MaxFixedIntermediate));
+    if (matte) {
+        __m256i limit = _mm256_mulhi_epu16(
+            _mm256_shuffle_epi8(words, lanes->wide_alpha),
+            _mm256_set1_epi16((short)(MaxRGB << 8)));
+        words = _mm256_min_epu16(words,
+                                 _mm256_or_si256(limit, lanes->wide_opacity));
+    }
+    _mm256_storeu_si256((__m256i *)d,
+                        _mm256_shuffle_epi8(words, lanes->wide_order));
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void HorizontalFilterFixedPixelsAVX2(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const MagickPixelOrder destination_order,
+    const bool wide,
+    const bool matte) {
+    const FixedLanesAVX2 lanes =
+        GetFixedLanesAVX2(source_order, destination_order);
+    const int64_t size = wide ? 8 : 4;
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const int16_t *restrict weights = table->fixed_weights + window->offset;
+        const MagickQuantum *restrict pixels =
+            (const MagickQuantum *)p + window->start * size;
+        __m256i sum = _mm256_setzero_si256();
+        int64_t i = 0;
+        for (; i + 4 <= window->count; i += 4) {
+            __m256i weight = _mm256_permutevar8x32_epi32(
+                _mm256_castsi128_si256(
+                    _mm_loadl_epi64((const __m128i *)(weights + i))),
+                lanes.taps);
+            sum = _mm256_add_epi32(
+                sum,
+                _mm256_madd_epi16(
+                    LoadFixedTapsAVX2(pixels + i * size, &lanes, wide, matte),
+                    weight));
+        }
+        __m128i total = AccumulateFixedTapsSSE41(
+            _mm_add_epi32(_mm256_castsi256_si128(sum),
+                          _mm256_extracti128_si256(sum, 1)),
+            pixels,
+            weights,
+            i,
+            window->count,
+            &lanes.lanes,
+            wide,
+            matte);
+        StoreFixedPixelsSSE41(q,
+                              x,
+                              total,
+                              total,
+                              false,
+                              table->fixed_bits,
+                              &lanes.lanes,
+                              source_order,
+                              destination_order,
+                              wide,
+                              matte);
+    }
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void VerticalFilterFixedPixelsAVX2(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const bool wide,
+    const bool matte) {
+    const FixedLanesAVX2 lanes =
+        GetFixedLanesAVX2(source_order, destination_order);
+    const ContributionWindow *window = &table->windows[y];
+    const int16_t *restrict weights = table->fixed_weights + window->offset;
+    const uint64_t size = wide ? 8 : 4;
+    uint64_t x = 0;
+    for (; x + 4 <= columns; x += 4) {
+        __m256i a = _mm256_setzero_si256(), b = _mm256_setzero_si256();
+        for (int64_t i = 0; i < window->count; i += 2) {
+            const bool both = i + 1 < window->count;
+            __m256i top = LoadFixedPixelsAVX2(
+                (const MagickQuantum *)rows[i] + x * size, &lanes, wide, matte);
+            __m256i bottom =
+                both ? LoadFixedPixelsAVX2(
+                           (const MagickQuantum *)rows[i + 1] + x * size,
+                           &lanes,
+                           wide,
+                           matte)
+                     : _mm256_setzero_si256();
+            __m256i weight =
+                _mm256_set1_epi32(GetFixedWeights(weights + i, both));
+            a = _mm256_add_epi32(
+                a,
+                _mm256_madd_epi16(_mm256_unpacklo_epi16(top, bottom), weight));
+            b = _mm256_add_epi32(
+                b,
+                _mm256_madd_epi16(_mm256_unpackhi_epi16(top, bottom), weight));
+        }
+        StoreFixedPixelsAVX2(q,
+                             x,
+                             a,
+                             b,
+                             table->fixed_bits,
+                             &lanes,
+                             source_order,
+                             destination_order,
+                             wide,
+                             matte);
+    }
+    VerticalFilterFixedColumnsSSE41(table,
+                                    y,
+                                    rows,
+                                    source_order,
+                                    q,
+                                    x,
+                                    columns,
+                                    destination_order,
+                                    &lanes.lanes,
+                                    wide,
+                                    matte);
+}
+
+// one RGBA32 pixel or, with pair, two neighbouring ones as int32 lanes
+MAGICK_TARGET("avx2")
+static inline __m256i LoadPixelPacketPairAVX2(const MagickQuantum *pixel,
+                                              const bool pair) {
+    int64_t value = 0;
+    memcpy(&value, pixel, pair ? 8 : 4);
+    return _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(value));
+}
+
+/*
+    AVX2 float kernels also work on two pixels per instruction, with the
+    arithmetic of the scalar float kernels: horizontally the low half sums
+    the even taps of a window and the high half the odd ones. The stores
+    round all four lanes at once like the double ones.
+*/
+typedef struct _FloatLanesAVX2 {
+    __m256i broadcast;  // alpha of each pixel into its four lanes
+    __m256 mask;        // all ones in the opacity lanes
+    __m128i invert;
+    __m128i shuffle;  // source byte order to destination byte order
+} FloatLanesAVX2;
+
+MAGICK_TARGET("avx2")
+static inline FloatLanesAVX2 GetFloatLanesAVX2(
+    const MagickPixelOrder source_order,
+    const MagickPixelOrder destination_order) {
+    FloatLanesAVX2 lanes;
+    const int o = source_order.opacity;
+    lanes.broadcast = _mm256_setr_epi32(o, o, o, o, o + 4, o + 4, o + 4, o + 4);
+    lanes.mask = _mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(_mm256_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3),
+                           _mm256_set1_epi32(o)));
+    lanes.invert = _mm_cvtsi32_si128((int)(0xffU << (8 * o)));
+    lanes.shuffle = GetPixelShuffle(source_order, destination_order);
+    return lanes;
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE __m256 AccumulateFloatAVX2(
+    const __m256 sum,
+    const FloatLanesAVX2 *restrict lanes,
+    const __m256i value,
+    const __m256 weight,
+    const bool matte,
+    __m256 *restrict normalize) {
+    if (!matte) {
+        return _mm256_add_ps(sum,
+                             _mm256_mul_ps(weight, _mm256_cvtepi32_ps(value)));
+    }
+    __m256 alpha = _mm256_cvtepi32_ps(
+        _mm256_permutevar8x32_epi32(value, lanes->broadcast));
+    __m256 transparency_coeff = _mm256_mul_ps(
+        weight, _mm256_mul_ps(alpha, _mm256_set1_ps(1.0f / MaxRGBFloat)));
+    __m256 pixel =
+        _mm256_blendv_ps(_mm256_cvtepi32_ps(value),
+                         _mm256_sub_ps(_mm256_set1_ps(MaxRGBFloat), alpha),
+                         lanes->mask);
+    *normalize = _mm256_add_ps(*normalize, transparency_coeff);
+    return _mm256_add_ps(
+        sum,
+        _mm256_mul_ps(_mm256_blendv_ps(transparency_coeff, weight, lanes->mask),
+                      pixel));
+}
+
+/*
+    SetFloatPixelPacket, or SetFloatPlainPixelPacket without matte, on all
+    lanes. normalize holds the weighted alpha in every lane.
+*/
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void SetFloatPixelAVX2(MagickQuantum *restrict q,
+                                           __m128 value,
+                                           __m128 normalize,
+                                           const FloatLanesAVX2 *restrict lanes,
+                                           const bool matte) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    if (matte) {
+        __m128 small =
+            _mm_cmple_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), normalize),
+                         _mm_set1_ps((float)MagickEpsilon));
+        normalize = _mm_div_ps(one, _mm_blendv_ps(normalize, one, small));
+        value = _mm_mul_ps(
+            value,
+            _mm_blendv_ps(
+                normalize, one, _mm256_castps256_ps128(lanes->mask)));
+    }
+    value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()),
+                       _mm_set1_ps(MaxRGBFloat));
+    __m128i words = _mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f)));
+    __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(words, words), words);
+    if (matte) bytes = _mm_xor_si128(bytes, lanes->invert);
+    bytes = _mm_shuffle_epi8(bytes, lanes->shuffle);
+    int packet = _mm_cvtsi128_si32(bytes);
+    memcpy(q, &packet, sizeof(packet));
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE __m256 AccumulateFloatWindowAVX2(
+    const FloatLanesAVX2 *restrict lanes,
+    const MagickPixelPacket4 *restrict pixels,
+    const float *restrict weights,
+    const int64_t count,
+    const bool matte,
+    __m256 *restrict normalize) {
+    __m256 sum = _mm256_setzero_ps();
+    int64_t i;
+    for (i = 0; i + 1 < count; i += 2) {
+        sum = AccumulateFloatAVX2(sum,
+                                  lanes,
+                                  LoadPixelPacketPairAVX2(pixels[i], true),
+                                  _mm256_setr_m128(_mm_set1_ps(weights[i]),
+                                                   _mm_set1_ps(weights[i + 1])),
+                                  matte,
+                                  normalize);
+    }
+    if (i < count) {
+        sum = AccumulateFloatAVX2(
+            sum,
+            lanes,
+            LoadPixelPacketPairAVX2(pixels[i], false),
+            _mm256_setr_m128(_mm_set1_ps(weights[i]), _mm_setzero_ps()),
+            matte,
+            normalize);
+    }
+    return sum;
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void HorizontalFilterPixelsFloatAVX2(
+    const ContributionTable *restrict table,
+    const MagickPixelPacket4 *restrict p,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const MagickPixelOrder destination_order,
+    const bool matte) {
+    const FloatLanesAVX2 lanes =
+        GetFloatLanesAVX2(source_order, destination_order);
+    for (uint64_t x = 0; x < table->length; x++) {
+        const ContributionWindow *window = &table->windows[x];
+        const float *restrict weights = table->float_weights + window->offset;
+        const MagickPixelPacket4 *restrict pixels = p + window->start;
+        __m256 sum, normalize = _mm256_setzero_ps();
+        switch (window->count) {
+            case 2:
+                sum = AccumulateFloatWindowAVX2(
+                    &lanes, pixels, weights, 2, matte, &normalize);
+                break;
+            case 4:
+                sum = AccumulateFloatWindowAVX2(
+                    &lanes, pixels, weights, 4, matte, &normalize);
+                break;
+            case 6:
+                sum = AccumulateFloatWindowAVX2(
+                    &lanes, pixels, weights, 6, matte, &normalize);
+                break;
+            default:
+                sum = AccumulateFloatWindowAVX2(&lanes,
+                                                pixels,
+                                                weights,
+                                                window->count,
+                                                matte,
+                                                &normalize);
+                break;
+        }
+        SetFloatPixelAVX2(q[x],
+                          _mm_add_ps(_mm256_castps256_ps128(sum),
+                                     _mm256_extractf128_ps(sum, 1)),
+                          _mm_add_ps(_mm256_castps256_ps128(normalize),
+                                     _mm256_extractf128_ps(normalize, 1)),
+                          &lanes,
+                          matte);
+    }
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void VerticalFilterColumnsFloatAVX2(
+    const FloatLanesAVX2 *restrict lanes,
+    const float *restrict weights,
+    const int64_t count,
+    const MagickPixelPacket4 *const *restrict rows,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const bool matte) {
+    for (uint64_t x = 0; x < columns; x += 2) {
+        const bool pair = x + 1 < columns;
+        __m256 sum = _mm256_setzero_ps(), normalize = _mm256_setzero_ps();
+        for (int64_t i = 0; i < count; i++) {
+            sum = AccumulateFloatAVX2(sum,
+                                      lanes,
+                                      LoadPixelPacketPairAVX2(rows[i][x], pair),
+                                      _mm256_set1_ps(weights[i]),
+                                      matte,
+                                      &normalize);
+        }
+        SetFloatPixelAVX2(q[x],
+                          _mm256_castps256_ps128(sum),
+                          _mm256_castps256_ps128(normalize),
+                          lanes,
+                          matte);
+        if (pair) {
+            SetFloatPixelAVX2(q[x + 1],
+                              _mm256_extractf128_ps(sum, 1),
+                              _mm256_extractf128_ps(normalize, 1),
+                              lanes,
+                              matte);
+        }
+    }
+}
+
+MAGICK_TARGET("avx2")
+MAGICK_FORCE_INLINE void VerticalFilterPixelsFloatAVX2(
+    const ContributionTable *restrict table,
+    const uint64_t y,
+    const MagickPixelPacket4 *const *restrict rows,
+    const MagickPixelOrder source_order,
+    MagickPixelPacket4 *restrict q,
+    const uint64_t columns,
+    const MagickPixelOrder destination_order,
+    const bool matte) {
+    const ContributionWindow *window = &table->windows[y];
+    const float *restrict weights = table->float_weights + window->offset;
+    const FloatLanesAVX2 lanes =
+        GetFloatLanesAVX2(source_order, destination_order);
+    switch (window->count) {
+        case 2:
+            VerticalFilterColumnsFloatAVX2(
+                &lanes, weights, 2, rows, q, columns, matte);
+            break;
+        case 4:
+            VerticalFilterColumnsFloatAVX2(
+                &lanes, weights, 4, rows, q, columns, matte);
+            break;
+        case 6:
+            VerticalFilterColumnsFloatAVX2(
+                &lanes, weights, 6, rows, q, columns, matte);
+            break;
+        default:
+            VerticalFilterColumnsFloatAVX2(
+                &lanes, weights, window->count, rows, q, columns, matte);
+            break;
+    }
+}
+
+/*
+    Defines Horizontal##name##isa and Vertical##name##isa, the row kernels
+    of one instruction set and alpha mode.
+*/
+#define DefineVectorRowKernels(isa, target, name, alpha)                    \
+    MAGICK_TARGET(target)                                                   \
+    static void Horizontal##name##isa(                                      \
+        const ContributionTable *restrict table,                            \
+        const MagickPixelPacket4 *restrict p,                               \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const MagickPixelOrder destination_order) {                         \
+        HorizontalFilterPixels##isa(                                        \
+            table, p, source_order, q, destination_order, alpha);           \
+    }                                                                       \
+    MAGICK_TARGET(target)                                                   \
+    static void Vertical##name##isa(                                        \
+        const ContributionTable *restrict table,                            \
+        const uint64_t y,                                                   \
+        const MagickPixelPacket4 *const *restrict rows,                     \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const uint64_t columns,                                             \
+        const MagickPixelOrder destination_order) {                         \
+        VerticalFilterPixels##isa(                                          \
+            table, y, rows, source_order, q, columns, destination_order,    \
+            alpha);                                                         \
+    }
+
+DefineVectorRowKernels(SSE2, "sse2", FilterRow, MatteResizeAlpha)
+DefineVectorRowKernels(SSE2, "sse2", OpaqueFilterRow, OpaqueResizeAlpha)
+DefineVectorRowKernels(SSE2,
+                       "sse2",
+                       PremultipliedFilterRow,
+                       PremultipliedResizeAlpha)
+DefineVectorRowKernels(SSE41, "sse4.1", FilterRow, MatteResizeAlpha)
+DefineVectorRowKernels(SSE41, "sse4.1", OpaqueFilterRow, OpaqueResizeAlpha)
+DefineVectorRowKernels(SSE41,
+                       "sse4.1",
+                       PremultipliedFilterRow,
+                       PremultipliedResizeAlpha)
+DefineVectorRowKernels(AVX2, "avx2", FilterRow, MatteResizeAlpha)
+DefineVectorRowKernels(AVX2, "avx2", OpaqueFilterRow, OpaqueResizeAlpha)
+DefineVectorRowKernels(AVX2,
+                       "avx2",
+                       PremultipliedFilterRow,
+                       PremultipliedResizeAlpha)
+DefineVectorRowKernels(FloatAVX2, "avx2", FilterRow, true)
+DefineVectorRowKernels(FloatAVX2, "avx2", PlainFilterRow, false)
+
+// RGBA64 kernels, the layout is fixed so the orders are not read
+#define DefineWideRowKernels(isa, target, name, matte)                      \
+    MAGICK_TARGET(target)                                                   \
+    static void Horizontal##name##isa(                                      \
+        const ContributionTable *restrict table,                            \
+        const MagickPixelPacket4 *restrict p,                               \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const MagickPixelOrder destination_order) {                         \
+        ARG_NOT_USED(source_order);                                         \
+        ARG_NOT_USED(destination_order);                                    \
+        HorizontalFilterWidePixels##isa(table, p, q, matte);                \
+    }                                                                       \
+    MAGICK_TARGET(target)                                                   \
+    static void Vertical##name##isa(                                        \
+        const ContributionTable *restrict table,                            \
+        const uint64_t y,                                                   \
+        const MagickPixelPacket4 *const *restrict rows,                     \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const uint64_t columns,                                             \
+        const MagickPixelOrder destination_order) {                         \
+        ARG_NOT_USED(source_order);                                         \
+        ARG_NOT_USED(destination_order);                                    \
+        VerticalFilterWidePixels##isa(table, y, rows, q, columns, matte);   \
+    }
+
+DefineWideRowKernels(AVX2, "avx2", WideFilterRow, true)
+DefineWideRowKernels(AVX2, "avx2", WidePremultipliedFilterRow, false)
+
+// fixed point kernels of RGBA32 or RGBA64 source rows
+#define DefineFixedRowKernels(isa, target, name, wide, matte)               \
+    MAGICK_TARGET(target)                                                   \
+    static void Horizontal##name##isa(                                      \
+        const ContributionTable *restrict table,                            \
+        const MagickPixelPacket4 *restrict p,                               \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const MagickPixelOrder destination_order) {                         \
+        HorizontalFilterFixedPixels##isa(                                   \
+            table, p, source_order, q, destination_order, wide, matte);     \
+    }                                                                       \
+    MAGICK_TARGET(target)                                                   \
+    static void Vertical##name##isa(                                        \
+        const ContributionTable *restrict table,                            \
+        const uint64_t y,                                                   \
+        const MagickPixelPacket4 *const *restrict rows,                     \
+        const MagickPixelOrder source_order,                                \
+        MagickPixelPacket4 *restrict q,                                     \
+        const uint64_t columns,                                             \
+        const MagickPixelOrder destination_order) {                         \
+        VerticalFilterFixedPixels##isa(                                     \
+            table, y, rows, source_order, q, columns, destination_order,    \
+            wide, matte);                                                   \
+    }
+
+DefineFixedRowKernels(SSE41, "sse4.1", FilterRowFixed, false, true)
+DefineFixedRowKernels(SSE41, "sse4.1", PlainFilterRowFixed, false, false)
+DefineFixedRowKernels(SSE41, "sse4.1", WideFilterRowFixed, true, true)
+DefineFixedRowKernels(SSE41, "sse4.1", WidePlainFilterRowFixed, true, false)
+DefineFixedRowKernels(AVX2, "avx2", FilterRowFixed, false, true)
+DefineFixedRowKernels(AVX2, "avx2", PlainFilterRowFixed, false, false)
+DefineFixedRowKernels(AVX2, "avx2", WideFilterRowFixed, true, true)
+DefineFixedRowKernels(AVX2, "avx2", WidePlainFilterRowFixed, true, false)
+
+// vector kernels read the orders from their arguments in every layout
+#define AnyLayout(kernel) \
+    { kernel, kernel, kernel }
+
+static const ResizeKernels sse2_kernels = {
+    "sse2",
+    AnyLayout(HorizontalFilterRowSSE2),
+    AnyLayout(VerticalFilterRowSSE2),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(HorizontalOpaqueFilterRowSSE2),
+    AnyLayout(VerticalOpaqueFilterRowSSE2),
+    AnyLayout(HorizontalPremultipliedFilterRowSSE2),
+    AnyLayout(VerticalPremultipliedFilterRowSSE2),
+    NULL,
+    NULL,
+    NULL,
+    NULL};
+static const ResizeKernels sse41_kernels = {
+    "sse4.1",
+    AnyLayout(HorizontalFilterRowSSE41),
+    AnyLayout(VerticalFilterRowSSE41),
+    AnyLayout(HorizontalFilterRowFixedSSE41),
+    AnyLayout(VerticalFilterRowFixedSSE41),
+    AnyLayout(HorizontalPlainFilterRowFixedSSE41),
+    AnyLayout(VerticalPlainFilterRowFixedSSE41),
+    AnyLayout(HorizontalWideFilterRowFixedSSE41),
+    AnyLayout(VerticalWideFilterRowFixedSSE41),
+    AnyLayout(HorizontalWidePlainFilterRowFixedSSE41),
+    AnyLayout(VerticalWidePlainFilterRowFixedSSE41),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(NULL),
+    AnyLayout(HorizontalOpaqueFilterRowSSE41),
+    AnyLayout(VerticalOpaqueFilterRowSSE41),
+    AnyLayout(HorizontalPremultipliedFilterRowSSE41),
+    AnyLayout(VerticalPremultipliedFilterRowSSE41),
+    NULL,
+    NULL,
+    NULL,
+    NULL};
+static const ResizeKernels avx2_kernels = {
+    "avx2",
+    AnyLayout(HorizontalFilterRowAVX2),
+    AnyLayout(VerticalFilterRowAVX2),
+    AnyLayout(HorizontalFilterRowFixedAVX2),
+    AnyLayout(VerticalFilterRowFixedAVX2),
+    AnyLayout(HorizontalPlainFilterRowFixedAVX2),
+    AnyLayout(VerticalPlainFilterRowFixedAVX2),
+    AnyLayout(HorizontalWideFilterRowFixedAVX2),
+    AnyLayout(VerticalWideFilterRowFixedAVX2),
+    AnyLayout(HorizontalWidePlainFilterRowFixedAVX2),
+    AnyLayout(VerticalWidePlainFilterRowFixedAVX2),
+    AnyLayout(HorizontalFilterRowFloatAVX2),
+    AnyLayout(VerticalFilterRowFloatAVX2),
+    AnyLayout(HorizontalPlainFilterRowFloatAVX2),
+    AnyLayout(VerticalPlainFilterRowFloatAVX2),
+    AnyLayout(HorizontalOpaqueFilterRowAVX2),
+    AnyLayout(VerticalOpaqueFilterRowAVX2),
+    AnyLayout(HorizontalPremultipliedFilterRowAVX2),
+    AnyLayout(VerticalPremultipliedFilterRowAVX2),
+    HorizontalWideFilterRowAVX2,
+    VerticalWideFilterRowAVX2,
+    HorizontalWidePremultipliedFilterRowAVX2,
+    VerticalWidePremultipliedFilterRowAVX2};
+
+static void GetCPUID(int leaf, int subleaf, unsigned int registers[4]) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    __cpuidex((int *)registers, leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2],
+                  registers[3]);
+#endif
+}
+
+MAGICK_TARGET("xsave")
+static bool OSSupportsAVX(void) {
+    // ymm state has to be enabled by the os
+    return (_xgetbv(0) & 0x6) == 0x6;
+}
+
+/*
+    Vector kernel sets from the oldest instruction set to the newest, the
+    running cpu supports the first GetSIMDLevel ones.
+*/
+static const ResizeKernels *const simd_kernels[] = {
+    &sse2_kernels, &sse41_kernels, &avx2_kernels};
+
+static int GetSIMDLevel(void) {
+    unsigned int registers[4];
+    GetCPUID(0, 0, registers);
+    unsigned int leaves = registers[0];
+    if (leaves < 1) return 0;
+    GetCPUID(1, 0, registers);
+    bool sse2 = (registers[3] & (1U << 26)) != 0;
+    bool sse41 = (registers[2] & (1U << 19)) != 0;
+    bool avx = (registers[2] & (1U << 28)) != 0 &&
+               (registers[2] & (1U << 27)) != 0 && OSSupportsAVX();
+    bool avx2 = false;
+    if (avx && leaves >= 7) {
+        GetCPUID(7, 0, registers);
+        avx2 = (registers[1] & (1U << 5)) != 0;
+    }
+    if (avx2) return 3;
+    if (sse41) return 2;
+    if (sse2) return 1;
+    return 0;
+}
+
+const ResizeKernels *GetSIMDResizeKernelsByName(const char *name) {
+    int level = GetSIMDLevel();
+    for (int i = 0; i < level; i++) {
+        if (strcmp(simd_kernels[i]->name, name) == 0) return simd_kernels[i];
+    }
+    return NULL;
+}
+
+const ResizeKernels *GetSIMDResizeKernels(void) {
+    const char *name = getenv("MAGICK_RESIZE_SIMD");
+    const ResizeKernels *kernels = NULL;
+    int level = GetSIMDLevel();
+    if (name != NULL) {
+        if (strcmp(name, "scalar") == 0) return NULL;
+        kernels = GetSIMDResizeKernelsByName(name);
+    }
+    if (kernels == NULL && level > 0) kernels = simd_kernels[level - 1];
+    return kernels;
+}
+
+#else
+
+const ResizeKernels *GetSIMDResizeKernelsByName(const char *name) {
+    ARG_NOT_USED(name);
+    return NULL;
+}
+
+const ResizeKernels *GetSIMDResizeKernels(void) { return NULL; }
+
+#endif
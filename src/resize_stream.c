@@ -0,0 +1,144 @@
+#include <stdlib.h>
+
+#include "resize_private.h"
+
+static MagickPixelPacket4 *GetRingRow(MagickPixelPacket4 *ring,
+                                      const uint64_t index,
+                                      const uint64_t columns,
+                                      const uint64_t size) {
+    return (MagickPixelPacket4 *)((MagickQuantum *)ring +
+                                  index * columns * size);
+}
+
+/*
+    Streaming resize, always horizontal pass first: every source row is
+    filtered into a ring of plan->vertical.max_count intermediate rows as
+    soon as it is read, and each destination row is filtered out of the
+    ring once its last contributing row is present. Vertical windows only
+    move forward so no row is needed again after it leaves the ring. In
+    linear light the ring holds RGBA64 rows, decoded before the horizontal
+    pass and encoded after the vertical one, and the fixed point engine
+    keeps its RGBA64 intermediate rows there as well.
+*/
+int ResizeImageStream(const ResizePlan *plan,
+                      const MagickPixelOrder src_order,
+                      ResizeReadRowHandler read_row,
+                      void *read_data,
+                      const MagickPixelOrder dst_order,
+                      ResizeWriteRowHandler write_row,
+                      void *write_data,
+                      const ResizeOptions *options) {
+    if (plan == NULL || read_row == NULL || write_row == NULL) {
+        return 1;
+    }
+    const ContributionTable *vertical = &plan->vertical;
+    const uint64_t ring_rows = (uint64_t)vertical->max_count;
+    ResizeOptions defaults;
+    int ret = 0;
+    uint64_t next = 0;
+
+    if (options == NULL) {
+        GetResizeOptions(&defaults);
+        options = &defaults;
+    }
+    if ((options->linear_light && options->alpha == PremultipliedResizeAlpha) ||
+        plan->x_halvings > 0 || plan->y_halvings > 0) {
+        return 1;
+    }
+    const bool linear = options->linear_light;
+    const ResizeEngineType engine =
+        linear && options->engine == FixedPointResizeEngine
+            ? DoubleResizeEngine
+            : options->engine;
+    // formats of the rows the horizontal pass reads and of the ring
+    const MagickPixelFormat source_format =
+        linear ? RGBA64PixelFormat : RGBA32PixelFormat;
+    const MagickPixelFormat format =
+        linear || engine == FixedPointResizeEngine ? RGBA64PixelFormat
+                                                   : RGBA32PixelFormat;
+    const MagickPixelOrder order = linear ? OpacityLastOrder : src_order;
+    const uint64_t size = GetPixelSize(format);
+    // rows are not available up front, so only the caller can tell opaque
+    // the linear intermediate of an opaque source takes plain sums
+    const ResizeAlphaMode alpha =
+        options->alpha == DetectResizeAlpha ? MatteResizeAlpha
+        : linear && options->alpha == OpaqueResizeAlpha
+            ? PremultipliedResizeAlpha
+            : options->alpha;
+    HorizontalRowKernel horizontal =
+        GetHorizontalRowKernel(engine, source_format, order, order, alpha);
+    VerticalRowKernel filter = GetVerticalRowKernel(
+        engine, format, order, linear ? order : dst_order, alpha);
+    MagickPixelPacket4 *source_row = (MagickPixelPacket4 *)malloc(
+        plan->src_columns * sizeof(MagickPixelPacket4));
+    MagickPixelPacket4 *ring =
+        (MagickPixelPacket4 *)malloc(ring_rows * plan->columns * size);
+    MagickPixelPacket4 *destination_row = (MagickPixelPacket4 *)malloc(
+        plan->columns * sizeof(MagickPixelPacket4));
+    const MagickPixelPacket4 **rows = (const MagickPixelPacket4 **)malloc(
+        ring_rows * sizeof(MagickPixelPacket4 *));
+    // decoded source row, then the filtered destination row
+    MagickPixelPacket4 *linear_row =
+        linear ? (MagickPixelPacket4 *)malloc(
+                     Max(plan->src_columns, plan->columns) * size)
+               : NULL;
+    if (source_row == NULL || ring == NULL || destination_row == NULL ||
+        rows == NULL || (linear && linear_row == NULL)) {
+        ret = 2;
+        goto done;
+    }
+    if (linear) InitializeLinearLight();
+    for (uint64_t y = 0; y < plan->rows; y++) {
+        const ContributionWindow *window = &vertical->windows[y];
+        uint64_t stop = (uint64_t)(window->start + window->count);
+        for (; next < stop; next++) {
+            if (read_row(read_data, next, source_row) != 0) {
+                ret = 8;
+                goto done;
+            }
+            // rows before the window are not needed by any later row either
+            if (next < (uint64_t)window->start) continue;
+            if (linear) {
+                DecodeLinearRow(RGBA32PixelFormat,
+                                src_order,
+                                source_row,
+                                plan->src_columns,
+                                linear_row);
+            }
+            horizontal(&plan->horizontal,
+                       linear ? linear_row : source_row,
+                       order,
+                       GetRingRow(ring, next % ring_rows, plan->columns, size),
+                       order);
+        }
+        for (int64_t i = 0; i < window->count; i++) {
+            rows[i] = GetRingRow(
+                ring, (window->start + i) % ring_rows, plan->columns, size);
+        }
+        filter(vertical,
+               y,
+               rows,
+               order,
+               linear ? linear_row : destination_row,
+               plan->columns,
+               linear ? order : dst_order);
+        if (linear) {
+            EncodeLinearRow(linear_row,
+                            plan->columns,
+                            RGBA32PixelFormat,
+                            dst_order,
+                            destination_row);
+        }
+        if (write_row(write_data, y, destination_row) != 0) {
+            ret = 8;
+            goto done;
+        }
+    }
+done:
+    if (source_row != NULL) free(source_row);
+    if (ring != NULL) free(ring);
+    if (destination_row != NULL) free(destination_row);
+    if (rows != NULL) free((void *)rows);
+    if (linear_row != NULL) free(linear_row);
+    return ret;
+}
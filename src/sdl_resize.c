@@ -1,27 +1,277 @@
 #ifdef USE_SDL
+#include <string.h>
+
 #include "sdl_resize.h"
 
+/*
+    Surfaces whose channels are whole bytes (the 32 bit formats with or
+    without alpha, RGB24 and BGR24) are resized in place like any other
+    MagickImage when both sides share a pixel format. Every other pair goes
+    through ResizeImageStream: source rows are unpacked to RGBA32 as the
+    horizontal pass reads them and destination rows are packed as the
+    vertical pass emits them, so no converted copy of either surface is made.
+*/
+
+typedef struct _SurfaceRows {
+    SDL_Surface *surface;
+    SDL_bool direct;          // RGBA32 rows in order, copied as they are
+    SDL_bool opaque;          // no alpha channel, or an opaque palette
+    MagickPixelOrder order;   // of the rows handed to the resize
+    Uint8 colors[256][4];     // palette as rgba
+    Uint8 samples[4][1024];   // rgba value of every packed channel value
+} SurfaceRows;
+
+// Byte of an 8 bit channel within a pixel, -1 when it is not a whole byte.
+static int GetChannelByte(const SDL_PixelFormat *fmt,
+                          const Uint32 mask,
+                          const Uint8 shift) {
+    if (shift % 8 != 0 || mask != (Uint32)0xff << shift) return -1;
+    return SDL_BYTEORDER == SDL_BIG_ENDIAN ? fmt->BytesPerPixel - 1 - shift / 8
+                                           : shift / 8;
+}
+
 static SDL_bool InitMagickImage(MagickImage *out, SDL_Surface *img) {
+    const SDL_PixelFormat *fmt = img->format;
+    if (SDL_ISPIXELFORMAT_INDEXED(fmt->format) ||
+        SDL_ISPIXELFORMAT_FOURCC(fmt->format) ||
+        (fmt->BytesPerPixel != 3 && fmt->BytesPerPixel != 4)) {
+        return SDL_FALSE;
+    }
+    int red = GetChannelByte(fmt, fmt->Rmask, fmt->Rshift);
+    int green = GetChannelByte(fmt, fmt->Gmask, fmt->Gshift);
+    int blue = GetChannelByte(fmt, fmt->Bmask, fmt->Bshift);
+    // the padding byte of the formats without alpha
+    int opacity = fmt->Amask != 0 ? GetChannelByte(fmt, fmt->Amask, fmt->Ashift)
+                                  : 6 - red - green - blue;
+    if (red < 0 || green < 0 || blue < 0 || opacity < 0 ||
+        (fmt->BytesPerPixel == 3 && fmt->Amask != 0)) {
+        return SDL_FALSE;
+    }
     out->pixels = (MagickPixelPacket4 *)img->pixels;
-    switch (img->format->format) {
-        case SDL_PIXELFORMAT_RGBA32:
-            out->order = (MagickPixelOrder){0, 1, 2, 3};
-            break;
-        case SDL_PIXELFORMAT_ARGB32:
-            out->order = (MagickPixelOrder){1, 2, 3, 0};
+    out->order = (MagickPixelOrder){red, green, blue, opacity};
+    out->columns = img->w;
+    out->rows = img->h;
+    out->stride = img->pitch;
+    out->format =
+        fmt->BytesPerPixel == 4 ? RGBA32PixelFormat : RGB24PixelFormat;
+    return SDL_TRUE;
+}
+
+static SDL_bool IsSupportedSurface(const SDL_Surface *img) {
+    const SDL_PixelFormat *fmt = img->format;
+    if (SDL_ISPIXELFORMAT_FOURCC(fmt->format) || fmt->BytesPerPixel > 4) {
+        return SDL_FALSE;
+    }
+    if (SDL_ISPIXELFORMAT_INDEXED(fmt->format)) {
+        return fmt->palette != NULL && fmt->BitsPerPixel <= 8;
+    }
+    // channels wider than 10 bits do not fit the sample tables
+    return fmt->BytesPerPixel > 0 && (fmt->Rmask >> fmt->Rshift) < 1024 &&
+           (fmt->Gmask >> fmt->Gshift) < 1024 &&
+           (fmt->Bmask >> fmt->Bshift) < 1024 &&
+           (fmt->Amask >> fmt->Ashift) < 1024;
+}
+
+static Uint32 GetSurfacePixel(const Uint8 *row,
+                              const int x,
+                              const SDL_PixelFormat *fmt) {
+    switch (fmt->BytesPerPixel) {
+        case 1: {
+            const int bits = fmt->BitsPerPixel;
+            if (bits == 8) return row[x];
+            // 1, 2 and 4 bit indexes, packed from the high or the low bits
+            const int per_byte = 8 / bits;
+            const int index = x % per_byte;
+            const int shift =
+                SDL_PIXELORDER(fmt->format) == SDL_BITMAPORDER_4321
+                    ? index * bits
+                    : 8 - (index + 1) * bits;
+            return (row[x / per_byte] >> shift) & ((1U << bits) - 1);
+        }
+        case 2:
+            return ((const Uint16 *)row)[x];
+        case 3: {
+            const Uint8 *p = row + x * 3;
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+            return (Uint32)p[0] << 16 | (Uint32)p[1] << 8 | p[2];
+#else
+            return (Uint32)p[2] << 16 | (Uint32)p[1] << 8 | p[0];
+#endif
+        }
+        default:
+            return ((const Uint32 *)row)[x];
+    }
+}
+
+static void SetSurfacePixel(Uint8 *row,
+                            const int x,
+                            const SDL_PixelFormat *fmt,
+                            const Uint32 value) {
+    switch (fmt->BytesPerPixel) {
+        case 1: {
+            const int bits = fmt->BitsPerPixel;
+            if (bits == 8) {
+                row[x] = (Uint8)value;
+                break;
+            }
+            const int per_byte = 8 / bits;
+            const int index = x % per_byte;
+            const int shift =
+                SDL_PIXELORDER(fmt->format) == SDL_BITMAPORDER_4321
+                    ? index * bits
+                    : 8 - (index + 1) * bits;
+            const Uint8 mask = (Uint8)(((1U << bits) - 1) << shift);
+            Uint8 *p = row + x / per_byte;
+            *p = (Uint8)((*p & ~mask) | ((value << shift) & mask));
             break;
-        case SDL_PIXELFORMAT_BGRA32:
-            out->order = (MagickPixelOrder){2, 1, 0, 3};
+        }
+        case 2:
+            ((Uint16 *)row)[x] = (Uint16)value;
             break;
-        case SDL_PIXELFORMAT_ABGR32:
-            out->order = (MagickPixelOrder){3, 2, 1, 0};
+        case 3: {
+            Uint8 *p = row + x * 3;
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+            p[0] = (Uint8)(value >> 16);
+            p[1] = (Uint8)(value >> 8);
+            p[2] = (Uint8)value;
+#else
+            p[0] = (Uint8)value;
+            p[1] = (Uint8)(value >> 8);
+            p[2] = (Uint8)(value >> 16);
+#endif
             break;
+        }
         default:
-            return SDL_FALSE;
+            ((Uint32 *)row)[x] = value;
+            break;
     }
-    out->columns = img->w;
-    out->rows = img->h;
-    return SDL_TRUE;
+}
+
+/*
+    Direct rows are the 32 bit formats, any other surface is exchanged as
+    RGBA32 in OpacityLast order through lookup tables filled by SDL_GetRGBA,
+    so unpacking matches SDL's own expansion of narrow channels.
+*/
+static void InitSurfaceRows(SurfaceRows *rows, SDL_Surface *img) {
+    const SDL_PixelFormat *fmt = img->format;
+    MagickImage image;
+    rows->surface = img;
+    rows->direct = InitMagickImage(&image, img) &&
+                   image.format == RGBA32PixelFormat;
+    rows->order =
+        rows->direct ? image.order : (MagickPixelOrder){0, 1, 2, 3};
+    rows->opaque = fmt->Amask == 0;
+    if (SDL_ISPIXELFORMAT_INDEXED(fmt->format)) {
+        const SDL_Palette *palette = fmt->palette;
+        memset(rows->colors, 0, sizeof(rows->colors));
+        for (int i = 0; i < palette->ncolors && i < 256; i++) {
+            rows->colors[i][0] = palette->colors[i].r;
+            rows->colors[i][1] = palette->colors[i].g;
+            rows->colors[i][2] = palette->colors[i].b;
+            rows->colors[i][3] = palette->colors[i].a;
+            rows->opaque = rows->opaque && palette->colors[i].a == 0xff;
+        }
+        return;
+    }
+    if (rows->direct) return;
+    const Uint32 masks[4] = {fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask};
+    const Uint8 shifts[4] = {
+        fmt->Rshift, fmt->Gshift, fmt->Bshift, fmt->Ashift};
+    for (int k = 0; k < 4; k++) {
+        for (Uint32 v = 0; v <= masks[k] >> shifts[k]; v++) {
+            Uint8 rgba[4];
+            SDL_GetRGBA(
+                v << shifts[k], fmt, &rgba[0], &rgba[1], &rgba[2], &rgba[3]);
+            rows->samples[k][v] = rgba[k];
+        }
+    }
+}
+
+static int ReadSurfaceRow(void *data,
+                          const uint64_t y,
+                          MagickPixelPacket4 *row) {
+    const SurfaceRows *rows = (const SurfaceRows *)data;
+    const SDL_Surface *img = rows->surface;
+    const SDL_PixelFormat *fmt = img->format;
+    const Uint8 *p = (const Uint8 *)img->pixels + y * img->pitch;
+    if (rows->direct) {
+        memcpy(row, p, img->w * sizeof(MagickPixelPacket4));
+        if (rows->opaque) {
+            const int opacity = rows->order.opacity;
+            for (int x = 0; x < img->w; x++) row[x][opacity] = 0xff;
+        }
+        return 0;
+    }
+    if (SDL_ISPIXELFORMAT_INDEXED(fmt->format)) {
+        for (int x = 0; x < img->w; x++) {
+            memcpy(row[x], rows->colors[GetSurfacePixel(p, x, fmt)], 4);
+        }
+        return 0;
+    }
+    const Uint32 masks[4] = {fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask};
+    const Uint8 shifts[4] = {
+        fmt->Rshift, fmt->Gshift, fmt->Bshift, fmt->Ashift};
+    for (int x = 0; x < img->w; x++) {
+        const Uint32 pixel = GetSurfacePixel(p, x, fmt);
+        for (int k = 0; k < 4; k++) {
+            row[x][k] = rows->samples[k][(pixel & masks[k]) >> shifts[k]];
+        }
+    }
+    return 0;
+}
+
+static int WriteSurfaceRow(void *data,
+                           const uint64_t y,
+                           const MagickPixelPacket4 *row) {
+    const SurfaceRows *rows = (const SurfaceRows *)data;
+    const SDL_Surface *img = rows->surface;
+    const SDL_PixelFormat *fmt = img->format;
+    Uint8 *q = (Uint8 *)img->pixels + y * img->pitch;
+    if (rows->direct) {
+        memcpy(q, row, img->w * sizeof(MagickPixelPacket4));
+        return 0;
+    }
+    for (int x = 0; x < img->w; x++) {
+        // nearest palette entry for indexed surfaces, truncated channels
+        // shifted into place for the others
+        SetSurfacePixel(
+            q,
+            x,
+            fmt,
+            SDL_MapRGBA(fmt, row[x][0], row[x][1], row[x][2], row[x][3]));
+    }
+    return 0;
+}
+
+static int StreamSurfaceResize(SDL_Surface *src,
+                               SDL_Surface *dst,
+                               const FilterTypes filter,
+                               const double blur) {
+    SurfaceRows *source = (SurfaceRows *)SDL_malloc(sizeof(SurfaceRows));
+    SurfaceRows *destination = (SurfaceRows *)SDL_malloc(sizeof(SurfaceRows));
+    ResizePlan *plan = NULL;
+    ResizeOptions options;
+    int ret = 2;
+    if (source == NULL || destination == NULL) goto done;
+    InitSurfaceRows(source, src);
+    InitSurfaceRows(destination, dst);
+    plan = CreateResizePlan(src->w, src->h, dst->w, dst->h, filter, blur);
+    if (plan == NULL) goto done;
+    GetResizeOptions(&options);
+    options.alpha = source->opaque ? OpaqueResizeAlpha : MatteResizeAlpha;
+    ret = ResizeImageStream(plan,
+                            source->order,
+                            ReadSurfaceRow,
+                            source,
+                            destination->order,
+                            WriteSurfaceRow,
+                            destination,
+                            &options);
+done:
+    DestroyResizePlan(plan);
+    SDL_free(source);
+    SDL_free(destination);
+    return ret;
 }
 
 int SDLSurfaceResize(SDL_Surface *src,
@@ -35,15 +285,31 @@ int SDLSurfaceResize(SDL_Surface *src,
     int ret = 0;
     MagickImage source;
     MagickImage destination;
-    if (!InitMagickImage(&source, src)) {
+    ResizeOptions options;
+    if (!IsSupportedSurface(src)) {
         ret = -1;
         goto done;
     }
-    if (!InitMagickImage(&destination, dst)) {
+    if (!IsSupportedSurface(dst)) {
         ret = -2;
         goto done;
     }
-    ret = ResizeImage(&source, &destination, filter, blur);
+    if (src->w <= 0 || src->h <= 0 || dst->w <= 0 || dst->h <= 0) {
+        ret = 1;
+        goto done;
+    }
+    // the padding byte of a source without alpha must not become the alpha
+    // of the destination, the streamed rows set it opaque
+    if (InitMagickImage(&source, src) && InitMagickImage(&destination, dst) &&
+        source.format == destination.format &&
+        (src->format->Amask != 0 || dst->format->Amask == 0)) {
+        GetResizeOptions(&options);
+        if (src->format->Amask == 0) options.alpha = OpaqueResizeAlpha;
+        ret = ResizeImageWithOptions(
+            &source, &destination, filter, blur, &options);
+    } else {
+        ret = StreamSurfaceResize(src, dst, filter, blur);
+    }
 done:
     SDL_UnlockSurface(src);
     SDL_UnlockSurface(dst);
@@ -56,14 +322,21 @@ SDL_Surface *SDLSurfaceResizeWrap(SDL_Surface *src,
                                   const FilterTypes filter,
                                   const double blur) {
     SDL_PixelFormat *fmt = src->format;
-    SDL_Surface *dst = SDL_CreateRGBSurface(SDL_SWSURFACE,
-                                            w,
-                                            h,
-                                            fmt->BitsPerPixel,
-                                            fmt->Rmask,
-                                            fmt->Gmask,
-                                            fmt->Bmask,
-                                            fmt->Amask);
+    SDL_Surface *dst;
+    // resized colors are not in the palette, indexed sources become RGBA32
+    if (SDL_ISPIXELFORMAT_INDEXED(fmt->format)) {
+        dst = SDL_CreateRGBSurfaceWithFormat(
+            SDL_SWSURFACE, w, h, 32, SDL_PIXELFORMAT_RGBA32);
+    } else {
+        dst = SDL_CreateRGBSurface(SDL_SWSURFACE,
+                                   w,
+                                   h,
+                                   fmt->BitsPerPixel,
+                                   fmt->Rmask,
+                                   fmt->Gmask,
+                                   fmt->Bmask,
+                                   fmt->Amask);
+    }
     if (dst == NULL) {
         return NULL;
     }
@@ -0,0 +1,278 @@
+#include "thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+#include <process.h>
+
+bool MagickMutexInit(MagickMutex *mutex) {
+    InitializeSRWLock(mutex);
+    return true;
+}
+void MagickMutexDestroy(MagickMutex *mutex) { (void)mutex; }
+void MagickMutexLock(MagickMutex *mutex) { AcquireSRWLockExclusive(mutex); }
+void MagickMutexUnlock(MagickMutex *mutex) { ReleaseSRWLockExclusive(mutex); }
+
+bool MagickCondInit(MagickCond *cond) {
+    InitializeConditionVariable(cond);
+    return true;
+}
+void MagickCondDestroy(MagickCond *cond) { (void)cond; }
+void MagickCondWait(MagickCond *cond, MagickMutex *mutex) {
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+void MagickCondSignal(MagickCond *cond) { WakeConditionVariable(cond); }
+void MagickCondBroadcast(MagickCond *cond) { WakeAllConditionVariable(cond); }
+
+typedef struct _ThreadStart {
+    MagickThreadFunction function;
+    void *arg;
+} ThreadStart;
+
+static unsigned __stdcall ThreadEntry(void *arg) {
+    ThreadStart start = *(ThreadStart *)arg;
+    free(arg);
+    start.function(start.arg);
+    return 0;
+}
+
+bool MagickThreadCreate(MagickThread *thread,
+                        MagickThreadFunction function,
+                        void *arg) {
+    ThreadStart *start = (ThreadStart *)malloc(sizeof(ThreadStart));
+    if (start == NULL) return false;
+    start->function = function;
+    start->arg = arg;
+    *thread = (HANDLE)_beginthreadex(NULL, 0, ThreadEntry, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void MagickThreadJoin(MagickThread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static BOOL CALLBACK OnceEntry(PINIT_ONCE once, PVOID arg, PVOID *context) {
+    (void)once;
+    (void)context;
+    ((void (*)(void))arg)();
+    return TRUE;
+}
+
+void MagickCallOnce(MagickOnce *once, void (*function)(void)) {
+    InitOnceExecuteOnce(once, OnceEntry, (PVOID)function, NULL);
+}
+
+int GetMagickCPUCount(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+uint64_t GetMagickNanoseconds(void) {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 /
+                      (double)frequency.QuadPart);
+}
+#else
+bool MagickMutexInit(MagickMutex *mutex) {
+    return pthread_mutex_init(mutex, NULL) == 0;
+}
+void MagickMutexDestroy(MagickMutex *mutex) { pthread_mutex_destroy(mutex); }
+void MagickMutexLock(MagickMutex *mutex) { pthread_mutex_lock(mutex); }
+void MagickMutexUnlock(MagickMutex *mutex) { pthread_mutex_unlock(mutex); }
+
+bool MagickCondInit(MagickCond *cond) {
+    return pthread_cond_init(cond, NULL) == 0;
+}
+void MagickCondDestroy(MagickCond *cond) { pthread_cond_destroy(cond); }
+void MagickCondWait(MagickCond *cond, MagickMutex *mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+void MagickCondSignal(MagickCond *cond) { pthread_cond_signal(cond); }
+void MagickCondBroadcast(MagickCond *cond) { pthread_cond_broadcast(cond); }
+
+typedef struct _ThreadStart {
+    MagickThreadFunction function;
+    void *arg;
+} ThreadStart;
+
+static void *ThreadEntry(void *arg) {
+    ThreadStart start = *(ThreadStart *)arg;
+    free(arg);
+    start.function(start.arg);
+    return NULL;
+}
+
+bool MagickThreadCreate(MagickThread *thread,
+                        MagickThreadFunction function,
+                        void *arg) {
+    ThreadStart *start = (ThreadStart *)malloc(sizeof(ThreadStart));
+    if (start == NULL) return false;
+    start->function = function;
+    start->arg = arg;
+    if (pthread_create(thread, NULL, ThreadEntry, start) != 0) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void MagickThreadJoin(MagickThread thread) { pthread_join(thread, NULL); }
+
+void MagickCallOnce(MagickOnce *once, void (*function)(void)) {
+    pthread_once(once, function);
+}
+
+int GetMagickCPUCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+uint64_t GetMagickNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+}
+#endif
+
+struct _MagickThreadPool {
+    MagickMutex mutex;
+    MagickCond wake;  // signals a new generation of tasks or shutdown
+    MagickCond done;  // signals that the last task of a run finished
+    MagickMutex run;  // serializes ThreadPoolRun callers
+    MagickThread *threads;
+    int workers;
+    bool shutdown;
+    uint64_t generation;
+    MagickTaskFunction function;
+    void *arg;
+    uint64_t next, count, finished;
+};
+
+/*
+    Claims and runs tasks of the current run until none is left, called with
+    the pool mutex held.
+*/
+static void ThreadPoolDrain(MagickThreadPool *pool) {
+    while (pool->next < pool->count) {
+        uint64_t index = pool->next++;
+        MagickTaskFunction function = pool->function;
+        void *arg = pool->arg;
+        MagickMutexUnlock(&pool->mutex);
+        function(arg, index);
+        MagickMutexLock(&pool->mutex);
+        if (++pool->finished == pool->count) MagickCondBroadcast(&pool->done);
+    }
+}
+
+static void ThreadPoolWorker(void *arg) {
+    MagickThreadPool *pool = (MagickThreadPool *)arg;
+    uint64_t generation = 0;
+    MagickMutexLock(&pool->mutex);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == generation) {
+            MagickCondWait(&pool->wake, &pool->mutex);
+        }
+        if (pool->shutdown) break;
+        generation = pool->generation;
+        ThreadPoolDrain(pool);
+    }
+    MagickMutexUnlock(&pool->mutex);
+}
+
+MagickThreadPool *CreateThreadPool(int threads) {
+    if (threads <= 0) threads = GetMagickCPUCount();
+    MagickThreadPool *pool =
+        (MagickThreadPool *)malloc(sizeof(MagickThreadPool));
+    if (pool == NULL) return NULL;
+    memset(pool, 0, sizeof(MagickThreadPool));
+    if (!MagickMutexInit(&pool->mutex)) {
+        free(pool);
+        return NULL;
+    }
+    if (!MagickMutexInit(&pool->run)) {
+        MagickMutexDestroy(&pool->mutex);
+        free(pool);
+        return NULL;
+    }
+    if (!MagickCondInit(&pool->wake) || !MagickCondInit(&pool->done)) {
+        MagickMutexDestroy(&pool->mutex);
+        MagickMutexDestroy(&pool->run);
+        free(pool);
+        return NULL;
+    }
+    // the thread calling ThreadPoolRun works too
+    pool->threads = (MagickThread *)malloc(sizeof(MagickThread) * threads);
+    if (pool->threads == NULL) {
+        DestroyThreadPool(pool);
+        return NULL;
+    }
+    for (int i = 0; i < threads - 1; i++) {
+        if (!MagickThreadCreate(
+                &pool->threads[i], ThreadPoolWorker, (void *)pool)) {
+            DestroyThreadPool(pool);
+            return NULL;
+        }
+        pool->workers++;
+    }
+    return pool;
+}
+
+void DestroyThreadPool(MagickThreadPool *pool) {
+    if (pool == NULL) return;
+    MagickMutexLock(&pool->mutex);
+    pool->shutdown = true;
+    MagickCondBroadcast(&pool->wake);
+    MagickMutexUnlock(&pool->mutex);
+    for (int i = 0; i < pool->workers; i++) {
+        MagickThreadJoin(pool->threads[i]);
+    }
+    if (pool->threads != NULL) free(pool->threads);
+    MagickCondDestroy(&pool->wake);
+    MagickCondDestroy(&pool->done);
+    MagickMutexDestroy(&pool->mutex);
+    MagickMutexDestroy(&pool->run);
+    free(pool);
+}
+
+int GetThreadPoolSize(const MagickThreadPool *pool) {
+    return pool == NULL ? 1 : pool->workers + 1;
+}
+
+void ThreadPoolRun(MagickThreadPool *pool,
+                   MagickTaskFunction function,
+                   void *arg,
+                   const uint64_t count) {
+    if (pool == NULL || pool->workers == 0 || count <= 1) {
+        for (uint64_t i = 0; i < count; i++) function(arg, i);
+        return;
+    }
+    MagickMutexLock(&pool->run);
+    MagickMutexLock(&pool->mutex);
+    pool->function = function;
+    pool->arg = arg;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->count = count;
+    pool->generation++;
+    MagickCondBroadcast(&pool->wake);
+    ThreadPoolDrain(pool);
+    while (pool->finished < pool->count) {
+        MagickCondWait(&pool->done, &pool->mutex);
+    }
+    MagickMutexUnlock(&pool->mutex);
+    MagickMutexUnlock(&pool->run);
+}
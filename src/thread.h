@@ -0,0 +1,61 @@
+#ifndef _MAGICK_THREAD_H
+#define _MAGICK_THREAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "resize.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+typedef SRWLOCK MagickMutex;
+typedef CONDITION_VARIABLE MagickCond;
+typedef HANDLE MagickThread;
+typedef INIT_ONCE MagickOnce;
+#define MAGICK_ONCE_INIT INIT_ONCE_STATIC_INIT
+#else
+#include <pthread.h>
+typedef pthread_mutex_t MagickMutex;
+typedef pthread_cond_t MagickCond;
+typedef pthread_t MagickThread;
+typedef pthread_once_t MagickOnce;
+#define MAGICK_ONCE_INIT PTHREAD_ONCE_INIT
+#endif
+
+typedef void (*MagickThreadFunction)(void *arg);
+typedef void (*MagickTaskFunction)(void *arg, const uint64_t index);
+
+bool MagickMutexInit(MagickMutex *mutex);
+void MagickMutexDestroy(MagickMutex *mutex);
+void MagickMutexLock(MagickMutex *mutex);
+void MagickMutexUnlock(MagickMutex *mutex);
+
+bool MagickCondInit(MagickCond *cond);
+void MagickCondDestroy(MagickCond *cond);
+void MagickCondWait(MagickCond *cond, MagickMutex *mutex);
+void MagickCondSignal(MagickCond *cond);
+void MagickCondBroadcast(MagickCond *cond);
+
+bool MagickThreadCreate(MagickThread *thread,
+                        MagickThreadFunction function,
+                        void *arg);
+void MagickThreadJoin(MagickThread thread);
+
+void MagickCallOnce(MagickOnce *once, void (*function)(void));
+
+int GetMagickCPUCount(void);
+
+// Monotonic clock in nanoseconds.
+uint64_t GetMagickNanoseconds(void);
+
+/*
+    Runs function(arg, index) for index in [0, count) on the pool workers and
+    the calling thread, returns once every task has finished. A NULL pool
+    runs all tasks on the calling thread.
+*/
+void ThreadPoolRun(MagickThreadPool *pool,
+                   MagickTaskFunction function,
+                   void *arg,
+                   const uint64_t count);
+
+#endif
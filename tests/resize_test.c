@@ -0,0 +1,821 @@
+/*
+    resize-test: checks of the internal kernels and tables, one line per
+    check and a FAIL line for every failure. Exits with 1 when any check
+    failed.
+
+    Every vector kernel set the cpu supports is compared with the scalar
+    kernels on random pixels, for every filter, pixel layout and alpha mode
+    both kinds of kernels exist for. The filter tables are compared with
+    the analytic filters, and the float and fixed point engines with the
+    double one. The ResizeQueue tests hold workers in job callbacks to run
+    cancels, full queues, stealing and destroys at known points.
+*/
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resize_private.h"
+#include "thread.h"
+
+static const char *filter_names[] = {"undefined",
+                                     "point",
+                                     "box",
+                                     "triangle",
+                                     "hermite",
+                                     "hanning",
+                                     "hamming",
+                                     "blackman",
+                                     "gaussian",
+                                     "quadratic",
+                                     "cubic",
+                                     "catrom",
+                                     "mitchell",
+                                     "lanczos",
+                                     "bessel",
+                                     "sinc"};
+
+static int failures = 0;
+
+static void Check(const bool passed, const char *name, const double error) {
+    printf("%s %s %g\n", passed ? "ok  " : "FAIL", name, error);
+    if (!passed) failures++;
+}
+
+static uint32_t random_state = 0x9e3779b9u;
+
+static uint32_t GetRandom(void) {
+    random_state = random_state * 1664525u + 1013904223u;
+    return random_state >> 8;
+}
+
+/*
+    Fills samples of pixel size 4 or 8 up to max in source order: straight
+    alpha with runs of transparent and opaque pixels, alpha max or colors no
+    brighter than their alpha.
+*/
+static void FillPixels(MagickQuantum *pixels,
+                       const uint64_t count,
+                       const bool wide,
+                       const uint32_t max,
+                       const MagickPixelOrder order,
+                       const ResizeAlphaMode alpha) {
+    for (uint64_t x = 0; x < count; x++) {
+        uint32_t sample[4], value = GetRandom();
+        for (int k = 0; k < 4; k++) sample[k] = GetRandom() % (max + 1);
+        if (alpha == OpaqueResizeAlpha || value % 4 == 0) {
+            sample[3] = max;
+        } else if (value % 4 == 1) {
+            sample[3] = 0;
+        }
+        if (alpha == PremultipliedResizeAlpha) {
+            for (int k = 0; k < 3; k++) {
+                sample[k] = sample[k] * sample[3] / max;
+            }
+        }
+        const int channels[4] = {
+            order.red, order.green, order.blue, order.opacity};
+        for (int k = 0; k < 4; k++) {
+            if (wide) {
+                ((uint16_t *)pixels)[x * 4 + channels[k]] = (uint16_t)sample[k];
+            } else {
+                pixels[x * 4 + channels[k]] = (MagickQuantum)sample[k];
+            }
+        }
+    }
+}
+
+static uint32_t GetLargestDifference(const MagickQuantum *a,
+                                     const MagickQuantum *b,
+                                     const uint64_t count,
+                                     const bool wide) {
+    uint32_t largest = 0;
+    for (uint64_t i = 0; i < count * 4; i++) {
+        int32_t difference = wide ? (int32_t)((const uint16_t *)a)[i] -
+                                        (int32_t)((const uint16_t *)b)[i]
+                                  : (int32_t)a[i] - (int32_t)b[i];
+        largest = Max(largest, (uint32_t)AbsoluteValue(difference));
+    }
+    return largest;
+}
+
+/*
+    Layout arrays of ResizeKernels, the wide kernels are single pointers
+    for RGBA64 in OpacityLastPixelLayout. The fixed point kernels read or
+    write the RGBA64 intermediate in any layout. tolerance is the largest
+    difference allowed against the scalar kernels, in samples.
+*/
+typedef struct _KernelMember {
+    const char *name;
+    size_t horizontal, vertical;
+    bool wide;
+    bool wide_source, wide_destination;
+    ResizeAlphaMode alpha;
+    uint32_t tolerance;
+} KernelMember;
+
+#define LayoutMember(name, alpha, tolerance)                 \
+    {#name,                                                  \
+     offsetof(ResizeKernels, name##horizontal),              \
+     offsetof(ResizeKernels, name##vertical),                \
+     false,                                                  \
+     false,                                                  \
+     false,                                                  \
+     alpha,                                                  \
+     tolerance}
+#define WideMember(name, alpha, tolerance)                   \
+    {#name,                                                  \
+     offsetof(ResizeKernels, name##horizontal),              \
+     offsetof(ResizeKernels, name##vertical),                \
+     true,                                                   \
+     true,                                                   \
+     true,                                                   \
+     alpha,                                                  \
+     tolerance}
+#define FixedMember(name, source, destination, alpha, tolerance) \
+    {#name,                                                      \
+     offsetof(ResizeKernels, name##horizontal),                  \
+     offsetof(ResizeKernels, name##vertical),                    \
+     false,                                                      \
+     source,                                                     \
+     destination,                                                \
+     alpha,                                                      \
+     tolerance}
+
+static const KernelMember kernel_members[] = {
+    LayoutMember(, MatteResizeAlpha, 0),
+    FixedMember(fixed_, false, true, MatteResizeAlpha, 0),
+    FixedMember(fixed_plain_, false, true, PremultipliedResizeAlpha, 0),
+    FixedMember(fixed_wide_, true, false, MatteResizeAlpha, 0),
+    FixedMember(fixed_wide_plain_, true, false, PremultipliedResizeAlpha, 0),
+    LayoutMember(float_, MatteResizeAlpha, 0),
+    LayoutMember(float_plain_, PremultipliedResizeAlpha, 0),
+    LayoutMember(opaque_, OpaqueResizeAlpha, 0),
+    LayoutMember(premultiplied_, PremultipliedResizeAlpha, 0),
+    WideMember(wide_, MatteResizeAlpha, 0),
+    WideMember(wide_premultiplied_, PremultipliedResizeAlpha, 0)};
+
+static HorizontalRowKernel GetHorizontalMember(const ResizeKernels *kernels,
+                                               const KernelMember *member,
+                                               const PixelLayout layout) {
+    const HorizontalRowKernel *kernel =
+        (const HorizontalRowKernel *)((const char *)kernels +
+                                      member->horizontal);
+    if (member->wide) {
+        if (kernels == GetScalarResizeKernels()) {
+            return GetFormatHorizontalRowKernel(
+                RGBA64PixelFormat, member->alpha == PremultipliedResizeAlpha);
+        }
+        return kernel[0];
+    }
+    return kernel[layout];
+}
+
+static VerticalRowKernel GetVerticalMember(const ResizeKernels *kernels,
+                                           const KernelMember *member,
+                                           const PixelLayout layout) {
+    const VerticalRowKernel *kernel =
+        (const VerticalRowKernel *)((const char *)kernels + member->vertical);
+    if (member->wide) {
+        if (kernels == GetScalarResizeKernels()) {
+            return GetFormatVerticalRowKernel(
+                RGBA64PixelFormat, member->alpha == PremultipliedResizeAlpha);
+        }
+        return kernel[0];
+    }
+    return kernel[layout];
+}
+
+typedef struct _LayoutOrders {
+    PixelLayout layout;
+    MagickPixelOrder source, destination;
+} LayoutOrders;
+
+static const LayoutOrders layout_orders[] = {
+    {AnyPixelLayout, {0, 1, 2, 3}, {2, 1, 0, 3}},
+    {AnyPixelLayout, {1, 2, 3, 0}, {0, 1, 2, 3}},
+    {OpacityLastPixelLayout, {2, 1, 0, 3}, {2, 1, 0, 3}},
+    {OpacityFirstPixelLayout, {1, 2, 3, 0}, {1, 2, 3, 0}}};
+
+// source columns x rows to columns x rows, down on one axis and up on the
+// other, odd lengths leave a single pixel after the pairs
+static const uint64_t kernel_geometries[][4] = {{61, 37, 29, 83},
+                                                {37, 61, 83, 29}};
+
+/*
+    Largest difference of both passes of plan between kernels and the
+    scalar kernels, the vertical pass filters plan->columns columns.
+*/
+static uint32_t CompareKernels(const ResizeKernels *kernels,
+                               const KernelMember *member,
+                               const LayoutOrders *orders,
+                               const ResizePlan *plan,
+                               bool *tested) {
+    const ResizeKernels *scalar = GetScalarResizeKernels();
+    const uint64_t size = member->wide_source ? 8 : 4;
+    const uint64_t destination_size = member->wide_destination ? 8 : 4;
+    // the fixed point intermediate holds premultiplied samples * 128
+    const bool intermediate = member->wide_source && !member->wide;
+    const MagickPixelOrder source_order =
+        member->wide ? OpacityLastOrder : orders->source;
+    const MagickPixelOrder destination_order =
+        member->wide ? OpacityLastOrder : orders->destination;
+    const PixelLayout layout =
+        member->wide ? OpacityLastPixelLayout : orders->layout;
+    HorizontalRowKernel horizontal =
+        GetHorizontalMember(kernels, member, layout);
+    VerticalRowKernel vertical = GetVerticalMember(kernels, member, layout);
+    const uint64_t length = Max(plan->src_columns, plan->columns);
+    MagickQuantum *source =
+        (MagickQuantum *)malloc(plan->src_rows * length * size);
+    MagickQuantum *expected =
+        (MagickQuantum *)malloc(length * destination_size);
+    MagickQuantum *actual = (MagickQuantum *)malloc(length * destination_size);
+    const MagickPixelPacket4 *rows[64];
+    uint32_t largest = 0;
+
+    *tested = false;
+    if (source == NULL || expected == NULL || actual == NULL) {
+        largest = UINT32_MAX;
+        goto done;
+    }
+    FillPixels(source,
+               plan->src_rows * length,
+               member->wide_source,
+               intermediate ? MaxFixedIntermediate
+               : member->wide_source ? MaxRGB16
+                                     : MaxRGB,
+               source_order,
+               intermediate ? PremultipliedResizeAlpha : member->alpha);
+    if (horizontal != NULL) {
+        HorizontalRowKernel reference =
+            GetHorizontalMember(scalar, member, layout);
+        for (uint64_t y = 0; y < plan->src_rows; y++) {
+            const MagickPixelPacket4 *p =
+                (const MagickPixelPacket4 *)(source + y * length * size);
+            reference(&plan->horizontal,
+                      p,
+                      source_order,
+                      (MagickPixelPacket4 *)expected,
+                      destination_order);
+            horizontal(&plan->horizontal,
+                       p,
+                       source_order,
+                       (MagickPixelPacket4 *)actual,
+                       destination_order);
+            largest = Max(largest,
+                          GetLargestDifference(expected,
+                                               actual,
+                                               plan->columns,
+                                               member->wide_destination));
+        }
+        *tested = true;
+    }
+    if (vertical != NULL && plan->vertical.max_count <= 64) {
+        VerticalRowKernel reference = GetVerticalMember(scalar, member, layout);
+        for (uint64_t y = 0; y < plan->rows; y++) {
+            const ContributionWindow *window = &plan->vertical.windows[y];
+            for (int64_t i = 0; i < window->count; i++) {
+                rows[i] = (const MagickPixelPacket4 *)(
+                    source + (uint64_t)(window->start + i) * length * size);
+            }
+            reference(&plan->vertical,
+                      y,
+                      rows,
+                      source_order,
+                      (MagickPixelPacket4 *)expected,
+                      plan->columns,
+                      destination_order);
+            vertical(&plan->vertical,
+                     y,
+                     rows,
+                     source_order,
+                     (MagickPixelPacket4 *)actual,
+                     plan->columns,
+                     destination_order);
+            largest = Max(largest,
+                          GetLargestDifference(expected,
+                                               actual,
+                                               plan->columns,
+                                               member->wide_destination));
+        }
+        *tested = true;
+    }
+done:
+    free(source);
+    free(expected);
+    free(actual);
+    return largest;
+}
+
+static void TestKernelSets(void) {
+    static const char *names[] = {"sse2", "sse4.1", "avx2"};
+    const size_t members = sizeof(kernel_members) / sizeof(kernel_members[0]);
+    const size_t layouts = sizeof(layout_orders) / sizeof(layout_orders[0]);
+    const size_t geometries =
+        sizeof(kernel_geometries) / sizeof(kernel_geometries[0]);
+
+    for (size_t s = 0; s < sizeof(names) / sizeof(names[0]); s++) {
+        const ResizeKernels *kernels = GetSIMDResizeKernelsByName(names[s]);
+        if (kernels == NULL) {
+            printf("skip %s kernels, not supported\n", names[s]);
+            continue;
+        }
+        for (size_t m = 0; m < members; m++) {
+            const KernelMember *member = &kernel_members[m];
+            uint32_t largest = 0;
+            bool tested = false;
+            for (int filter = PointFilter; filter <= SincFilter; filter++) {
+                for (size_t g = 0; g < geometries; g++) {
+                    const uint64_t *geometry = kernel_geometries[g];
+                    ResizePlan *plan = CreateResizePlan(geometry[0],
+                                                        geometry[1],
+                                                        geometry[2],
+                                                        geometry[3],
+                                                        (FilterTypes)filter,
+                                                        1.0);
+                    if (plan == NULL) {
+                        largest = UINT32_MAX;
+                        continue;
+                    }
+                    for (size_t l = 0; l < layouts; l++) {
+                        bool compared;
+                        uint32_t difference = CompareKernels(
+                            kernels, member, &layout_orders[l], plan,
+                            &compared);
+                        if (difference > member->tolerance) {
+                            printf("     %s %skernels %s layout %d differs "
+                                   "by %u\n",
+                                   names[s],
+                                   member->name,
+                                   filter_names[filter],
+                                   (int)layout_orders[l].layout,
+                                   difference);
+                        }
+                        largest = Max(largest, difference);
+                        tested = tested || compared;
+                    }
+                    DestroyResizePlan(plan);
+                }
+            }
+            if (!tested) continue;
+            char name[64];
+            snprintf(name,
+                     sizeof(name),
+                     "%s %skernels against scalar",
+                     names[s],
+                     member->name);
+            Check(largest <= member->tolerance, name, (double)largest);
+        }
+    }
+}
+
+/*
+    The filter tables against the analytic filters on a grid that does not
+    line up with the table samples, past support + 1 both are analytic.
+*/
+static void TestFilterTables(void) {
+    for (int filter = PointFilter; filter <= SincFilter; filter++) {
+        double largest = 0.0;
+        for (int i = -6 * 4099; i <= 6 * 4099; i++) {
+            const double x = i / 4099.0;
+            double error = GetFilterValue((FilterTypes)filter, x, true) -
+                           GetFilterValue((FilterTypes)filter, x, false);
+            largest = Max(largest, AbsoluteValue(error));
+        }
+        char name[64];
+        snprintf(name,
+                 sizeof(name),
+                 "%s table against analytic",
+                 filter_names[filter]);
+        Check(largest < 1.0e-6, name, largest);
+    }
+}
+
+// sources of the engine comparisons, all straight alpha
+typedef enum {
+    OpaqueTestImage,    // alpha 255
+    MatteTestImage,     // runs of transparent and opaque pixels
+    LowAlphaTestImage,  // alpha below 8, normalizing amplifies every error
+    TestImageCount
+} TestImage;
+
+static const char *test_image_names[] = {"opaque", "matte", "low alpha"};
+
+/*
+    Largest differences of a resize against the double engine. Colors off
+    by more than color_tolerance pass when the difference times the larger
+    alpha of both results, what stays visible after compositing, is within
+    premultiplied_tolerance.
+*/
+typedef struct _EngineTolerance {
+    uint32_t alpha, color;
+    double premultiplied;
+} EngineTolerance;
+
+typedef struct _EngineDifference {
+    uint32_t alpha, color;
+    double premultiplied;  // of the colors beyond the color tolerance
+    uint64_t beyond;       // colors beyond the color tolerance
+} EngineDifference;
+
+// the last ones reduce one axis by a large ratio, windows of thousands of taps
+static const uint64_t engine_geometries[][4] = {{61, 37, 29, 83},
+                                                {97, 89, 300, 41},
+                                                {200, 150, 77, 211},
+                                                {9001, 8, 3, 8},
+                                                {8, 20001, 8, 3}};
+
+static bool CompareEngine(const ResizeEngineType engine,
+                          const FilterTypes filter,
+                          const TestImage kind,
+                          const EngineTolerance *tolerance,
+                          EngineDifference *difference) {
+    const MagickPixelOrder order = {2, 1, 0, 3};
+    const size_t geometries =
+        sizeof(engine_geometries) / sizeof(engine_geometries[0]);
+    bool passed = true;
+
+    for (size_t g = 0; g < geometries; g++) {
+        const uint64_t *geometry = engine_geometries[g];
+        MagickImage src = {NULL, order, geometry[0], geometry[1], 0, 0};
+        MagickImage expected = {NULL, order, geometry[2], geometry[3], 0, 0};
+        MagickImage actual = expected;
+        ResizeOptions options;
+        const uint64_t count = expected.columns * expected.rows;
+        src.pixels = (MagickPixelPacket4 *)malloc(
+            src.columns * src.rows * sizeof(MagickPixelPacket4));
+        expected.pixels =
+            (MagickPixelPacket4 *)malloc(count * sizeof(MagickPixelPacket4));
+        actual.pixels =
+            (MagickPixelPacket4 *)malloc(count * sizeof(MagickPixelPacket4));
+        if (src.pixels == NULL || expected.pixels == NULL ||
+            actual.pixels == NULL) {
+            passed = false;
+            goto next;
+        }
+        FillPixels((MagickQuantum *)src.pixels,
+                   src.columns * src.rows,
+                   false,
+                   MaxRGB,
+                   order,
+                   kind == OpaqueTestImage ? OpaqueResizeAlpha
+                                           : MatteResizeAlpha);
+        if (kind == LowAlphaTestImage) {
+            for (uint64_t i = 0; i < src.columns * src.rows; i++) {
+                src.pixels[i][order.opacity] %= 8;
+            }
+        }
+        GetResizeOptions(&options);
+        if (ResizeImageWithOptions(&src, &expected, filter, 1.0, &options) !=
+            0) {
+            passed = false;
+            goto next;
+        }
+        options.engine = engine;
+        if (ResizeImageWithOptions(&src, &actual, filter, 1.0, &options) !=
+            0) {
+            passed = false;
+            goto next;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            const MagickQuantum *a = expected.pixels[i], *b = actual.pixels[i];
+            const int o = order.opacity;
+            const uint32_t alpha = (uint32_t)AbsoluteValue(a[o] - b[o]);
+            difference->alpha = Max(difference->alpha, alpha);
+            passed = passed && alpha <= tolerance->alpha;
+            for (int k = 0; k < 4; k++) {
+                if (k == o) continue;
+                const uint32_t color = (uint32_t)AbsoluteValue(a[k] - b[k]);
+                difference->color = Max(difference->color, color);
+                if (color <= tolerance->color) continue;
+                const double premultiplied =
+                    color * Max(a[o], b[o]) / MaxRGBDouble;
+                difference->premultiplied =
+                    Max(difference->premultiplied, premultiplied);
+                difference->beyond++;
+                passed = passed && premultiplied <= tolerance->premultiplied;
+            }
+        }
+    next:
+        free(src.pixels);
+        free(expected.pixels);
+        free(actual.pixels);
+    }
+    return passed;
+}
+
+static void TestEngine(const ResizeEngineType engine,
+                       const char *engine_name,
+                       const EngineTolerance *tolerance) {
+    for (int filter = PointFilter; filter <= SincFilter; filter++) {
+        for (int kind = 0; kind < TestImageCount; kind++) {
+            EngineDifference difference = {0, 0, 0.0, 0};
+            bool passed = CompareEngine(engine,
+                                        (FilterTypes)filter,
+                                        (TestImage)kind,
+                                        tolerance,
+                                        &difference);
+            char name[96];
+            snprintf(name,
+                     sizeof(name),
+                     "%s %s %s against double, alpha %u, color %u, "
+                     "%llu colors beyond %u, premultiplied",
+                     engine_name,
+                     filter_names[filter],
+                     test_image_names[kind],
+                     difference.alpha,
+                     difference.color,
+                     (unsigned long long)difference.beyond,
+                     tolerance->color);
+            Check(passed, name, difference.premultiplied);
+        }
+    }
+}
+
+/*
+    Job callbacks record their status, a held one blocks its worker until
+    the gate opens.
+*/
+typedef struct _JobGate {
+    MagickMutex mutex;
+    MagickCond cond;
+    bool open;
+} JobGate;
+
+typedef struct _JobRecord {
+    JobGate *gate;
+    bool hold;
+    int calls, status;
+} JobRecord;
+
+static void RecordJob(void *data, const int status) {
+    JobRecord *record = (JobRecord *)data;
+    JobGate *gate = record->gate;
+    MagickMutexLock(&gate->mutex);
+    record->calls++;
+    record->status = status;
+    MagickCondBroadcast(&gate->cond);
+    while (record->hold && !gate->open) {
+        MagickCondWait(&gate->cond, &gate->mutex);
+    }
+    MagickMutexUnlock(&gate->mutex);
+}
+
+// Blocks until the callback of record ran, a held one until it is holding.
+static void WaitJobRecord(JobGate *gate, const JobRecord *record) {
+    MagickMutexLock(&gate->mutex);
+    while (record->calls == 0) MagickCondWait(&gate->cond, &gate->mutex);
+    MagickMutexUnlock(&gate->mutex);
+}
+
+static void OpenJobGate(JobGate *gate) {
+    MagickMutexLock(&gate->mutex);
+    gate->open = true;
+    MagickCondBroadcast(&gate->cond);
+    MagickMutexUnlock(&gate->mutex);
+}
+
+static int GetJobRecordStatus(JobGate *gate, const JobRecord *record) {
+    int status;
+    MagickMutexLock(&gate->mutex);
+    status = record->calls == 1 ? record->status : -1;
+    MagickMutexUnlock(&gate->mutex);
+    return status;
+}
+
+// Polls job for at most 10 seconds, -1 when it is still not done.
+static int PollResizeJob(const ResizeJob *job) {
+    const uint64_t deadline = GetMagickNanoseconds() + 10000000000ull;
+    int status;
+    while ((status = GetResizeJobStatus(job)) == -1 &&
+           GetMagickNanoseconds() < deadline) {
+    }
+    return status;
+}
+
+static void DestroyQueueThread(void *arg) {
+    DestroyResizeQueue((ResizeQueue *)arg);
+}
+
+#define QueueTestJobs 4
+
+static void TestResizeQueue(void) {
+    const MagickPixelOrder order = {2, 1, 0, 3};
+    MagickImage src = {NULL, order, 64, 48, 0, 0};
+    MagickImage expected = {NULL, order, 29, 37, 0, 0};
+    MagickImage dst[QueueTestJobs];
+    JobRecord records[QueueTestJobs];
+    ResizeJob *jobs[QueueTestJobs];
+    JobGate gate;
+    ResizeQueue *queue;
+    MagickThread destroyer;
+    const uint64_t count = expected.columns * expected.rows;
+    bool passed;
+    int status;
+
+    src.pixels = (MagickPixelPacket4 *)malloc(src.columns * src.rows *
+                                              sizeof(MagickPixelPacket4));
+    expected.pixels =
+        (MagickPixelPacket4 *)malloc(count * sizeof(MagickPixelPacket4));
+    passed = src.pixels != NULL && expected.pixels != NULL;
+    for (int i = 0; i < QueueTestJobs; i++) {
+        dst[i] = expected;
+        dst[i].pixels =
+            (MagickPixelPacket4 *)malloc(count * sizeof(MagickPixelPacket4));
+        passed = passed && dst[i].pixels != NULL;
+    }
+    if (!passed || !MagickMutexInit(&gate.mutex)) {
+        Check(false, "queue test setup", 0.0);
+        goto done;
+    }
+    if (!MagickCondInit(&gate.cond)) {
+        MagickMutexDestroy(&gate.mutex);
+        Check(false, "queue test setup", 0.0);
+        goto done;
+    }
+    FillPixels((MagickQuantum *)src.pixels,
+               src.columns * src.rows,
+               false,
+               MaxRGB,
+               order,
+               MatteResizeAlpha);
+    ResizeImage(&src, &expected, LanczosFilter, 1.0);
+
+    // submit, then wait for one job and poll the other
+    queue = CreateResizeQueue(2, 4, NULL);
+    status = SubmitResizeJob(queue,
+                             &src,
+                             &dst[0],
+                             LanczosFilter,
+                             1.0,
+                             NULL,
+                             NULL,
+                             DefaultResizeSubmit,
+                             &jobs[0]) |
+             SubmitResizeJob(queue,
+                             &src,
+                             &dst[1],
+                             LanczosFilter,
+                             1.0,
+                             NULL,
+                             NULL,
+                             DefaultResizeSubmit,
+                             &jobs[1]);
+    passed = status == 0 && WaitResizeJob(jobs[0]) == 0 &&
+             PollResizeJob(jobs[1]) == 0;
+    for (int i = 0; i < 2 && passed; i++) {
+        passed = GetLargestDifference((const MagickQuantum *)expected.pixels,
+                                      (const MagickQuantum *)dst[i].pixels,
+                                      count,
+                                      false) == 0;
+    }
+    Check(passed, "queue submit, wait and poll match ResizeImage", 0.0);
+    ReleaseResizeJob(jobs[0]);
+    ReleaseResizeJob(jobs[1]);
+    DestroyResizeQueue(queue);
+
+    /*
+        One worker of depth 1 held by job 0: job 1 fills the queue, job 2
+        does not fit and job 1 is cancelled.
+    */
+    gate.open = false;
+    for (int i = 0; i < QueueTestJobs; i++) {
+        records[i] = (JobRecord){&gate, i == 0, 0, 0};
+    }
+    queue = CreateResizeQueue(1, 1, NULL);
+    for (int i = 0; i < 3; i++) {
+        jobs[i] = NULL;
+        status = SubmitResizeJob(queue,
+                                 &src,
+                                 &dst[i],
+                                 LanczosFilter,
+                                 1.0,
+                                 RecordJob,
+                                 &records[i],
+                                 NoWaitResizeSubmit,
+                                 &jobs[i]);
+        if (i == 0) WaitJobRecord(&gate, &records[0]);
+        Check(status == (i < 2 ? 0 : 32),
+              i < 2 ? "queue submit without waiting"
+                    : "queue full without waiting returns 32",
+              (double)status);
+    }
+    passed = jobs[2] == NULL && CancelResizeJob(jobs[1]);
+    status = GetJobRecordStatus(&gate, &records[1]);
+    Check(passed && status == 16 && GetResizeJobStatus(jobs[1]) == 16,
+          "queue cancel calls back with 16",
+          (double)status);
+    OpenJobGate(&gate);
+    Check(WaitResizeJob(jobs[0]) == 0 && !CancelResizeJob(jobs[0]) &&
+              GetJobRecordStatus(&gate, &records[0]) == 0,
+          "queue cancel of a done job fails",
+          0.0);
+    ReleaseResizeJob(jobs[0]);
+    ReleaseResizeJob(jobs[1]);
+    DestroyResizeQueue(queue);
+
+    /*
+        Two workers, one held by job 0: job 1 of the same geometry goes to
+        the held worker, whose context holds its plan, and has to be stolen.
+    */
+    gate.open = false;
+    for (int i = 0; i < QueueTestJobs; i++) {
+        records[i] = (JobRecord){&gate, i == 0, 0, 0};
+    }
+    queue = CreateResizeQueue(2, 4, NULL);
+    passed = true;
+    for (int i = 0; i < QueueTestJobs; i++) {
+        status = SubmitResizeJob(queue,
+                                 &src,
+                                 &dst[i],
+                                 LanczosFilter,
+                                 1.0,
+                                 RecordJob,
+                                 &records[i],
+                                 DefaultResizeSubmit,
+                                 &jobs[i]);
+        passed = passed && status == 0;
+        if (i == 0) WaitJobRecord(&gate, &records[0]);
+    }
+    for (int i = 1; i < QueueTestJobs; i++) {
+        passed = passed && PollResizeJob(jobs[i]) == 0;
+    }
+    Check(passed, "queue idle worker steals from a held one", 0.0);
+    OpenJobGate(&gate);
+    for (int i = 0; i < QueueTestJobs; i++) {
+        WaitResizeJob(jobs[i]);
+        ReleaseResizeJob(jobs[i]);
+    }
+    DestroyResizeQueue(queue);
+
+    /*
+        One worker held by job 0 while the queue is destroyed: the queued
+        jobs are cancelled, the held one finishes, and the handles stay
+        valid until released.
+    */
+    gate.open = false;
+    for (int i = 0; i < QueueTestJobs; i++) {
+        records[i] = (JobRecord){&gate, i == 0, 0, 0};
+    }
+    queue = CreateResizeQueue(1, 4, NULL);
+    passed = true;
+    for (int i = 0; i < QueueTestJobs; i++) {
+        status = SubmitResizeJob(queue,
+                                 &src,
+                                 &dst[i],
+                                 LanczosFilter,
+                                 1.0,
+                                 RecordJob,
+                                 &records[i],
+                                 DefaultResizeSubmit,
+                                 i < 3 ? &jobs[i] : NULL);
+        passed = passed && status == 0;
+        if (i == 0) WaitJobRecord(&gate, &records[0]);
+    }
+    if (MagickThreadCreate(&destroyer, DestroyQueueThread, queue)) {
+        for (int i = 1; i < QueueTestJobs; i++) {
+            WaitJobRecord(&gate, &records[i]);
+        }
+        OpenJobGate(&gate);
+        MagickThreadJoin(destroyer);
+    } else {
+        passed = false;
+        OpenJobGate(&gate);
+        DestroyResizeQueue(queue);
+    }
+    for (int i = 0; i < QueueTestJobs; i++) {
+        passed = passed && GetJobRecordStatus(&gate, &records[i]) ==
+                               (i == 0 ? 0 : 16);
+    }
+    for (int i = 0; i < 3; i++) {
+        passed = passed && GetResizeJobStatus(jobs[i]) == (i == 0 ? 0 : 16);
+        ReleaseResizeJob(jobs[i]);
+    }
+    Check(passed, "queue destroy cancels queued jobs, handles stay valid", 0.0);
+
+    MagickCondDestroy(&gate.cond);
+    MagickMutexDestroy(&gate.mutex);
+done:
+    for (int i = 0; i < QueueTestJobs; i++) free(dst[i].pixels);
+    free(src.pixels);
+    free(expected.pixels);
+}
+
+int main(void) {
+    /*
+        A whole resize on the float and fixed point engines is within 1 of
+        the double one. The straight colors of almost transparent pixels
+        come from sums divided by their small alpha and may differ by far
+        more, but premultiplied by their alpha they are within 1 as well.
+    */
+    const EngineTolerance tolerance = {1, 1, 1.0};
+
+    TestKernelSets();
+    TestFilterTables();
+    TestEngine(FloatResizeEngine, "float", &tolerance);
+    TestEngine(FixedPointResizeEngine, "fixed", &tolerance);
+    TestResizeQueue();
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -10,6 +10,21 @@ option("example")
     set_showmenu(true)
 option_end()
 
+option("bench")
+    set_default(false)
+    set_showmenu(true)
+option_end()
+
+option("cli")
+    set_default(false)
+    set_showmenu(true)
+option_end()
+
+option("test")
+    set_default(false)
+    set_showmenu(true)
+option_end()
+
 if is_plat("windows") then
     add_cxflags("/utf-8")
 end
@@ -18,12 +33,18 @@ add_repositories("zeromake https://github.com/zeromake/xrepo.git")
 
 if get_config("sdl") then
     add_requires("sdl2")
+    if get_config("cli") then
+        add_requires("sdl2_image")
+    end
 end
 
 target("resize")
     set_kind("static")
-    add_headerfiles("src/*.h", {prefixdir="resize"})
+    add_headerfiles("src/resize.h", "src/sdl_resize.h", {prefixdir="resize"})
     add_files("src/*.c")
+    if is_plat("linux", "bsd", "android") then
+        add_syslinks("pthread", {public = true})
+    end
     if get_config("sdl") then
         add_defines("USE_SDL")
         add_packages("sdl2")
@@ -40,3 +61,37 @@ if get_config("example") then
         add_packages("sdl2", "sdl2_image")
     target_end()
 end
+
+if get_config("bench") then
+    target("resize-bench")
+        set_kind("binary")
+        add_deps("resize")
+        add_files("bench/resize_bench.c")
+        add_includedirs("src")
+        if is_plat("windows") then
+            add_syslinks("psapi")
+        end
+    target_end()
+end
+
+if get_config("cli") then
+    target("resize-cli")
+        set_kind("binary")
+        add_deps("resize")
+        add_files("cli/resize_cli.c")
+        add_includedirs("src")
+        if get_config("sdl") then
+            add_defines("USE_SDL_IMAGE")
+            add_packages("sdl2", "sdl2_image")
+        end
+    target_end()
+end
+
+if get_config("test") then
+    target("resize-test")
+        set_kind("binary")
+        add_deps("resize")
+        add_files("tests/resize_test.c")
+        add_includedirs("src")
+    target_end()
+end